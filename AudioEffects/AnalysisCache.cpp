@@ -0,0 +1,184 @@
+//
+//  AnalysisCache.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/9.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "AnalysisCache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// First line of every cache file, files starting with anything else are ignored
+static const char *cache_header = "# AudioEffects analysis cache 2";
+
+// Splits line at every separator
+static std::vector<std::string> split(const std::string &line, char separator){
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while(true){
+        size_t end = line.find(separator, start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if(end == std::string::npos){
+            return fields;
+        }
+        start = end + 1;
+    }
+}
+
+// Comma separated list of values, written with enough digits to read back exactly
+static std::string joinValues(const std::vector<float> &values){
+    std::stringstream s;
+    s.precision(std::numeric_limits<float>::max_digits10);
+    for(size_t i = 0; i < values.size(); ++i){
+        s << (i ? "," : "") << values[i];
+    }
+    return s.str();
+}
+
+// strtod rather than streams, which won't read back the -inf of silent files
+static std::vector<float> parseValues(const std::string &field){
+    std::vector<float> values;
+    if(!field.empty()){
+        std::vector<std::string> parts = split(field, ',');
+        for(size_t i = 0; i < parts.size(); ++i){
+            values.push_back((float)strtod(parts[i].c_str(), NULL));
+        }
+    }
+    return values;
+}
+
+// Default Constructor
+AnalysisCache::AnalysisCache(){
+}
+
+// Constructor
+// Loads the cache file at path, if there is one
+AnalysisCache::AnalysisCache(std::string p){
+    load(p);
+}
+
+// Replaces the contents with the cache file at path
+// Lines that don't parse are skipped, the worst a damaged cache can do is cost a scan
+// Each line is: file, size, modification time in seconds and nanoseconds, channels, sample rate, frames,
+// peak, true peak, rms, loudness, then the per channel peaks, true peaks and rms
+void AnalysisCache::load(std::string p){
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    path = p;
+
+    std::ifstream in(path);
+    std::string line;
+    if(!in || !std::getline(in, line) || line != cache_header){
+        return;
+    }
+
+    while(std::getline(in, line)){
+        std::vector<std::string> fields = split(line, '\t');
+        if(fields.size() != 14){
+            continue;
+        }
+        Entry entry;
+        entry.stamp.size = strtoull(fields[1].c_str(), NULL, 10);
+        entry.stamp.modified = strtoll(fields[2].c_str(), NULL, 10);
+        entry.stamp.modified_nanoseconds = (uint32_t)strtoul(fields[3].c_str(), NULL, 10);
+
+        AudioAnalysis &a = entry.analysis;
+        a.num_channels = atoi(fields[4].c_str());
+        a.sample_rate = (uint32_t)strtoul(fields[5].c_str(), NULL, 10);
+        a.num_frames = strtoull(fields[6].c_str(), NULL, 10);
+        a.peak = (float)strtod(fields[7].c_str(), NULL);
+        a.true_peak = (float)strtod(fields[8].c_str(), NULL);
+        a.rms = (float)strtod(fields[9].c_str(), NULL);
+        a.loudness = (float)strtod(fields[10].c_str(), NULL);
+        a.channel_peak = parseValues(fields[11]);
+        a.channel_true_peak = parseValues(fields[12]);
+        a.channel_rms = parseValues(fields[13]);
+
+        size_t n = (size_t)a.num_channels;
+        if(a.channel_peak.size() == n && a.channel_true_peak.size() == n && a.channel_rms.size() == n){
+            entries[fields[0]] = entry;
+        }
+    }
+}
+
+// Writes every entry to the cache file
+// Written next to it first, then renamed over it
+void AnalysisCache::save(){
+    std::lock_guard<std::mutex> guard(lock);
+    if(path.empty()){
+        throw std::logic_error("AnalysisCache Error: No cache file to save to!");
+    }
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary);
+        if(!out){
+            throw std::runtime_error("AnalysisCache Error: Couldn't write " + temporary + "!");
+        }
+        out.precision(std::numeric_limits<float>::max_digits10);
+        out << cache_header << "\n";
+        for(std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it){
+            const AudioAnalysis &a = it->second.analysis;
+            out << it->first << "\t" << it->second.stamp.size << "\t" << it->second.stamp.modified;
+            out << "\t" << it->second.stamp.modified_nanoseconds;
+            out << "\t" << a.num_channels << "\t" << a.sample_rate << "\t" << a.num_frames;
+            out << "\t" << a.peak << "\t" << a.true_peak << "\t" << a.rms << "\t" << a.loudness;
+            out << "\t" << joinValues(a.channel_peak) << "\t" << joinValues(a.channel_true_peak);
+            out << "\t" << joinValues(a.channel_rms) << "\n";
+        }
+        if(!out.flush()){
+            throw std::runtime_error("AnalysisCache Error: Couldn't write " + temporary + "!");
+        }
+    }
+    if(rename(temporary.c_str(), path.c_str()) != 0){
+        remove(temporary.c_str());
+        throw std::runtime_error("AnalysisCache Error: Couldn't replace " + path + "!");
+    }
+}
+
+// Fills analysis and returns true if there is one for file as stamp describes it
+bool AnalysisCache::lookup(const std::string &file, const FileStamp &stamp, AudioAnalysis &analysis){
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Entry>::iterator it = entries.find(file);
+    if(it == entries.end() || !compareStamps(it->second.stamp, stamp)){
+        return false;
+    }
+    analysis = it->second.analysis;
+    return true;
+}
+
+// Remembers analysis of file as stamp describes it
+// Names that would break the line format aren't kept
+void AnalysisCache::store(const std::string &file, const FileStamp &stamp, const AudioAnalysis &analysis){
+    if(file.find_first_of("\t\r\n") != std::string::npos){
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    Entry &entry = entries[file];
+    entry.stamp = stamp;
+    entry.analysis = analysis;
+}
+
+// Forgets everything
+void AnalysisCache::clear(){
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+}
+
+// Getters
+size_t AnalysisCache::getNumEntries(){
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+
+std::string AnalysisCache::getPath(){
+    std::lock_guard<std::mutex> guard(lock);
+    return path;
+}
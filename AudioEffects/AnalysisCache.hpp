@@ -0,0 +1,74 @@
+//
+//  AnalysisCache.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/9.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef AnalysisCache_hpp
+#define AnalysisCache_hpp
+
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include "AudioAnalyzer.hpp"
+#include "WavCommon.hpp"
+
+/* AnalysisCache class
+ *
+ * Analyses of files on disk, kept between runs in a cache file
+ *
+ * Each analysis is stored with the size and modification time the file
+ * had when it was read, and is only handed back while the file still has
+ * them, so edited files are analyzed again. The cache file is plain text,
+ * one file per line, and is replaced in one rename when saved so a crash
+ * never leaves half of one behind.
+ *
+ * Safe to use from several threads at once.
+ */
+class AnalysisCache {
+public:
+
+    // Default Constructor
+    // Empty, and not saved anywhere
+    AnalysisCache();
+
+    // Constructor
+    // Loads the cache file at path, if there is one
+    explicit AnalysisCache(std::string path);
+
+    // Replaces the contents with the cache file at path, and saves there from now on
+    // A missing file is an empty cache
+    void load(std::string path);
+
+    // Writes every entry to the cache file
+    void save();
+
+    // Fills analysis and returns true if there is one for file as stamp describes it
+    bool lookup(const std::string &file, const FileStamp &stamp, AudioAnalysis &analysis);
+
+    // Remembers analysis of file as stamp describes it
+    void store(const std::string &file, const FileStamp &stamp, const AudioAnalysis &analysis);
+
+    // Forgets everything
+    void clear();
+
+    // Getters
+    size_t getNumEntries();
+    std::string getPath();
+
+protected:
+private:
+    struct Entry {
+        FileStamp stamp;
+        AudioAnalysis analysis;
+    };
+
+    std::map<std::string, Entry> entries;
+    std::string path;
+    std::mutex lock;
+};
+
+#endif /* AnalysisCache_hpp */
@@ -0,0 +1,530 @@
+//
+//  AudioAnalyzer.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/9.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "AudioAnalyzer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include "AnalysisCache.hpp"
+#include "SampleConversion.hpp"
+#include "ThreadPool.hpp"
+#include "WavCommon.hpp"
+#include "WavFile.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AUDIOEFFECTS_X86 1
+#include <immintrin.h>
+#endif
+
+// True peak interpolation
+// Each of the 3 points between two samples is interpolated from the 12 samples
+// around it, 5 before the first of the two and 6 after it. Like the filter
+// in BS.1770 that's within a few hundredths of a dB up to about 0.35 of the
+// sample rate, and a few tenths off right up by Nyquist
+static const int tp_phases = 3;
+static const int tp_taps = 12;
+static const int tp_before = 5;
+static const int tp_after = tp_taps - tp_before - 1;
+static const double tp_kaiser_beta = 6.0;
+
+// Squares are summed in floats this many frames at a time, then added to a double
+static const size_t chunk_frames = 4096;
+
+// About how many frames each task analyzes, rounded to whole loudness steps
+static const size_t segment_frames = 1 << 18;
+
+// Loudness gating, BS.1770-4
+static const double absolute_gate = -70.0; // LUFS
+static const double relative_gate = -10.0; // LU below the loudness of the blocks over the absolute gate
+static const int steps_per_block = 4; // Blocks are 400ms, overlapping by 75%
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x){
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 50; ++k){
+        term *= (x/(2*k))*(x/(2*k));
+        sum += term;
+        if(term < sum*1e-12){
+            break;
+        }
+    }
+    return sum;
+}
+
+// Interpolation filter for the true peak, one row of taps per point between samples
+struct TruePeakFilter {
+    float rows[tp_phases][tp_taps];
+
+    // Kaiser windowed sinc, each row normalized to unity gain at DC
+    TruePeakFilter(){
+        double half_width = tp_before + 1;
+        for(int p = 0; p < tp_phases; ++p){
+            double fraction = (p + 1)/(double)(tp_phases + 1);
+            double h[tp_taps];
+            double sum = 0.0;
+            for(int k = 0; k < tp_taps; ++k){
+                // Distance from the point to the sample this tap multiplies
+                double t = fraction + tp_before - k;
+                double u = t/half_width;
+                double window = besselI0(tp_kaiser_beta*sqrt(std::max(0.0, 1 - u*u)))/besselI0(tp_kaiser_beta);
+                h[k] = sin(M_PI*t)/(M_PI*t)*window;
+                sum += h[k];
+            }
+            for(int k = 0; k < tp_taps; ++k){
+                rows[p][k] = (float)(h[k]/sum);
+            }
+        }
+    }
+};
+
+// What a task finds in its segment of one channel
+struct ChannelStats {
+    float peak;
+    float true_peak;
+    double sum_squares;
+};
+
+// ---- Kernels, each adds count samples of one channel from x to stats
+// x[-tp_before, count + tp_after) must be readable
+
+typedef void (*AnalysisKernel)(const float *x, size_t count, const TruePeakFilter &filter, ChannelStats &stats);
+
+static void analyzeScalar(const float *x, size_t count, const TruePeakFilter &filter, ChannelStats &stats){
+    for(size_t n = 0; n < count; ++n){
+        float s = x[n];
+        stats.peak = std::max(stats.peak, fabsf(s));
+        stats.sum_squares += (double)s*s;
+        for(int p = 0; p < tp_phases; ++p){
+            const float *h = filter.rows[p];
+            const float *w = x + n - tp_before;
+            float a = 0.0f;
+            for(int k = 0; k < tp_taps; ++k){
+                a += h[k]*w[k];
+            }
+            stats.true_peak = std::max(stats.true_peak, fabsf(a));
+        }
+    }
+}
+
+#ifdef AUDIOEFFECTS_X86
+static float horizontalMax(__m128 v){
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+static float horizontalSum(__m128 v){
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+// 4 samples at a time, the 3 points after each are interpolated side by side
+static void analyzeSSE(const float *x, size_t count, const TruePeakFilter &filter, ChannelStats &stats){
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 peak = _mm_setzero_ps();
+    __m128 true_peak = _mm_setzero_ps();
+    size_t vector_count = count & ~(size_t)3;
+    size_t n = 0;
+    while(n < vector_count){
+        size_t chunk_end = std::min(vector_count, n + chunk_frames);
+        __m128 squares = _mm_setzero_ps();
+        for(; n < chunk_end; n += 4){
+            __m128 s = _mm_loadu_ps(x + n);
+            peak = _mm_max_ps(peak, _mm_andnot_ps(sign, s));
+            squares = _mm_add_ps(squares, _mm_mul_ps(s, s));
+
+            const float *w = x + n - tp_before;
+            __m128 a0 = _mm_setzero_ps();
+            __m128 a1 = _mm_setzero_ps();
+            __m128 a2 = _mm_setzero_ps();
+            for(int k = 0; k < tp_taps; ++k){
+                __m128 v = _mm_loadu_ps(w + k);
+                a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_set1_ps(filter.rows[0][k]), v));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_set1_ps(filter.rows[1][k]), v));
+                a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_set1_ps(filter.rows[2][k]), v));
+            }
+            true_peak = _mm_max_ps(true_peak, _mm_andnot_ps(sign, a0));
+            true_peak = _mm_max_ps(true_peak, _mm_andnot_ps(sign, a1));
+            true_peak = _mm_max_ps(true_peak, _mm_andnot_ps(sign, a2));
+        }
+        stats.sum_squares += horizontalSum(squares);
+    }
+    stats.peak = std::max(stats.peak, horizontalMax(peak));
+    stats.true_peak = std::max(stats.true_peak, horizontalMax(true_peak));
+    analyzeScalar(x + n, count - n, filter, stats);
+}
+
+__attribute__((target("avx")))
+static void analyzeAVX(const float *x, size_t count, const TruePeakFilter &filter, ChannelStats &stats){
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 peak = _mm256_setzero_ps();
+    __m256 true_peak = _mm256_setzero_ps();
+    size_t vector_count = count & ~(size_t)7;
+    size_t n = 0;
+    while(n < vector_count){
+        size_t chunk_end = std::min(vector_count, n + chunk_frames);
+        __m256 squares = _mm256_setzero_ps();
+        for(; n < chunk_end; n += 8){
+            __m256 s = _mm256_loadu_ps(x + n);
+            peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, s));
+            squares = _mm256_add_ps(squares, _mm256_mul_ps(s, s));
+
+            const float *w = x + n - tp_before;
+            __m256 a0 = _mm256_setzero_ps();
+            __m256 a1 = _mm256_setzero_ps();
+            __m256 a2 = _mm256_setzero_ps();
+            for(int k = 0; k < tp_taps; ++k){
+                __m256 v = _mm256_loadu_ps(w + k);
+                a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_set1_ps(filter.rows[0][k]), v));
+                a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_set1_ps(filter.rows[1][k]), v));
+                a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_set1_ps(filter.rows[2][k]), v));
+            }
+            true_peak = _mm256_max_ps(true_peak, _mm256_andnot_ps(sign, a0));
+            true_peak = _mm256_max_ps(true_peak, _mm256_andnot_ps(sign, a1));
+            true_peak = _mm256_max_ps(true_peak, _mm256_andnot_ps(sign, a2));
+        }
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(squares), _mm256_extractf128_ps(squares, 1));
+        stats.sum_squares += horizontalSum(sum);
+    }
+    __m128 p = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    __m128 t = _mm_max_ps(_mm256_castps256_ps128(true_peak), _mm256_extractf128_ps(true_peak, 1));
+    stats.peak = std::max(stats.peak, horizontalMax(p));
+    stats.true_peak = std::max(stats.true_peak, horizontalMax(t));
+    analyzeScalar(x + n, count - n, filter, stats);
+}
+#endif /* AUDIOEFFECTS_X86 */
+
+// Picks the widest kernel this CPU has
+static AnalysisKernel selectKernel(const char **name){
+#ifdef AUDIOEFFECTS_X86
+    if(cpuHasAVX()){
+        *name = "avx";
+        return analyzeAVX;
+    }
+    *name = "sse";
+    return analyzeSSE;
+#else
+    *name = "scalar";
+    return analyzeScalar;
+#endif
+}
+
+// Frames [begin, end) of a channel of num_frames frames, too close to either end for the
+// kernel to read around them. They're copied out a few at a time with zeros past the ends
+static void analyzeEdge(const float *channel, size_t num_frames, size_t begin, size_t end,
+                        const TruePeakFilter &filter, ChannelStats &stats){
+    const size_t block = 16;
+    float padded[tp_before + block + tp_after];
+    for(size_t start = begin; start < end; start += block){
+        size_t count = std::min(block, end - start);
+        for(size_t i = 0; i < tp_before + count + tp_after; ++i){
+            size_t frame = start + i - tp_before;
+            padded[i] = (start + i >= (size_t)tp_before && frame < num_frames) ? channel[frame] : 0.0f;
+        }
+        analyzeScalar(padded + tp_before, count, filter, stats);
+    }
+}
+
+// ---- K-weighting, the two filters of BS.1770 designed for any sample rate
+
+struct Biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+// The shelf models the acoustic effect of the head, the high pass the
+// ear's insensitivity to low frequencies. At 48kHz these give the
+// coefficients listed in the standard
+static void designKWeighting(uint32_t rate, Biquad &shelf, Biquad &highpass){
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347; // dB
+    double q = 0.7071752369554196;
+    double k = tan(M_PI*f0/rate);
+    double vh = pow(10.0, gain/20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k/q + k*k;
+    shelf.b0 = (vh + vb*k/q + k*k)/a0;
+    shelf.b1 = 2.0*(k*k - vh)/a0;
+    shelf.b2 = (vh - vb*k/q + k*k)/a0;
+    shelf.a1 = 2.0*(k*k - 1.0)/a0;
+    shelf.a2 = (1.0 - k/q + k*k)/a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI*f0/rate);
+    a0 = 1.0 + k/q + k*k;
+    highpass.b0 = 1.0;
+    highpass.b1 = -2.0;
+    highpass.b2 = 1.0;
+    highpass.a1 = 2.0*(k*k - 1.0)/a0;
+    highpass.a2 = (1.0 - k/q + k*k)/a0;
+}
+
+// Weight of a channel in the loudness sum, surround channels count for more and the LFE not at all
+static double channelWeight(int channel, int num_channels){
+    if(num_channels == 5){
+        return channel >= 3 ? 1.41 : 1.0;
+    }
+    if(num_channels == 6){
+        return channel == 3 ? 0.0 : (channel >= 4 ? 1.41 : 1.0);
+    }
+    return 1.0;
+}
+
+// Everything the tasks of one analyze call share
+struct AnalysisJob {
+    AudioBufferView audio;
+    AnalysisKernel kernel;
+    const TruePeakFilter *filter;
+    Biquad shelf;
+    Biquad highpass;
+    size_t step_frames; // Frames per loudness step, 100ms
+    size_t num_steps; // Including a last partial one
+    size_t segment_frames;
+    int num_segments;
+
+    std::vector<ChannelStats> stats; // Per task
+    std::vector<double> energies; // K-weighted sum of squares of each step, channel by channel
+};
+
+// Default Constructor
+// Analysis of nothing
+AudioAnalysis::AudioAnalysis(){
+    num_channels = 0;
+    sample_rate = 0;
+    num_frames = 0;
+    peak = 0.0f;
+    true_peak = 0.0f;
+    rms = 0.0f;
+    loudness = -std::numeric_limits<float>::infinity();
+}
+
+// Gain that brings the peak to target, 1 for silence
+float AudioAnalysis::getPeakGain(float target) const {
+    return peak > 0 ? target/peak : 1.0f;
+}
+
+// Gain that brings the loudness to target_lufs without the true peak going over max_true_peak
+float AudioAnalysis::getLoudnessGain(float target_lufs, float max_true_peak) const {
+    if(!std::isfinite(loudness) || true_peak <= 0){
+        return 1.0f;
+    }
+    float gain = powf(10.0f, (target_lufs - loudness)/20.0f);
+    if(true_peak*gain > max_true_peak){
+        gain = max_true_peak/true_peak;
+    }
+    return gain;
+}
+
+// Linear level in dB relative to full scale
+static float decibels(float level){
+    return level > 0 ? 20.0f*log10f(level) : -std::numeric_limits<float>::infinity();
+}
+
+// Pretty print the analysis
+std::string AudioAnalysis::toString() const {
+    std::stringstream s;
+    s << std::fixed << std::setprecision(2);
+    s << num_channels << " channels, " << num_frames << " frames at " << sample_rate << "Hz" << std::endl;
+    s << "Peak: " << decibels(peak) << " dBFS, true peak: " << decibels(true_peak) << " dBTP" << std::endl;
+    s << "RMS: " << decibels(rms) << " dBFS, loudness: " << loudness << " LUFS" << std::endl;
+    return s.str();
+}
+
+// Constructor
+AudioAnalyzer::AudioAnalyzer(ThreadPool *p){
+    pool = p;
+}
+
+// Analyzes every channel of audio, sampled at sample_rate
+AudioAnalysis AudioAnalyzer::analyze(const AudioBufferView &audio, uint32_t sample_rate){
+    static const char *name;
+    static const AnalysisKernel kernel = selectKernel(&name);
+    static const TruePeakFilter filter;
+
+    if(sample_rate < 10){
+        throw std::invalid_argument("AudioAnalyzer Error: Sample rate is too low!");
+    }
+
+    int num_channels = audio.getNumChannels();
+    size_t num_frames = audio.getNumFrames();
+
+    AnalysisJob job;
+    job.audio = audio;
+    job.kernel = kernel;
+    job.filter = &filter;
+    designKWeighting(sample_rate, job.shelf, job.highpass);
+    job.step_frames = sample_rate/10;
+    job.num_steps = (num_frames + job.step_frames - 1)/job.step_frames;
+    job.segment_frames = std::max((size_t)1, segment_frames/job.step_frames)*job.step_frames;
+    job.num_segments = (int)((num_frames + job.segment_frames - 1)/job.segment_frames);
+    job.energies.assign(num_channels*job.num_steps, 0.0);
+    ChannelStats empty = {0.0f, 0.0f, 0.0};
+    job.stats.assign(num_channels*job.num_segments, empty);
+
+    int num_tasks = num_channels*job.num_segments;
+    if(pool){
+        pool->run(analyzeTask, &job, num_tasks);
+    } else {
+        for(int i = 0; i < num_tasks; ++i){
+            analyzeTask(&job, i);
+        }
+    }
+
+    AudioAnalysis result;
+    result.num_channels = num_channels;
+    result.sample_rate = sample_rate;
+    result.num_frames = num_frames;
+    result.channel_peak.resize(num_channels);
+    result.channel_true_peak.resize(num_channels);
+    result.channel_rms.resize(num_channels);
+
+    double total_squares = 0.0;
+    for(int c = 0; c < num_channels; ++c){
+        ChannelStats channel = empty;
+        for(int s = 0; s < job.num_segments; ++s){
+            const ChannelStats &segment = job.stats[c*job.num_segments + s];
+            channel.peak = std::max(channel.peak, segment.peak);
+            channel.true_peak = std::max(channel.true_peak, segment.true_peak);
+            channel.sum_squares += segment.sum_squares;
+        }
+        // The samples themselves are points of the signal too
+        channel.true_peak = std::max(channel.true_peak, channel.peak);
+
+        result.channel_peak[c] = channel.peak;
+        result.channel_true_peak[c] = channel.true_peak;
+        result.channel_rms[c] = num_frames ? (float)sqrt(channel.sum_squares/num_frames) : 0.0f;
+        result.peak = std::max(result.peak, channel.peak);
+        result.true_peak = std::max(result.true_peak, channel.true_peak);
+        total_squares += channel.sum_squares;
+    }
+    if(num_frames && num_channels){
+        result.rms = (float)sqrt(total_squares/((double)num_frames*num_channels));
+    }
+
+    // Mean square power of every 400ms block, only blocks of whole steps count
+    size_t full_steps = num_frames/job.step_frames;
+    size_t num_blocks = full_steps >= steps_per_block ? full_steps - steps_per_block + 1 : 0;
+    std::vector<double> powers(num_blocks, 0.0);
+    for(int c = 0; c < num_channels; ++c){
+        double weight = channelWeight(c, num_channels)/(steps_per_block*job.step_frames);
+        if(weight == 0){
+            continue;
+        }
+        const double *e = &job.energies[c*job.num_steps];
+        for(size_t b = 0; b < num_blocks; ++b){
+            double energy = 0.0;
+            for(int i = 0; i < steps_per_block; ++i){
+                energy += e[b + i];
+            }
+            powers[b] += weight*energy;
+        }
+    }
+
+    // Two gates: blocks quieter than absolute_gate don't count, then neither do
+    // blocks quieter than relative_gate below the loudness of what's left
+    double threshold = pow(10.0, (absolute_gate + 0.691)/10.0);
+    for(int pass = 0; pass < 2; ++pass){
+        double sum = 0.0;
+        size_t count = 0;
+        for(size_t b = 0; b < num_blocks; ++b){
+            if(powers[b] > threshold){
+                sum += powers[b];
+                ++count;
+            }
+        }
+        if(count == 0){
+            break;
+        }
+        if(pass == 0){
+            threshold = std::max(threshold, sum/count*pow(10.0, relative_gate/10.0));
+        } else {
+            result.loudness = (float)(-0.691 + 10.0*log10(sum/count));
+        }
+    }
+    return result;
+}
+
+// Analyzes segment index%num_segments of channel index/num_segments
+void AudioAnalyzer::analyzeTask(void *context, int index){
+    AnalysisJob *job = (AnalysisJob *)context;
+    int c = index/job->num_segments;
+    size_t num_frames = job->audio.getNumFrames();
+    size_t begin = (index%job->num_segments)*job->segment_frames;
+    size_t end = std::min(num_frames, begin + job->segment_frames);
+    const float *x = job->audio[c];
+
+    // One step at a time, so the K-weighting filter reads what the kernel has just brought
+    // into cache. The filters start a step early to settle them.
+    ChannelStats &stats = job->stats[index];
+    size_t low = std::min(std::max(begin, (size_t)tp_before), end);
+    size_t high = std::max(std::min(end, num_frames > (size_t)tp_after ? num_frames - tp_after : 0), low);
+    const Biquad &f = job->shelf;
+    const Biquad &g = job->highpass;
+    double f1 = 0.0, f2 = 0.0, g1 = 0.0, g2 = 0.0;
+    size_t start = begin >= job->step_frames ? begin - job->step_frames : 0;
+    double *energies = &job->energies[c*job->num_steps];
+    for(size_t n = start; n < end;){
+        size_t step = n/job->step_frames;
+        size_t step_end = std::min(end, (step + 1)*job->step_frames);
+        
+        // Peaks and squares, the kernel takes everything it can read around
+        if(step_end > begin){
+            size_t kernel_begin = std::min(std::max(n, low), step_end);
+            size_t kernel_end = std::max(std::min(step_end, high), kernel_begin);
+            analyzeEdge(x, num_frames, n, kernel_begin, *job->filter, stats);
+            job->kernel(x + kernel_begin, kernel_end - kernel_begin, *job->filter, stats);
+            analyzeEdge(x, num_frames, kernel_end, step_end, *job->filter, stats);
+        }
+        
+        // K-weighted energy of the step
+        double energy = 0.0;
+        for(; n < step_end; ++n){
+            double in = x[n];
+            double y = f.b0*in + f1;
+            f1 = f.b1*in - f.a1*y + f2;
+            f2 = f.b2*in - f.a2*y;
+            double z = g.b0*y + g1;
+            g1 = g.b1*y - g.a1*z + g2;
+            g2 = g.b2*y - g.a2*z;
+            energy += z*z;
+        }
+        if(step_end > begin){
+            energies[step] = energy;
+        }
+    }
+}
+
+// Analyzes the wav file at path, using and filling cache if there is one
+AudioAnalysis AudioAnalyzer::analyzeFile(std::string path, AnalysisCache *cache){
+    FileStamp stamp;
+    bool stamped = getFileStamp(path, stamp);
+
+    AudioAnalysis result;
+    if(cache && stamped && cache->lookup(path, stamp, result)){
+        return result;
+    }
+
+    WavFile file(path);
+    result = analyze(file.getData(), file.getSampleRate());
+    if(cache && stamped){
+        cache->store(path, stamp, result);
+    }
+    return result;
+}
+
+// Name of the kernel this CPU uses
+const char *AudioAnalyzer::getKernelName(){
+    const char *name;
+    selectKernel(&name);
+    return name;
+}
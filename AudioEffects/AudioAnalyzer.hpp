@@ -0,0 +1,96 @@
+//
+//  AudioAnalyzer.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/9.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef AudioAnalyzer_hpp
+#define AudioAnalyzer_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AudioBuffer.hpp"
+
+class AnalysisCache;
+class ThreadPool;
+
+// Everything AudioAnalyzer measures about some audio
+struct AudioAnalysis {
+    int num_channels;
+    uint32_t sample_rate;
+    uint64_t num_frames;
+
+    // Linear, 1 is full scale
+    float peak; // Highest sample
+    float true_peak; // Highest point of the signal between the samples too, from 4x oversampling
+    float rms; // Over every channel
+
+    // Integrated loudness in LUFS (ITU-R BS.1770 / EBU R128), -inf if everything was gated out
+    float loudness;
+
+    // The same, per channel
+    std::vector<float> channel_peak;
+    std::vector<float> channel_true_peak;
+    std::vector<float> channel_rms;
+
+    // Default Constructor
+    // Analysis of nothing
+    AudioAnalysis();
+
+    // Gain that brings the peak to target, 1 for silence
+    float getPeakGain(float target = 1.0f) const;
+
+    // Gain that brings the loudness to target_lufs, lowered if needed to
+    // keep the true peak at or below max_true_peak. 1 for silence
+    float getLoudnessGain(float target_lufs, float max_true_peak = 1.0f) const;
+
+    // Pretty print the analysis
+    std::string toString() const;
+};
+
+/* AudioAnalyzer class
+ *
+ * Measures peak, true peak, RMS and integrated loudness in a single pass
+ *
+ * Each channel is split into segments of a few seconds, and every
+ * channel's segments are analyzed as separate tasks on the thread pool.
+ * Segments are worked through one 100ms loudness step at a time. A
+ * vectorized kernel finds the step's peak, sum of squares and 4x
+ * oversampled true peak together, then a K-weighting filter measures its
+ * energy for the loudness gating of BS.1770, reading the samples the
+ * kernel just brought into cache. The filter is recursive, so it stays
+ * scalar. Segments other than the first run the filter over the step
+ * before them to settle it, so the results don't depend on the number of
+ * threads.
+ */
+class AudioAnalyzer {
+public:
+
+    // Constructor
+    // Without a pool everything runs on the calling thread
+    explicit AudioAnalyzer(ThreadPool *pool = NULL);
+
+    // Analyzes every channel of audio, sampled at sample_rate
+    AudioAnalysis analyze(const AudioBufferView &audio, uint32_t sample_rate);
+
+    // Analyzes the wav file at path
+    // If cache is given and has an analysis of the file as it is now, the file isn't read at all,
+    // otherwise the new analysis is stored in it
+    AudioAnalysis analyzeFile(std::string path, AnalysisCache *cache = NULL);
+
+    // Name of the kernel this CPU uses, for logging
+    static const char *getKernelName();
+
+protected:
+private:
+    // One channel's segment, run on the pool
+    static void analyzeTask(void *context, int index);
+
+    ThreadPool *pool;
+};
+
+#endif /* AudioAnalyzer_hpp */
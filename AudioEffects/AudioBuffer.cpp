@@ -0,0 +1,162 @@
+//
+//  AudioBuffer.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/28.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "AudioBuffer.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Empty view
+AudioBufferView::AudioBufferView(){
+    data = NULL;
+    num_channels = 0;
+    num_frames = 0;
+    stride = 0;
+}
+
+AudioBufferView::AudioBufferView(float *d, int channels, size_t frames, size_t s){
+    data = d;
+    num_channels = channels;
+    num_frames = frames;
+    stride = s;
+}
+
+// Frames [start, start + frames) of every channel
+AudioBufferView AudioBufferView::slice(size_t start, size_t frames) const {
+    if(start > num_frames || frames > num_frames - start){
+        throw std::out_of_range("AudioBuffer Error: Slice is out of range!");
+    }
+    return AudioBufferView(data + start, num_channels, frames, stride);
+}
+
+// Channels [first, first + count), all frames
+AudioBufferView AudioBufferView::channels(int first, int count) const {
+    if(first < 0 || count < 0 || first + count > num_channels){
+        throw std::out_of_range("AudioBuffer Error: Tried to access a channel that doesn't exist!");
+    }
+    return AudioBufferView(data + first*stride, count, num_frames, stride);
+}
+
+// Sets every sample to zero
+void AudioBufferView::clear() const {
+    for(int c = 0; c < num_channels; ++c){
+        memset(channel(c), 0, num_frames*sizeof(float));
+    }
+}
+
+// Copies src's samples into this view
+void AudioBufferView::copyFrom(const AudioBufferView &src) const {
+    if(src.num_channels != num_channels || src.num_frames != num_frames){
+        throw std::invalid_argument("AudioBuffer Error: Can't copy between buffers of different sizes!");
+    }
+    for(int c = 0; c < num_channels; ++c){
+        memcpy(channel(c), src.channel(c), num_frames*sizeof(float));
+    }
+}
+
+// Empty buffer
+AudioBuffer::AudioBuffer(){
+    data = NULL;
+    num_channels = 0;
+    num_frames = 0;
+    stride = 0;
+}
+
+// Allocates num_channels channels of num_frames zeroed samples
+AudioBuffer::AudioBuffer(int channels, size_t frames){
+    data = NULL;
+    num_channels = 0;
+    num_frames = 0;
+    stride = 0;
+    allocate(channels, frames);
+}
+
+AudioBuffer::~AudioBuffer(){
+    free();
+}
+
+AudioBuffer::AudioBuffer(AudioBuffer &&other){
+    data = other.data;
+    num_channels = other.num_channels;
+    num_frames = other.num_frames;
+    stride = other.stride;
+    owner = std::move(other.owner);
+    other.data = NULL;
+    other.num_channels = 0;
+    other.num_frames = 0;
+    other.stride = 0;
+}
+
+AudioBuffer &AudioBuffer::operator=(AudioBuffer &&other){
+    if(this != &other){
+        free();
+        data = other.data;
+        num_channels = other.num_channels;
+        num_frames = other.num_frames;
+        stride = other.stride;
+        owner = std::move(other.owner);
+        other.data = NULL;
+        other.num_channels = 0;
+        other.num_frames = 0;
+        other.stride = 0;
+    }
+    return *this;
+}
+
+// Frees the old samples and allocates num_channels channels of num_frames zeroed samples
+void AudioBuffer::allocate(int channels, size_t frames){
+    free();
+    if(channels <= 0){
+        return;
+    }
+
+    // Pad every channel to a whole number of alignment blocks
+    const size_t floats_per_block = alignment/sizeof(float);
+    size_t s = (frames + floats_per_block - 1)/floats_per_block*floats_per_block;
+    if(s == 0){
+        s = floats_per_block;
+    }
+
+    void *p = NULL;
+    size_t bytes = (size_t)channels*s*sizeof(float);
+    if(posix_memalign(&p, alignment, bytes) != 0){
+        throw std::bad_alloc();
+    }
+    memset(p, 0, bytes);
+
+    data = (float *)p;
+    num_channels = channels;
+    num_frames = frames;
+    stride = s;
+}
+
+// Frees the old samples and uses samples owned by owner instead
+void AudioBuffer::adopt(float *d, int channels, size_t frames, size_t s, std::shared_ptr<void> o){
+    free();
+    if(((size_t)d % alignment) != 0 || (s*sizeof(float)) % alignment != 0 || s < frames){
+        throw std::invalid_argument("AudioBuffer Error: Adopted samples aren't aligned!");
+    }
+    data = d;
+    num_channels = channels;
+    num_frames = frames;
+    stride = s;
+    owner = o;
+}
+
+// Frees the samples, or lets go of their owner if they were adopted
+void AudioBuffer::free(){
+    if(owner){
+        owner.reset();
+    } else if(data){
+        ::free(data);
+    }
+    data = NULL;
+    num_channels = 0;
+    num_frames = 0;
+    stride = 0;
+}
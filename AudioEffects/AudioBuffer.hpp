@@ -0,0 +1,156 @@
+//
+//  AudioBuffer.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/28.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef AudioBuffer_hpp
+#define AudioBuffer_hpp
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+/* AudioBufferView class
+ *
+ * Non-owning view of planar samples
+ *
+ * Channel c starts stride floats after channel c-1. Views are cheap to
+ * copy, and slicing a view by channel or by frame range never allocates.
+ * A view doesn't keep its samples alive, the buffer it came from must
+ * outlive it.
+ */
+class AudioBufferView {
+public:
+
+    // Empty view
+    AudioBufferView();
+
+    // View of num_channels channels of num_frames samples, each channel stride floats apart
+    AudioBufferView(float *data, int num_channels, size_t num_frames, size_t stride);
+
+    // Start of channel c
+    float *channel(int c) const {
+        return data + c*stride;
+    }
+
+    float *operator[](int c) const {
+        return data + c*stride;
+    }
+
+    // Frames [start, start + frames) of every channel
+    AudioBufferView slice(size_t start, size_t frames) const;
+
+    // Channels [first, first + count), all frames
+    AudioBufferView channels(int first, int count) const;
+
+    // Sets every sample to zero
+    void clear() const;
+
+    // Copies src's samples into this view, which must have the same size
+    void copyFrom(const AudioBufferView &src) const;
+
+    // Getters
+    int getNumChannels() const { return num_channels; }
+    size_t getNumFrames() const { return num_frames; }
+    size_t getStride() const { return stride; }
+    float *getData() const { return data; }
+
+protected:
+private:
+    float *data;
+    int num_channels;
+    size_t num_frames;
+    size_t stride;
+};
+
+/* AudioBuffer class
+ *
+ * Owns planar samples in a single allocation
+ *
+ * The allocation and every channel start on a 64 byte boundary (channels
+ * are padded to a multiple of 16 floats), so kernels can use aligned
+ * vector loads on any channel. Buffers can be moved but not copied,
+ * copying a buffer's contents has to be asked for with copyFrom.
+ *
+ * A buffer can also adopt memory allocated elsewhere, such as a mapped
+ * file, which is released through its owner instead of freed.
+ */
+class AudioBuffer {
+public:
+
+    // Alignment of the allocation and of every channel, in bytes
+    static const size_t alignment = 64;
+
+    // Empty buffer
+    AudioBuffer();
+
+    // Allocates num_channels channels of num_frames zeroed samples
+    AudioBuffer(int num_channels, size_t num_frames);
+
+    // Destructor
+    // Frees the samples
+    ~AudioBuffer();
+
+    AudioBuffer(AudioBuffer &&other);
+    AudioBuffer &operator=(AudioBuffer &&other);
+
+    AudioBuffer(const AudioBuffer &) = delete;
+    AudioBuffer &operator=(const AudioBuffer &) = delete;
+
+    // Frees the old samples and allocates num_channels channels of num_frames zeroed samples
+    void allocate(int num_channels, size_t num_frames);
+
+    // Frees the old samples and uses num_channels channels of num_frames samples at data instead,
+    // stride floats apart. The memory belongs to owner, which the buffer keeps alive until it's freed
+    // data and stride must keep the usual alignment
+    void adopt(float *data, int num_channels, size_t num_frames, size_t stride, std::shared_ptr<void> owner);
+
+    // Frees the samples
+    void free();
+
+    // View of the whole buffer
+    AudioBufferView view() const {
+        return AudioBufferView(data, num_channels, num_frames, stride);
+    }
+
+    operator AudioBufferView() const {
+        return view();
+    }
+
+    // Frames [start, start + frames) of every channel
+    AudioBufferView slice(size_t start, size_t frames) const {
+        return view().slice(start, frames);
+    }
+
+    // Copies src's samples into this buffer, which must have the same size
+    void copyFrom(const AudioBufferView &src){
+        view().copyFrom(src);
+    }
+
+    // Start of channel c
+    float *channel(int c) const {
+        return data + c*stride;
+    }
+
+    float *operator[](int c) const {
+        return data + c*stride;
+    }
+
+    // Getters
+    int getNumChannels() const { return num_channels; }
+    size_t getNumFrames() const { return num_frames; }
+    size_t getStride() const { return stride; }
+
+protected:
+private:
+    float *data;
+    int num_channels;
+    size_t num_frames;
+    size_t stride;
+    std::shared_ptr<void> owner; // Of adopted samples, NULL if they were allocated here
+};
+
+#endif /* AudioBuffer_hpp */
@@ -0,0 +1,136 @@
+//
+//  AudioEffect.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/25.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "AudioEffect.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+AudioEffect::AudioEffect(){
+    next = NULL;
+    sample_rate = 0;
+    max_block = 0;
+    num_channels = 0;
+}
+
+// Sets the effect up for a stream
+void AudioEffect::prepare(int rate, int block, int channels){
+    sample_rate = rate;
+    max_block = block;
+    num_channels = channels;
+}
+
+// Effects are planar only unless they say otherwise
+bool AudioEffect::supportsInterleaved(){
+    return false;
+}
+
+void AudioEffect::processInterleaved(float *, int){
+    throw std::logic_error("AudioEffect Error: Effect does not support interleaved frames!");
+}
+
+// Effects process all their channels together unless they say otherwise
+bool AudioEffect::supportsChannelParallel(){
+    return false;
+}
+
+void AudioEffect::beginBlock(int){
+}
+
+void AudioEffect::processChannels(const AudioBufferView &, int, int){
+    throw std::logic_error("AudioEffect Error: Effect does not support channel parallel processing!");
+}
+
+// Calls process, and records how long it took when instrumentation is on
+void AudioEffect::processTimed(const AudioBufferView &buffer){
+    if(!Instrumentation::isEnabled()){
+        process(buffer);
+        return;
+    }
+    uint64_t start = Instrumentation::now();
+    process(buffer);
+    counters.record(buffer.getNumFrames(), Instrumentation::now() - start);
+}
+
+// Processes a block with this effect and then every effect after it
+void AudioEffect::processChain(const AudioBufferView &buffer){
+    for(AudioEffect *ae = this; ae; ae = ae->next){
+        ae->processTimed(buffer);
+    }
+}
+
+void AudioEffect::processChainInterleaved(float *buffer, int num_frames){
+    bool timed = Instrumentation::isEnabled();
+    for(AudioEffect *ae = this; ae; ae = ae->next){
+        uint64_t start = timed ? Instrumentation::now() : 0;
+        ae->processInterleaved(buffer, num_frames);
+        if(timed){
+            ae->counters.record(num_frames, Instrumentation::now() - start);
+        }
+    }
+}
+
+// True if this effect and every effect after it support interleaved frames
+bool AudioEffect::chainSupportsInterleaved(){
+    for(AudioEffect *ae = this; ae; ae = ae->next){
+        if(!ae->supportsInterleaved()){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Calls prepare on this effect and every effect after it
+void AudioEffect::prepareChain(int rate, int block, int channels){
+    for(AudioEffect *ae = this; ae; ae = ae->next){
+        ae->prepare(rate, block, channels);
+    }
+}
+
+// Calls reset on this effect and every effect after it
+void AudioEffect::resetChain(){
+    for(AudioEffect *ae = this; ae; ae = ae->next){
+        ae->reset();
+    }
+}
+
+// Applies this audio effect to the whole buffer, then the rest of the chain
+// Done in blocks, so it goes through exactly the same code as streaming
+void AudioEffect::apply(const AudioBufferView &buffer, int rate){
+    const size_t block = 4096;
+    size_t num_frames = buffer.getNumFrames();
+    
+    prepare(rate, block, buffer.getNumChannels());
+    reset();
+    
+    for(size_t start = 0; start < num_frames; start += block){
+        processTimed(buffer.slice(start, std::min(block, num_frames - start)));
+    }
+    
+    if(next){
+        next->apply(buffer, rate);
+    }
+}
+
+// The next effect in the chain, NULL for the last one
+void AudioEffect::setNext(AudioEffect *ae){
+    next = ae;
+}
+
+AudioEffect *AudioEffect::getNext(){
+    return next;
+}
+
+// The sample rate given to prepare
+int AudioEffect::getSampleRate(){
+    return sample_rate;
+}
+
+// Time spent processing
+EffectCounters &AudioEffect::getCounters(){
+    return counters;
+}
@@ -10,6 +10,8 @@
 #define AudioEffect_hpp
 
 #include <stdio.h>
+#include "AudioBuffer.hpp"
+#include "Instrumentation.hpp"
 
 /* AudioEffect Interface (Abstract class)
  *
@@ -17,22 +19,94 @@
  * linked list of audio effects
  *
  * Allows for a modular effect chain
+ *
+ * Effects process audio in blocks and keep whatever state they need
+ * (filter memory, LFO phase, ...) from one block to the next, so a stream
+ * cut into blocks of any size comes out exactly the same as the whole
+ * buffer processed at once.
  */
 
 class AudioEffect {
 public:
     
-    // Applies this audio effect to the sample in in_buffer, then
-    // calls apply on the next effect in the chain (if it exists);
+    AudioEffect();
+    virtual ~AudioEffect(){}
+    
+    // Sets the effect up for a stream
+    // Called before processing, and again whenever the stream's format changes
+    //
+    // max_block is the largest number of frames that will be passed to process,
+    // this is where effects should allocate anything they need
+    virtual void prepare(int sample_rate, int max_block, int num_channels);
+    
+    // Clears all state, as if no audio had been processed since prepare
+    virtual void reset() = 0;
+    
+    // Processes the next buffer.getNumFrames() frames of the stream in place
     //
-    // in_buffer must have num_channels sub_buffers, each with room for num_samples floats
+    // buffer must have the num_channels channels given to prepare
+    virtual void process(const AudioBufferView &buffer) = 0;
+    
+    // True if this effect can also process interleaved frames with processInterleaved
+    virtual bool supportsInterleaved();
+    
+    // Processes the next num_frames interleaved frames of the stream in place
+    // Must give exactly the same result as process on the same frames
+    //
+    // Only called when supportsInterleaved returns true
+    virtual void processInterleaved(float *buffer, int num_frames);
+    
+    // True if channels can be processed independently with beginBlock/processChannels
+    virtual bool supportsChannelParallel();
+    
+    // Advances the state shared by every channel (LFOs, parameter ramps, ...) by num_frames
+    // Followed by processChannels calls that together cover every channel exactly once,
+    // which may run on different threads at the same time
     //
-    // returns the result once it goes through all the audio effects
-    virtual float **apply(float **in_buffer, int num_samples, int num_channels, int sample_rate) = 0;
+    // num_frames must be at most the max_block given to prepare
+    virtual void beginBlock(int num_frames);
+    
+    // Processes channels [first, first + count) of buffer, the block given to beginBlock
+    // Must only touch those channels' samples and state
+    virtual void processChannels(const AudioBufferView &buffer, int first, int count);
+    
+    // Calls process, and records how long it took when instrumentation is on
+    void processTimed(const AudioBufferView &buffer);
+    
+    // Processes a block with this effect and then every effect after it
+    void processChain(const AudioBufferView &buffer);
+    void processChainInterleaved(float *buffer, int num_frames);
+    
+    // True if this effect and every effect after it support interleaved frames
+    bool chainSupportsInterleaved();
+    
+    // Calls prepare/reset on this effect and every effect after it
+    void prepareChain(int sample_rate, int max_block, int num_channels);
+    void resetChain();
+    
+    // Applies this audio effect to all of buffer in place, then
+    // calls apply on the next effect in the chain (if it exists);
+    virtual void apply(const AudioBufferView &buffer, int sample_rate);
+    
+    // The next effect in the chain, NULL for the last one
+    void setNext(AudioEffect *ae);
+    AudioEffect *getNext();
+    
+    // The sample rate given to prepare
+    int getSampleRate();
+    
+    // Time spent processing, recorded by processTimed and the chain functions
+    EffectCounters &getCounters();
     
 protected:
     AudioEffect *next; // pointer to the next effect in the list
+    
+    // The stream format given to prepare
+    int sample_rate;
+    int max_block;
+    int num_channels;
 private:
+    EffectCounters counters;
 };
 
 #endif /* AudioEffect_hpp */
@@ -10,51 +10,62 @@
 #define AudioPlayer_hpp
 
 #include <stdio.h>
-#include <AudioToolbox/AudioToolbox.h>
+#include <memory>
 #include "AudioEffect.hpp"
+#include "AudioSink.hpp"
+#include "DecodedAudioCache.hpp"
+#include "PlaybackStream.hpp"
 #include "WavFile.hpp"
 
 class AudioPlayer {
 public:
     
+    // Plays through the default sink for this platform
+    // An AudioQueue on macOS, an OfflineSink that discards everything elsewhere
     AudioPlayer(int num_buffers = 3, float time_between_callbacks = 0.25f);
     
     ~AudioPlayer();
     
     void setEffects(AudioEffect *ae);
     
+    // Plays everything at rate, resampling files recorded at other rates
+    // 0 plays each file at its own rate
+    void setOutputRate(uint32_t rate);
+    
+    // Sends audio to sink instead of the default sink
+    // The player doesn't take ownership, NULL goes back to the default
+    void setSink(AudioSink *sink);
+    
+    // Decodes files once through cache instead of streaming them from disk on every play
+    // The player doesn't take ownership, NULL goes back to streaming
+    void setCache(DecodedAudioCache *cache);
+    
+    // Streams the file at path from disk while it plays, or plays it from the cache if there is one
+    // Anything that goes wrong while decoding or processing is thrown from play
     void play(std::string path);
+    
+    // Plays an already loaded file, its samples are not modified
     void play(WavFile &wav);
     
-protected:
-private:
-    int num_buffers;
-    float time_between_callbacks;
-    AudioQueueRef q;
-    
-    // Internal playing data
-    float ** buffer;
-    int cur_sample;
-    int num_samples;
-    int num_channels;
-    int packets_per_read;
-    int bytes_per_packet;
+    // Plays shared decoded audio, its samples are not modified
+    void play(std::shared_ptr<const DecodedAudio> audio);
     
-    AudioEffect *effects;
+    // Playback statistics, for the current or last call to play
+    uint64_t getUnderruns();
+    int getFillLevel();
+    int getMinFillLevel();
     
-    void calculateBufferSize(AudioStreamBasicDescription &asbd,
-                             int max_packet_size,
-                             float time_to_play,
-                             int *outBufferSize,
-                             int *outNumPacketsToRead);
+protected:
+private:
+    // Runs the sink until the stream is finished, then rethrows anything the producer threw
+    void playStream();
     
-    // Callback for
-    void callback(AudioQueueRef q, AudioQueueBufferRef br);
+    PlaybackStream stream; // Decodes and processes ahead of the sink
+    std::unique_ptr<AudioSink> default_sink;
+    AudioSink *sink;
+    DecodedAudioCache *cache;
     
-    static void AQcallback(void *ptr, AudioQueueRef queue, AudioQueueBufferRef buf_ref){
-        AudioPlayer *ap = (AudioPlayer *)ptr;
-        ap->callback(queue, buf_ref);
-    }
+    AudioEffect *effects;
 };
 
 
@@ -0,0 +1,149 @@
+//
+//  AudioQueueSink.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/27.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "AudioQueueSink.hpp"
+#include "Instrumentation.hpp"
+
+#ifdef __APPLE__
+
+AudioQueueSink::AudioQueueSink(int n_buffers, float time_callbacks){
+    num_buffers = n_buffers;
+    time_between_callbacks = time_callbacks;
+    q = NULL;
+    stream = NULL;
+    stopping = false;
+}
+
+AudioQueueSink::~AudioQueueSink(){
+    if(q){
+        AudioQueueDispose(q, true);
+    }
+}
+
+// Plays the stream until it is finished
+void AudioQueueSink::run(PlaybackStream &s){
+    AudioStreamBasicDescription asbd;
+    
+    stream = &s;
+    stopping = false;
+    
+    // Set up the Audio Stream Basic Description using the stream
+    asbd.mSampleRate = stream->getSampleRate();
+    asbd.mFormatID = kAudioFormatLinearPCM;
+    asbd.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked;
+    asbd.mFramesPerPacket = 1;
+    asbd.mChannelsPerFrame = stream->getNumChannels();
+    asbd.mBytesPerPacket = asbd.mBytesPerFrame = bytes_per_packet = sizeof(float)*stream->getNumChannels();
+    asbd.mBitsPerChannel = sizeof(float)*8;
+    asbd.mReserved = 0;
+    
+    AudioQueueNewOutput(&asbd,
+                        AQcallback,
+                        this, CFRunLoopGetCurrent(),
+                        kCFRunLoopCommonModes, 0, &q);
+    
+    int buffer_size;
+    AudioQueueBufferRef buf_refs[num_buffers];
+    
+    // Determine best size for buffers and packets
+    calculateBufferSize(asbd, bytes_per_packet, time_between_callbacks, &buffer_size, &packets_per_read);
+    
+    // Let the producer get ahead before priming, or every buffer would start out as silence
+    stream->waitForFill(num_buffers*packets_per_read);
+    
+    // Create and init buffers
+    for (int i = 0; i < num_buffers; ++i) {
+        AudioQueueAllocateBuffer(q, buffer_size, &(buf_refs[i]));
+        buf_refs[i]->mAudioDataByteSize = buffer_size;
+        AQcallback(this, q, buf_refs[i]);
+    }
+    
+    // Set desired volume
+    AudioQueueSetParameter (q, kAudioQueueParam_Volume, 1.0f);
+    
+    // Start playback
+    AudioQueueStart (q, NULL);
+    
+    // Run the callback in a loop
+    while (!stream->isFinished()){
+        CFRunLoopRunInMode (
+                            kCFRunLoopDefaultMode,
+                            time_between_callbacks, // seconds
+                            false // don't return after source handled
+                            );
+    }
+    
+    // Make sure that all audio is finished playing
+    CFRunLoopRunInMode ( kCFRunLoopDefaultMode,
+                        time_between_callbacks*num_buffers,
+                        false);
+    
+    // Dispose of the audio queue
+    AudioQueueDispose(q, true);
+    q = NULL;
+    stream = NULL;
+}
+
+void AudioQueueSink::callback(AudioQueueRef q, AudioQueueBufferRef br){
+    AudioQueueBuffer *buf = br;
+    float *samp = (float *)buf->mAudioData;
+    
+    if(stopping){
+        return;
+    }
+    
+    if(stream->isFinished()){
+        stopping = true;
+        AudioQueueStop(q, false);
+        return;
+    }
+    
+    // Never waits, anything the producer hasn't delivered yet is played as silence
+    bool timed = Instrumentation::isEnabled();
+    uint64_t start = timed ? Instrumentation::now() : 0;
+    stream->pull(samp, packets_per_read);
+    if(timed){
+        Instrumentation::recordCallback(Instrumentation::now() - start, (double)packets_per_read/stream->getSampleRate());
+    }
+    buf->mAudioDataByteSize = packets_per_read*bytes_per_packet;
+    AudioQueueEnqueueBuffer (q, br, 0, NULL);
+}
+
+// Figures out the proper buffer size for the a specific length of audio
+void AudioQueueSink::calculateBufferSize(AudioStreamBasicDescription &asbd,
+                                      int max_packet_size,
+                                      float time_to_play,
+                                      int *out_buffer_size,
+                                      int *out_num_packets_to_read){
+    static const int maxBufferSize = 0x50000;
+    static const int minBufferSize = 0x4000;
+    
+    if (asbd.mFramesPerPacket != 0) {
+        float numPacketsForTime =
+        asbd.mSampleRate / asbd.mFramesPerPacket * time_to_play;
+        *out_buffer_size = numPacketsForTime * max_packet_size;
+    } else {
+        *out_buffer_size =
+        maxBufferSize > max_packet_size ?
+        maxBufferSize : max_packet_size;
+    }
+    
+    if (
+        *out_buffer_size > maxBufferSize &&
+        *out_buffer_size > max_packet_size
+        )
+        *out_buffer_size = maxBufferSize;
+    else {
+        if (*out_buffer_size < minBufferSize)
+            *out_buffer_size = minBufferSize;
+    }
+    
+    *out_num_packets_to_read = *out_buffer_size / max_packet_size;
+}
+
+#endif /* __APPLE__ */
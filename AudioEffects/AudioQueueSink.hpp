@@ -0,0 +1,61 @@
+//
+//  AudioQueueSink.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/27.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef AudioQueueSink_hpp
+#define AudioQueueSink_hpp
+
+#ifdef __APPLE__
+
+#include <stdio.h>
+#include <AudioToolbox/AudioToolbox.h>
+#include "AudioSink.hpp"
+
+/* AudioQueueSink class
+ *
+ * Plays a stream through a macOS AudioQueue in real time
+ */
+class AudioQueueSink: public AudioSink {
+public:
+    
+    AudioQueueSink(int num_buffers = 3, float time_between_callbacks = 0.25f);
+    
+    ~AudioQueueSink();
+    
+    // Plays the stream until it is finished
+    void run(PlaybackStream &stream) override;
+    
+protected:
+private:
+    int num_buffers;
+    float time_between_callbacks;
+    AudioQueueRef q;
+    
+    // Internal playing data
+    PlaybackStream *stream;
+    bool stopping; // Set once the stream has run dry and the queue was stopped
+    int packets_per_read;
+    int bytes_per_packet;
+    
+    void calculateBufferSize(AudioStreamBasicDescription &asbd,
+                             int max_packet_size,
+                             float time_to_play,
+                             int *outBufferSize,
+                             int *outNumPacketsToRead);
+    
+    // Callback for the AudioQueue, copies the next buffer out of the stream
+    void callback(AudioQueueRef q, AudioQueueBufferRef br);
+    
+    static void AQcallback(void *ptr, AudioQueueRef queue, AudioQueueBufferRef buf_ref){
+        AudioQueueSink *sink = (AudioQueueSink *)ptr;
+        sink->callback(queue, buf_ref);
+    }
+};
+
+#endif /* __APPLE__ */
+
+#endif /* AudioQueueSink_hpp */
@@ -0,0 +1,36 @@
+//
+//  AudioSink.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/27.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef AudioSink_hpp
+#define AudioSink_hpp
+
+#include <stdio.h>
+#include "PlaybackStream.hpp"
+
+/* AudioSink Interface (Abstract class)
+ *
+ * Somewhere for AudioPlayer to send its audio
+ *
+ * A sink pulls interleaved frames from a started PlaybackStream at
+ * whatever pace it runs at, a sound card in real time or a file as fast
+ * as the CPU allows. The player doesn't know which one it is talking to.
+ */
+
+class AudioSink {
+public:
+    virtual ~AudioSink(){}
+    
+    // Consumes the stream until it is finished
+    // Returns once everything pulled from the stream has been delivered
+    virtual void run(PlaybackStream &stream) = 0;
+    
+protected:
+private:
+};
+
+#endif /* AudioSink_hpp */
@@ -0,0 +1,292 @@
+//
+//  BatchRenderer.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/6.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "BatchRenderer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "OfflineSink.hpp"
+#include "PlaybackStream.hpp"
+#include "WavReader.hpp"
+
+// Frames per block between the producer and the writer
+static const int block_frames = 4096;
+
+// The part of path after the last /
+static std::string baseName(const std::string &path){
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::string joinPath(const std::string &directory, const std::string &name){
+    if(directory.empty() || directory[directory.size() - 1] == '/'){
+        return directory + name;
+    }
+    return directory + "/" + name;
+}
+
+// Pretty print the summary
+std::string BatchRenderer::Summary::toString(){
+    std::stringstream s;
+    s << "Rendered " << files << " file" << (files == 1 ? "" : "s");
+    s << " (" << std::fixed << std::setprecision(1) << audio_seconds << "s of audio)";
+    s << " in " << std::setprecision(2) << elapsed_seconds << "s" << std::endl;
+    s << std::setprecision(1) << files_per_second << " files/s, " << realtime_factor << "x realtime" << std::endl;
+    s << failed << " failed" << std::endl;
+    for(size_t i = 0; i < failures.size(); ++i){
+        s << "    " << failures[i].path << ": " << failures[i].message << std::endl;
+    }
+    return s.str();
+}
+
+// Constructor
+BatchRenderer::BatchRenderer(int num_threads): pool(num_threads){
+    factory = NULL;
+    factory_context = NULL;
+    memory_budget = 256 << 20;
+    output_rate = 0;
+    encoding = SampleEncoding::Float32;
+    cache = NULL;
+}
+
+// Destructor
+BatchRenderer::~BatchRenderer(){
+    deleteChains();
+}
+
+// Sets how chains are built
+void BatchRenderer::setChainFactory(ChainFactory f, void *context){
+    deleteChains();
+    factory = f;
+    factory_context = context;
+}
+
+// Queues one file
+void BatchRenderer::addFile(std::string input, std::string output){
+    Job job;
+    job.input = input;
+    job.output = output;
+
+    struct stat info;
+    job.size = (stat(input.c_str(), &info) == 0) ? (uint64_t)info.st_size : 0;
+    jobs.push_back(job);
+}
+
+// Queues every .wav file in directory
+int BatchRenderer::addDirectory(std::string directory, std::string output_directory){
+    DIR *dir = opendir(directory.c_str());
+    if(!dir){
+        throw std::runtime_error("BatchRenderer Error: Couldn't open directory " + directory + "!");
+    }
+
+    std::vector<std::string> names;
+    while(struct dirent *entry = readdir(dir)){
+        std::string name = entry->d_name;
+        if(name.size() > 4){
+            std::string extension = name.substr(name.size() - 4);
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if(extension == ".wav"){
+                names.push_back(name);
+            }
+        }
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    for(size_t i = 0; i < names.size(); ++i){
+        addFile(joinPath(directory, names[i]), joinPath(output_directory, names[i]));
+    }
+    return (int)names.size();
+}
+
+// Queues every file listed in the manifest at path
+int BatchRenderer::loadManifest(std::string path, std::string output_directory){
+    std::ifstream manifest(path);
+    if(!manifest){
+        throw std::runtime_error("BatchRenderer Error: Couldn't open manifest " + path + "!");
+    }
+
+    int count = 0;
+    std::string line;
+    while(std::getline(manifest, line)){
+        if(!line.empty() && line[line.size() - 1] == '\r'){
+            line.erase(line.size() - 1);
+        }
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        size_t tab = line.find('\t');
+        if(tab == std::string::npos){
+            addFile(line, joinPath(output_directory, baseName(line)));
+        } else {
+            addFile(line.substr(0, tab), line.substr(tab + 1));
+        }
+        ++count;
+    }
+    return count;
+}
+
+// Most bytes of audio buffered at once, across every thread
+void BatchRenderer::setMemoryBudget(size_t bytes){
+    memory_budget = bytes;
+}
+
+// Output settings
+void BatchRenderer::setOutputRate(uint32_t rate){
+    output_rate = rate;
+}
+
+void BatchRenderer::setEncoding(SampleEncoding e){
+    encoding = e;
+}
+
+// Takes inputs from cache instead of streaming them from disk
+void BatchRenderer::setCache(DecodedAudioCache *c){
+    cache = c;
+}
+
+int BatchRenderer::getNumQueued(){
+    return (int)jobs.size();
+}
+
+// Renders every queued file, then empties the queue
+BatchRenderer::Summary BatchRenderer::run(){
+    summary = Summary();
+    summary.files = 0;
+    summary.failed = 0;
+    summary.frames = 0;
+    summary.audio_seconds = 0;
+
+    // Starting the longest files first keeps one from being left running alone at the end
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b){
+        return a.size > b.size;
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.run(renderTask, this, (int)jobs.size());
+    summary.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double seconds = summary.elapsed_seconds > 0 ? summary.elapsed_seconds : 1e-9;
+    summary.files_per_second = summary.files/seconds;
+    summary.realtime_factor = summary.audio_seconds/seconds;
+
+    jobs.clear();
+    return summary;
+}
+
+// Renders job index, run on the pool
+void BatchRenderer::renderTask(void *context, int index){
+    BatchRenderer *renderer = (BatchRenderer *)context;
+    const Job &job = renderer->jobs[index];
+    try {
+        renderer->render(job);
+    } catch(std::exception &e){
+        std::lock_guard<std::mutex> guard(renderer->lock);
+        Failure failure;
+        failure.path = job.input;
+        failure.message = e.what();
+        renderer->summary.failures.push_back(failure);
+        ++renderer->summary.failed;
+    }
+}
+
+void BatchRenderer::render(const Job &job){
+    // Each thread gets an even share of the budget for its ring buffer, however long its file is
+    // A file from the cache is already whole in memory, counted by the cache's own budget
+    uint16_t channels;
+    uint32_t rate;
+    std::shared_ptr<const DecodedAudio> audio;
+    if(cache){
+        audio = cache->get(job.input);
+        channels = audio->getNumChannels();
+        rate = output_rate ? output_rate : audio->getSampleRate();
+    } else {
+        WavReader header(job.input);
+        channels = header.getNumChannels();
+        rate = output_rate ? output_rate : header.getSampleRate();
+    }
+    double share = (double)memory_budget/pool.getNumThreads();
+    float buffer_seconds = (float)std::min(10.0, share/((double)rate*channels*sizeof(float)));
+
+    AudioEffect *chain = acquireChain();
+    try {
+        PlaybackStream stream(buffer_seconds, block_frames);
+        stream.setOutputRate(output_rate);
+        OfflineSink sink(job.output, encoding, block_frames);
+
+        if(audio){
+            stream.start(audio, chain);
+        } else {
+            stream.start(job.input, chain);
+        }
+        sink.run(stream);
+        stream.stop();
+
+        // Decoding and the effects run on the stream's producer thread, anything they threw
+        // is rethrown here so renderTask records it against this file
+        if(std::exception_ptr error = stream.getError()){
+            remove(job.output.c_str()); // Only part of the file made it out
+            std::rethrow_exception(error);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        ++summary.files;
+        summary.frames += sink.getFramesRendered();
+        summary.audio_seconds += (double)sink.getFramesRendered()/stream.getSampleRate();
+    } catch(...){
+        releaseChain(chain);
+        throw;
+    }
+    releaseChain(chain);
+}
+
+// A chain no other thread is using, built if there isn't one
+// There are never more chains than threads rendering at once
+AudioEffect *BatchRenderer::acquireChain(){
+    if(!factory){
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(!idle_chains.empty()){
+        AudioEffect *chain = idle_chains.back();
+        idle_chains.pop_back();
+        return chain;
+    }
+    AudioEffect *chain = factory(factory_context);
+    chains.push_back(chain);
+    return chain;
+}
+
+void BatchRenderer::releaseChain(AudioEffect *chain){
+    if(chain){
+        std::lock_guard<std::mutex> guard(lock);
+        idle_chains.push_back(chain);
+    }
+}
+
+// Deletes every chain, and every effect after it
+void BatchRenderer::deleteChains(){
+    for(size_t i = 0; i < chains.size(); ++i){
+        AudioEffect *effect = chains[i];
+        while(effect){
+            AudioEffect *next = effect->getNext();
+            delete effect;
+            effect = next;
+        }
+    }
+    chains.clear();
+    idle_chains.clear();
+}
@@ -0,0 +1,147 @@
+//
+//  BatchRenderer.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/6.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef BatchRenderer_hpp
+#define BatchRenderer_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AudioEffect.hpp"
+#include "DecodedAudioCache.hpp"
+#include "SampleConversion.hpp"
+#include "ThreadPool.hpp"
+
+/* BatchRenderer class
+ *
+ * Renders many wav files through the same effect chain in one process
+ *
+ * Files are handed out to the thread pool longest first, and idle threads
+ * steal from busy ones. Each file is streamed: a producer thread decodes
+ * and processes blocks ahead of the worker that writes them out, so
+ * loading overlaps with processing and saving, and only a bounded window
+ * of each file is ever in memory.
+ *
+ * The chain is built by the factory once per thread that needs one and
+ * reused for every file that thread renders.
+ */
+class BatchRenderer {
+public:
+
+    // Builds a new effect chain, context is whatever was given to setChainFactory
+    // The renderer deletes the returned effect and every effect after it
+    typedef AudioEffect *(*ChainFactory)(void *context);
+
+    // One file that couldn't be rendered
+    struct Failure {
+        std::string path;
+        std::string message;
+    };
+
+    // Results of a run
+    struct Summary {
+        int files; // Rendered successfully
+        int failed;
+        uint64_t frames;
+        double audio_seconds;
+        double elapsed_seconds; // Wall clock time taken
+        double files_per_second;
+        double realtime_factor; // Seconds of audio rendered per second of wall clock time
+        std::vector<Failure> failures;
+
+        // Pretty print the summary
+        std::string toString();
+    };
+
+    // Constructor
+    // Renders on num_threads threads, 0 uses one per hardware thread
+    explicit BatchRenderer(int num_threads = 0);
+
+    // Destructor
+    // Deletes the chains that were built
+    ~BatchRenderer();
+
+    // Sets how chains are built, NULL renders without effects
+    // Chains built by an earlier factory are deleted
+    void setChainFactory(ChainFactory factory, void *context);
+
+    // Queues one file
+    void addFile(std::string input, std::string output);
+
+    // Queues every .wav file in directory, to be written under the same name in output_directory
+    // returns the number of files found
+    int addDirectory(std::string directory, std::string output_directory);
+
+    // Queues every file listed in the manifest at path
+    // One file per line, its input and output path separated by a tab. A line with just
+    // an input path is written under the same name in output_directory. Blank lines
+    // and lines starting with # are skipped.
+    //
+    // returns the number of files found
+    int loadManifest(std::string path, std::string output_directory);
+
+    // Most bytes of audio buffered at once, across every thread
+    // Only counts the streams' ring buffers, files taken from a cache stay within the cache's own budget
+    void setMemoryBudget(size_t bytes);
+
+    // Output settings, the input's sample rate is kept when rate is 0
+    void setOutputRate(uint32_t rate);
+    void setEncoding(SampleEncoding encoding);
+
+    // Takes inputs from cache instead of streaming them from disk, for inputs that are rendered
+    // over and over. The renderer doesn't take ownership, NULL goes back to streaming
+    // Each file is held whole while it renders, which the cache's budget accounts for rather than
+    // the memory budget above, so size the two together
+    void setCache(DecodedAudioCache *cache);
+
+    // Renders every queued file, then empties the queue
+    Summary run();
+
+    int getNumQueued();
+
+protected:
+private:
+    BatchRenderer(const BatchRenderer &) = delete;
+    BatchRenderer &operator=(const BatchRenderer &) = delete;
+
+    struct Job {
+        std::string input;
+        std::string output;
+        uint64_t size; // Bytes on disk, to schedule the longest first
+    };
+
+    // Renders job index, run on the pool
+    static void renderTask(void *context, int index);
+    void render(const Job &job);
+
+    // A chain no other thread is using, built if there isn't one
+    AudioEffect *acquireChain();
+    void releaseChain(AudioEffect *chain);
+    void deleteChains();
+
+    ThreadPool pool;
+    std::vector<Job> jobs;
+
+    ChainFactory factory;
+    void *factory_context;
+
+    size_t memory_budget;
+    uint32_t output_rate;
+    SampleEncoding encoding;
+    DecodedAudioCache *cache;
+
+    // Guards everything below, which the workers share
+    std::mutex lock;
+    std::vector<AudioEffect *> chains; // Every chain built
+    std::vector<AudioEffect *> idle_chains; // Chains no thread is using
+    Summary summary;
+};
+
+#endif /* BatchRenderer_hpp */
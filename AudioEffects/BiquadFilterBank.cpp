@@ -0,0 +1,339 @@
+//
+//  BiquadFilterBank.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/3.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "BiquadFilterBank.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "SampleConversion.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AUDIOEFFECTS_X86 1
+#include <immintrin.h>
+#endif
+
+// Offsets of each coefficient and state array within a group
+enum {
+    B0 = 0,
+    B1 = 8,
+    B2 = 16,
+    A1 = 24,
+    A2 = 32,
+    Z1 = 40,
+    Z2 = 48
+};
+
+// ---- Kernels, each runs one group of 8 channels over frames [0, num_frames)
+
+// One channel of a group, transposed direct form II
+static void biquadLane(float *x, size_t start, size_t end, float *g, int lane){
+    float b0 = g[B0 + lane], b1 = g[B1 + lane], b2 = g[B2 + lane];
+    float a1 = g[A1 + lane], a2 = g[A2 + lane];
+    float z1 = g[Z1 + lane], z2 = g[Z2 + lane];
+    for(size_t i = start; i < end; ++i){
+        float in = x[i];
+        float y = b0*in + z1;
+        z1 = b1*in - a1*y + z2;
+        z2 = b2*in - a2*y;
+        x[i] = y;
+    }
+    g[Z1 + lane] = z1;
+    g[Z2 + lane] = z2;
+}
+
+#ifndef AUDIOEFFECTS_X86
+static void biquadGroupScalar(float *const *channels, int active, float *g, size_t num_frames){
+    for(int lane = 0; lane < active; ++lane){
+        biquadLane(channels[lane], 0, num_frames, g, lane);
+    }
+}
+#else
+// Four channels, lanes [half*4, half*4 + 4) of the group
+static void biquadHalfSSE(float *const *channels, float *g, int half, size_t num_frames){
+    float *h = g + 4*half;
+    __m128 b0 = _mm_loadu_ps(h + B0), b1 = _mm_loadu_ps(h + B1), b2 = _mm_loadu_ps(h + B2);
+    __m128 a1 = _mm_loadu_ps(h + A1), a2 = _mm_loadu_ps(h + A2);
+    __m128 z1 = _mm_loadu_ps(h + Z1), z2 = _mm_loadu_ps(h + Z2);
+    float *c0 = channels[0], *c1 = channels[1], *c2 = channels[2], *c3 = channels[3];
+
+    size_t frame = 0;
+    for(; frame + 4 <= num_frames; frame += 4){
+        // Rows are channels, after the transpose rows are frames
+        __m128 x[4] = {
+            _mm_loadu_ps(c0 + frame), _mm_loadu_ps(c1 + frame),
+            _mm_loadu_ps(c2 + frame), _mm_loadu_ps(c3 + frame)
+        };
+        _MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+
+        for(int i = 0; i < 4; ++i){
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x[i]), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x[i]), _mm_mul_ps(a1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, x[i]), _mm_mul_ps(a2, y));
+            x[i] = y;
+        }
+
+        _MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+        _mm_storeu_ps(c0 + frame, x[0]);
+        _mm_storeu_ps(c1 + frame, x[1]);
+        _mm_storeu_ps(c2 + frame, x[2]);
+        _mm_storeu_ps(c3 + frame, x[3]);
+    }
+
+    _mm_storeu_ps(h + Z1, z1);
+    _mm_storeu_ps(h + Z2, z2);
+    for(int lane = 0; lane < 4; ++lane){
+        biquadLane(channels[lane], frame, num_frames, h, lane);
+    }
+}
+
+static void biquadGroupSSE(float *const *channels, int active, float *g, size_t num_frames){
+    biquadHalfSSE(channels, g, 0, num_frames);
+    if(active > 4){
+        biquadHalfSSE(channels + 4, g, 1, num_frames);
+    }
+}
+
+// All eight channels, each half transposed with SSE and joined into one AVX vector per frame
+__attribute__((target("avx")))
+static void biquadGroupAVX(float *const *channels, int active, float *g, size_t num_frames){
+    if(active <= 4){
+        biquadHalfSSE(channels, g, 0, num_frames);
+        return;
+    }
+
+    __m256 b0 = _mm256_loadu_ps(g + B0), b1 = _mm256_loadu_ps(g + B1), b2 = _mm256_loadu_ps(g + B2);
+    __m256 a1 = _mm256_loadu_ps(g + A1), a2 = _mm256_loadu_ps(g + A2);
+    __m256 z1 = _mm256_loadu_ps(g + Z1), z2 = _mm256_loadu_ps(g + Z2);
+
+    size_t frame = 0;
+    for(; frame + 4 <= num_frames; frame += 4){
+        __m128 lo[4], hi[4];
+        for(int i = 0; i < 4; ++i){
+            lo[i] = _mm_loadu_ps(channels[i] + frame);
+            hi[i] = _mm_loadu_ps(channels[i + 4] + frame);
+        }
+        _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+        _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+
+        for(int i = 0; i < 4; ++i){
+            __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[i]), hi[i], 1);
+            __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+            z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y)), z2);
+            z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+            lo[i] = _mm256_castps256_ps128(y);
+            hi[i] = _mm256_extractf128_ps(y, 1);
+        }
+
+        _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+        _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+        for(int i = 0; i < 4; ++i){
+            _mm_storeu_ps(channels[i] + frame, lo[i]);
+            _mm_storeu_ps(channels[i + 4] + frame, hi[i]);
+        }
+    }
+
+    _mm256_storeu_ps(g + Z1, z1);
+    _mm256_storeu_ps(g + Z2, z2);
+    for(int lane = 0; lane < 8; ++lane){
+        biquadLane(channels[lane], frame, num_frames, g, lane);
+    }
+}
+#endif /* AUDIOEFFECTS_X86 */
+
+typedef void (*BiquadKernel)(float *const *channels, int active, float *g, size_t num_frames);
+
+// Picks the widest kernel this CPU has
+static BiquadKernel selectKernel(const char **name){
+#ifdef AUDIOEFFECTS_X86
+    if(cpuHasAVX()){
+        *name = "avx";
+        return biquadGroupAVX;
+    }
+    *name = "sse";
+    return biquadGroupSSE;
+#else
+    *name = "scalar";
+    return biquadGroupScalar;
+#endif
+}
+
+// Settings of one channel's filter
+BiquadFilterBank::Parameters::Parameters(Type t, float f, float q_value, float gain){
+    type = t;
+    frequency = f;
+    q = q_value;
+    gain_db = gain;
+}
+
+// Default Constructor
+BiquadFilterBank::BiquadFilterBank(){
+    any_changed = false;
+    num_groups = 0;
+}
+
+// Sets the filter of every channel
+void BiquadFilterBank::setParameters(const Parameters &p){
+    all_parameters = p;
+    std::fill(parameters.begin(), parameters.end(), p);
+    std::fill(changed.begin(), changed.end(), 1);
+    any_changed = true;
+}
+
+// Sets the filter of one channel
+void BiquadFilterBank::setParameters(int channel, const Parameters &p){
+    if(channel < 0 || channel >= (int)parameters.size()){
+        throw std::out_of_range("BiquadFilterBank Error: No such channel!");
+    }
+    parameters[channel] = p;
+    changed[channel] = 1;
+    any_changed = true;
+}
+
+const BiquadFilterBank::Parameters &BiquadFilterBank::getParameters(int channel){
+    if(channel < 0 || channel >= (int)parameters.size()){
+        throw std::out_of_range("BiquadFilterBank Error: No such channel!");
+    }
+    return parameters[channel];
+}
+
+void BiquadFilterBank::prepare(int rate, int block, int channels){
+    AudioEffect::prepare(rate, block, channels);
+
+    // Channels that were already set up keep their filters
+    parameters.resize(channels, all_parameters);
+    changed.assign(channels, 1);
+    any_changed = true;
+
+    // Missing channels of the last group keep all zero coefficients, so they stay silent
+    num_groups = (channels + lanes - 1)/lanes;
+    bank.assign((size_t)num_groups*group_size, 0.0f);
+    silence.assign(block > 0 ? block : 1, 0.0f);
+    updateCoefficients();
+}
+
+// Clears the filter state, keeps the coefficients
+void BiquadFilterBank::reset(){
+    for(int group = 0; group < num_groups; ++group){
+        float *g = &bank[(size_t)group*group_size];
+        std::fill(g + Z1, g + Z2 + lanes, 0.0f);
+    }
+}
+
+void BiquadFilterBank::process(const AudioBufferView &buffer){
+    static const char *name;
+    static const BiquadKernel kernel = selectKernel(&name);
+
+    if(any_changed){
+        updateCoefficients();
+    }
+
+    size_t num_frames = buffer.getNumFrames();
+    size_t block = silence.size();
+    for(size_t start = 0; start < num_frames; start += block){
+        AudioBufferView piece = buffer.slice(start, std::min(block, num_frames - start));
+
+        for(int group = 0; group < num_groups; ++group){
+            int first = group*lanes;
+            int active = std::min((int)lanes, num_channels - first);
+            float *channels[lanes];
+            for(int lane = 0; lane < lanes; ++lane){
+                channels[lane] = (lane < active) ? piece[first + lane] : silence.data();
+            }
+
+            float *g = &bank[(size_t)group*group_size];
+            kernel(channels, active, g, piece.getNumFrames());
+
+            // Keep decaying state out of the denormal range
+            for(int i = Z1; i < Z2 + lanes; ++i){
+                if(fabsf(g[i]) < 1e-20f){
+                    g[i] = 0.0f;
+                }
+            }
+        }
+    }
+}
+
+// Which kernel process uses on this CPU
+const char *BiquadFilterBank::getKernelName(){
+    const char *name;
+    selectKernel(&name);
+    return name;
+}
+
+// Recomputes the coefficients of every channel whose parameters changed
+// Robert Bristow-Johnson's audio EQ cookbook formulas, normalized so a0 = 1
+void BiquadFilterBank::updateCoefficients(){
+    any_changed = false;
+    if(sample_rate <= 0){
+        return;
+    }
+
+    for(int channel = 0; channel < num_channels; ++channel){
+        if(!changed[channel]){
+            continue;
+        }
+        changed[channel] = 0;
+
+        const Parameters &p = parameters[channel];
+        double nyquist = 0.5*sample_rate;
+        double frequency = std::min(std::max((double)p.frequency, 1.0), 0.98*nyquist);
+        double w0 = 2*M_PI*frequency/sample_rate;
+        double cosw = cos(w0);
+        double alpha = sin(w0)/(2*std::max((double)p.q, 1e-3));
+        double A = pow(10.0, p.gain_db/40.0);
+        double root = 2*sqrt(A)*alpha;
+
+        double b0, b1, b2, a0, a1, a2;
+        switch(p.type){
+            case Type::LowPass:
+                b0 = (1 - cosw)/2; b1 = 1 - cosw; b2 = (1 - cosw)/2;
+                a0 = 1 + alpha; a1 = -2*cosw; a2 = 1 - alpha;
+                break;
+            case Type::HighPass:
+                b0 = (1 + cosw)/2; b1 = -(1 + cosw); b2 = (1 + cosw)/2;
+                a0 = 1 + alpha; a1 = -2*cosw; a2 = 1 - alpha;
+                break;
+            case Type::BandPass:
+                b0 = alpha; b1 = 0; b2 = -alpha;
+                a0 = 1 + alpha; a1 = -2*cosw; a2 = 1 - alpha;
+                break;
+            case Type::Notch:
+                b0 = 1; b1 = -2*cosw; b2 = 1;
+                a0 = 1 + alpha; a1 = -2*cosw; a2 = 1 - alpha;
+                break;
+            case Type::Peak:
+                b0 = 1 + alpha*A; b1 = -2*cosw; b2 = 1 - alpha*A;
+                a0 = 1 + alpha/A; a1 = -2*cosw; a2 = 1 - alpha/A;
+                break;
+            case Type::LowShelf:
+                b0 = A*((A + 1) - (A - 1)*cosw + root);
+                b1 = 2*A*((A - 1) - (A + 1)*cosw);
+                b2 = A*((A + 1) - (A - 1)*cosw - root);
+                a0 = (A + 1) + (A - 1)*cosw + root;
+                a1 = -2*((A - 1) + (A + 1)*cosw);
+                a2 = (A + 1) + (A - 1)*cosw - root;
+                break;
+            default: // HighShelf
+                b0 = A*((A + 1) + (A - 1)*cosw + root);
+                b1 = -2*A*((A - 1) + (A + 1)*cosw);
+                b2 = A*((A + 1) + (A - 1)*cosw - root);
+                a0 = (A + 1) - (A - 1)*cosw + root;
+                a1 = 2*((A - 1) - (A + 1)*cosw);
+                a2 = (A + 1) - (A - 1)*cosw - root;
+                break;
+        }
+
+        float *g = &bank[(size_t)(channel/lanes)*group_size];
+        int lane = channel % lanes;
+        g[B0 + lane] = (float)(b0/a0);
+        g[B1 + lane] = (float)(b1/a0);
+        g[B2 + lane] = (float)(b2/a0);
+        g[A1 + lane] = (float)(a1/a0);
+        g[A2 + lane] = (float)(a2/a0);
+    }
+}
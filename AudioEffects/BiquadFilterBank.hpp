@@ -0,0 +1,93 @@
+//
+//  BiquadFilterBank.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/3.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef BiquadFilterBank_hpp
+#define BiquadFilterBank_hpp
+
+#include <stdio.h>
+#include <vector>
+#include "AudioEffect.hpp"
+
+/* BiquadFilterBank class
+ *
+ * One second order filter per channel, low/high/band pass, notch, peak or shelf
+ *
+ * Channels are handled in groups of eight, with each group's coefficients
+ * and state stored structure-of-arrays so one vector holds the same value
+ * for every channel in it. Each block is transposed four frames at a time
+ * so a single vector instruction advances four (SSE) or eight (AVX)
+ * channels by one sample. Groups that aren't full are padded with silent
+ * channels.
+ *
+ * Coefficients are only recomputed for channels whose parameters changed,
+ * at the start of the next block.
+ */
+class BiquadFilterBank: public AudioEffect {
+public:
+
+    enum class Type {
+        LowPass,
+        HighPass,
+        BandPass, // 0dB peak gain
+        Notch,
+        Peak,
+        LowShelf,
+        HighShelf
+    };
+
+    // Settings of one channel's filter
+    struct Parameters {
+        Type type;
+        float frequency; // Center or corner frequency in Hz
+        float q;
+        float gain_db; // Only used by Peak and the shelves
+
+        Parameters(Type type = Type::LowPass, float frequency = 1000.0f, float q = 0.70710678f, float gain_db = 0.0f);
+    };
+
+    // Default Constructor
+    BiquadFilterBank();
+
+    // Sets the filter of every channel
+    void setParameters(const Parameters &parameters);
+
+    // Sets the filter of one channel, only valid after prepare
+    // The setting is kept by later prepares with at least that many channels
+    void setParameters(int channel, const Parameters &parameters);
+    const Parameters &getParameters(int channel);
+
+    void prepare(int sample_rate, int max_block, int num_channels) override;
+    void reset() override;
+    void process(const AudioBufferView &buffer) override;
+
+    // Which kernel process uses on this CPU, for diagnostics
+    const char *getKernelName();
+
+protected:
+private:
+    // Channels per group, and floats of coefficients and state per group
+    static const int lanes = 8;
+    static const int group_size = 7*lanes;
+
+    // Recomputes the coefficients of every channel whose parameters changed
+    void updateCoefficients();
+
+    Parameters all_parameters; // What channels start with at prepare
+    std::vector<Parameters> parameters;
+    std::vector<char> changed;
+    bool any_changed;
+
+    // Per group b0, b1, b2, a1, a2, z1, z2, each lanes floats long
+    std::vector<float> bank;
+    int num_groups;
+
+    // Stands in for the missing channels of the last group
+    std::vector<float> silence;
+};
+
+#endif /* BiquadFilterBank_hpp */
@@ -0,0 +1,66 @@
+//
+//  ChannelParallelExecutor.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/29.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "ChannelParallelExecutor.hpp"
+#include <algorithm>
+
+// Constructor
+ChannelParallelExecutor::ChannelParallelExecutor(ThreadPool &p) : pool(p){
+    stage = NULL;
+    num_groups = 0;
+}
+
+// Processes a block with chain and every effect after it
+void ChannelParallelExecutor::process(AudioEffect *chain, const AudioBufferView &buffer){
+    int num_channels = buffer.getNumChannels();
+    size_t samples = buffer.getNumFrames()*num_channels;
+    bool parallel = pool.getNumThreads() > 1 && num_channels > 1 && samples >= min_parallel_samples;
+
+    for(AudioEffect *ae = chain; ae; ae = ae->getNext()){
+        if(!parallel || !ae->supportsChannelParallel()){
+            ae->processTimed(buffer);
+            continue;
+        }
+
+        // Timed as a whole from here, so the effect's counters show the wall clock time of the block
+        bool timed = Instrumentation::isEnabled();
+        uint64_t start = timed ? Instrumentation::now() : 0;
+        ae->beginBlock((int)buffer.getNumFrames());
+
+        // Twice as many groups as threads leaves something to steal when channels cost different amounts
+        stage = ae;
+        block = buffer;
+        num_groups = std::min(num_channels, 2*pool.getNumThreads());
+        pool.run(&ChannelParallelExecutor::processGroup, this, num_groups);
+        if(timed){
+            ae->getCounters().record(buffer.getNumFrames(), Instrumentation::now() - start);
+        }
+    }
+}
+
+// Applies the whole chain to buffer in place, in the same blocks as AudioEffect::apply
+void ChannelParallelExecutor::apply(AudioEffect *chain, const AudioBufferView &buffer, int rate){
+    const size_t block_frames = 4096;
+    size_t num_frames = buffer.getNumFrames();
+
+    chain->prepareChain(rate, block_frames, buffer.getNumChannels());
+    chain->resetChain();
+
+    for(size_t start = 0; start < num_frames; start += block_frames){
+        process(chain, buffer.slice(start, std::min(block_frames, num_frames - start)));
+    }
+}
+
+// Runs one channel group of the current stage
+void ChannelParallelExecutor::processGroup(void *context, int group){
+    ChannelParallelExecutor *executor = static_cast<ChannelParallelExecutor *>(context);
+    int num_channels = executor->block.getNumChannels();
+    int first = group*num_channels/executor->num_groups;
+    int last = (group + 1)*num_channels/executor->num_groups;
+    executor->stage->processChannels(executor->block, first, last - first);
+}
@@ -0,0 +1,36 @@
+//
+//  Clipper.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/1.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "Clipper.hpp"
+#include <cmath>
+
+// Constructor
+Clipper::Clipper(float t){
+    threshold = fabsf(t);
+}
+
+void Clipper::setThreshold(float t){
+    threshold = fabsf(t);
+}
+
+float Clipper::getThreshold(){
+    return threshold;
+}
+
+// No state to clear
+void Clipper::reset(){
+}
+
+// Every sample is independent
+bool Clipper::supportsChannelParallel(){
+    return true;
+}
+
+bool Clipper::supportsInterleaved(){
+    return true;
+}
@@ -0,0 +1,62 @@
+//
+//  Clipper.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/1.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef Clipper_hpp
+#define Clipper_hpp
+
+#include <stdio.h>
+#include <algorithm>
+#include "AudioEffect.hpp"
+
+/* Clipper class
+ *
+ * Hard clips every sample to [-threshold, threshold]
+ *
+ * The per sample loops are defined here rather than in the .cpp so a
+ * StaticChain can inline them instead of calling out for every piece.
+ */
+class Clipper final: public AudioEffect {
+public:
+
+    // Constructor
+    Clipper(float threshold = 1.0f);
+
+    void setThreshold(float threshold);
+    float getThreshold();
+
+    void reset() override;
+
+    void process(const AudioBufferView &buffer) override {
+        processChannels(buffer, 0, buffer.getNumChannels());
+    }
+
+    bool supportsChannelParallel() override;
+    void processChannels(const AudioBufferView &buffer, int first, int count) override {
+        size_t num_frames = buffer.getNumFrames();
+        for(int channel = first; channel < first + count; ++channel){
+            float *samples = buffer[channel];
+            for(size_t i = 0; i < num_frames; ++i){
+                samples[i] = std::min(threshold, std::max(-threshold, samples[i]));
+            }
+        }
+    }
+
+    bool supportsInterleaved() override;
+    void processInterleaved(float *buffer, int num_frames) override {
+        size_t count = (size_t)num_frames*num_channels;
+        for(size_t i = 0; i < count; ++i){
+            buffer[i] = std::min(threshold, std::max(-threshold, buffer[i]));
+        }
+    }
+
+protected:
+private:
+    float threshold;
+};
+
+#endif /* Clipper_hpp */
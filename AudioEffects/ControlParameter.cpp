@@ -0,0 +1,156 @@
+//
+//  ControlParameter.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/24.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "ControlParameter.hpp"
+#include <algorithm>
+#include <cmath>
+
+TriangleLFO::TriangleLFO(float min_v, float max_v){
+    min_value = min_v;
+    max_value = max_v;
+    phase = 0;
+    phase_per_sample = 0;
+}
+
+void TriangleLFO::setRange(float min_v, float max_v){
+    min_value = min_v;
+    max_value = max_v;
+}
+
+// Sets the length of one full cycle in samples
+void TriangleLFO::setPeriod(double period_in_samples){
+    phase_per_sample = (period_in_samples > 0) ? 1.0/period_in_samples : 0;
+}
+
+// Moves back to the start of the cycle
+void TriangleLFO::reset(){
+    phase = 0;
+}
+
+float TriangleLFO::value(){
+    // Rises from 0 to 1 over the first half of the cycle, falls back over the second
+    float tri = (float)(1.0 - std::abs(2.0*phase - 1.0));
+    return (max_value - min_value)*tri + min_value;
+}
+
+float TriangleLFO::advance(int num_samples){
+    phase += num_samples*phase_per_sample;
+    if(phase >= 1.0){
+        phase -= std::floor(phase);
+    }
+    return value();
+}
+
+ControlParameter::ControlParameter(int n, Interpolation interp){
+    interpolation = interp;
+    start = target = current = increment = 0;
+    position = 0;
+    setInterval(n);
+    applyInterval();
+}
+
+// Number of samples between control values
+// A period in progress keeps its length, the source was already advanced by all of it,
+// so the new interval starts with the next period
+void ControlParameter::setInterval(int n){
+    next_interval = std::max(1, n);
+}
+
+// Length of the next control period
+int ControlParameter::getInterval(){
+    return next_interval;
+}
+
+void ControlParameter::setInterpolation(Interpolation interp){
+    interpolation = interp;
+}
+
+// Starts over from the source's current value
+void ControlParameter::reset(ControlSource &source){
+    start = target = current = source.value();
+    increment = 0;
+
+    // Pretend a period just finished so the next render asks for a new value
+    position = interval;
+}
+
+// Fills out with num_samples per sample values, advancing the source as needed
+void ControlParameter::render(ControlSource &source, float *out, int num_samples){
+    int done = 0;
+    while(done < num_samples){
+        if(position == interval){
+            nextPeriod(source);
+        }
+
+        int n = std::min(interval - position, num_samples - done);
+        float *dst = out + done;
+
+        if(interpolation == Interpolation::Linear){
+            // Computed from the start of the period instead of accumulated,
+            // so every sample is independent and the loop vectorizes
+            for(int i = 0; i < n; ++i){
+                dst[i] = start + (position + i)*increment;
+            }
+        } else {
+            float y = current;
+            for(int i = 0; i < n; ++i){
+                y += smoothing*(target - y);
+                dst[i] = y;
+            }
+            current = y;
+        }
+
+        position += n;
+        done += n;
+    }
+}
+
+// Samples left in the current control period, 0 if the next sample starts a new one
+int ControlParameter::getFramesToNextPeriod(){
+    return interval - position;
+}
+
+// Moves forward num_samples as if they had been rendered
+void ControlParameter::skip(ControlSource &source, size_t num_samples){
+    while(num_samples > 0){
+        if(position == interval){
+            nextPeriod(source);
+        }
+
+        int n = (int)std::min((size_t)(interval - position), num_samples);
+
+        // Linear values only depend on the position, smoothing has to be run to know where it ends up
+        if(interpolation == Interpolation::Smoothed){
+            float y = current;
+            for(int i = 0; i < n; ++i){
+                y += smoothing*(target - y);
+            }
+            current = y;
+        }
+
+        position += n;
+        num_samples -= n;
+    }
+}
+
+// Makes the interval last set the current one
+void ControlParameter::applyInterval(){
+    interval = next_interval;
+
+    // Gets within 1% of the target by the end of a control period
+    smoothing = 1.0f - powf(0.01f, 1.0f/interval);
+}
+
+// Starts the next control period from where the last one ended
+void ControlParameter::nextPeriod(ControlSource &source){
+    applyInterval();
+    start = target;
+    target = source.advance(interval);
+    increment = (target - start)/interval;
+    position = 0;
+}
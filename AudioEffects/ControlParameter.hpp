@@ -0,0 +1,125 @@
+//
+//  ControlParameter.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/24.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef ControlParameter_hpp
+#define ControlParameter_hpp
+
+#include <stdio.h>
+#include <cstddef>
+
+/* ControlSource Interface (Abstract class)
+ *
+ * Something that drives a parameter, like an LFO or an envelope
+ *
+ * Sources are only asked for a value once every control period, so they
+ * can afford to do more work than anything running per sample
+ */
+class ControlSource {
+public:
+    virtual ~ControlSource(){}
+
+    // The value at the current position
+    virtual float value() = 0;
+
+    // Moves forward by num_samples and returns the new value
+    virtual float advance(int num_samples) = 0;
+};
+
+/* TriangleLFO class
+ *
+ * Triangle wave that starts at min_value, peaks at max_value halfway
+ * through the period and returns to min_value
+ *
+ * The phase is kept as a running accumulator, so advancing costs an add
+ * and a compare instead of a division and a modulo
+ */
+class TriangleLFO: public ControlSource {
+public:
+
+    TriangleLFO(float min_value = 0.0f, float max_value = 1.0f);
+
+    void setRange(float min_value, float max_value);
+
+    // Sets the length of one full cycle in samples
+    void setPeriod(double period_in_samples);
+
+    // Moves back to the start of the cycle
+    void reset();
+
+    float value() override;
+    float advance(int num_samples) override;
+
+protected:
+private:
+    float min_value;
+    float max_value;
+    double phase; // Position in the cycle, in [0, 1)
+    double phase_per_sample;
+};
+
+/* ControlParameter class
+ *
+ * A parameter that is evaluated at a control rate and interpolated per sample
+ *
+ * The source is asked for a new value every interval samples, and the
+ * samples in between are filled in either with a linear ramp or by
+ * smoothing towards the new value. Rendering can be split into blocks of
+ * any size, the values produced don't depend on how it was split.
+ */
+class ControlParameter {
+public:
+
+    enum class Interpolation {
+        Linear, // Straight line between control values, exact for piecewise linear sources
+        Smoothed // One pole smoothing towards each control value
+    };
+
+    ControlParameter(int interval = 32, Interpolation interpolation = Interpolation::Linear);
+
+    // Number of samples between control values
+    // Takes effect when the current control period ends, getInterval returns the new one straight away
+    void setInterval(int interval);
+    int getInterval();
+
+    void setInterpolation(Interpolation interpolation);
+
+    // Starts over from the source's current value
+    void reset(ControlSource &source);
+
+    // Fills out with num_samples per sample values, advancing the source as needed
+    void render(ControlSource &source, float *out, int num_samples);
+
+    // Samples left in the current control period, 0 if the next sample starts a new one
+    // The source is only asked for a value when a period starts, so anything driving it
+    // only needs to be up to date at those samples
+    int getFramesToNextPeriod();
+
+    // Moves forward num_samples as if they had been rendered, without producing them
+    // Asks the source for the same values render would, so rendering afterwards
+    // gives exactly the values render would have
+    void skip(ControlSource &source, size_t num_samples);
+
+protected:
+private:
+    // Starts the next control period from where the last one ended
+    void nextPeriod(ControlSource &source);
+    void applyInterval();
+
+    int interval; // Length of the current control period
+    int next_interval; // Set by setInterval, applied when the next period starts
+    Interpolation interpolation;
+    float smoothing; // Per sample coefficient for Smoothed
+
+    float start; // Value at the start of the current control period
+    float target; // Value at the end of the current control period
+    float increment; // Per sample change for Linear
+    float current; // Last value produced for Smoothed
+    int position; // Samples rendered in the current control period
+};
+
+#endif /* ControlParameter_hpp */
@@ -0,0 +1,201 @@
+//
+//  Convolver.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/4.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "Convolver.hpp"
+#include <algorithm>
+#include <cstring>
+#include "Resampler.hpp"
+#include "WavFile.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// acc += x*h over num_bins complex bins, the inner loop of the whole convolver
+static void multiplyAccumulate(const float *x_re, const float *x_im, const float *h_re, const float *h_im,
+                               float *acc_re, float *acc_im, int num_bins){
+    int k = 0;
+#ifdef __SSE2__
+    for(; k + 4 <= num_bins; k += 4){
+        __m128 xr = _mm_loadu_ps(x_re + k);
+        __m128 xi = _mm_loadu_ps(x_im + k);
+        __m128 hr = _mm_loadu_ps(h_re + k);
+        __m128 hi = _mm_loadu_ps(h_im + k);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(acc_re + k, _mm_add_ps(_mm_loadu_ps(acc_re + k), re));
+        _mm_storeu_ps(acc_im + k, _mm_add_ps(_mm_loadu_ps(acc_im + k), im));
+    }
+#endif
+    for(; k < num_bins; ++k){
+        acc_re[k] += x_re[k]*h_re[k] - x_im[k]*h_im[k];
+        acc_im[k] += x_re[k]*h_im[k] + x_im[k]*h_re[k];
+    }
+}
+
+// Default Constructor
+Convolver::Convolver(){
+    ir_sample_rate = 0;
+    partition_size = 512;
+    num_partitions = 0;
+    num_bins = 0;
+    delay_head = 0;
+    position = 0;
+}
+
+// Loads the impulse response from a wav file
+void Convolver::loadImpulseResponse(const std::string &path){
+    WavFile w(path);
+    setImpulseResponse(w.getData(), w.getSampleRate());
+}
+
+// Copies the impulse response out of ir
+void Convolver::setImpulseResponse(const AudioBufferView &response, int rate){
+    ir.allocate(response.getNumChannels(), response.getNumFrames());
+    ir.copyFrom(response);
+    ir_sample_rate = rate;
+}
+
+// Samples per partition, rounded up to a power of two
+void Convolver::setPartitionSize(int size){
+    int n = 2;
+    while(n < size){
+        n <<= 1;
+    }
+    partition_size = n;
+}
+
+int Convolver::getPartitionSize(){
+    return partition_size;
+}
+
+// Samples the output lags behind the input
+int Convolver::getLatency(){
+    return partition_size;
+}
+
+// Computes the partition spectra and allocates everything process needs
+void Convolver::prepare(int rate, int block, int channels){
+    AudioEffect::prepare(rate, block, channels);
+
+    // A response recorded at another rate is converted once, the original is kept for later prepares
+    AudioBuffer converted;
+    AudioBufferView response = ir.view();
+    if(ir.getNumFrames() > 0 && ir_sample_rate != rate){
+        Resampler::convert(ir.view(), ir_sample_rate, rate, converted);
+        response = converted.view();
+    }
+
+    int fft_size = 2*partition_size;
+    fft.setSize(fft_size);
+    num_bins = partition_size + 1;
+    num_partitions = (int)((response.getNumFrames() + partition_size - 1)/partition_size);
+
+    // Each partition is zero padded to the transform size
+    int ir_channels = response.getNumChannels();
+    ir_re.assign((size_t)ir_channels*num_partitions*num_bins, 0.0f);
+    ir_im.assign(ir_re.size(), 0.0f);
+    time.assign(fft_size, 0.0f);
+    for(int c = 0; c < ir_channels; ++c){
+        for(int p = 0; p < num_partitions; ++p){
+            size_t start = (size_t)p*partition_size;
+            size_t n = std::min((size_t)partition_size, response.getNumFrames() - start);
+            std::fill(time.begin(), time.end(), 0.0f);
+            memcpy(time.data(), response[c] + start, n*sizeof(float));
+
+            size_t offset = ((size_t)c*num_partitions + p)*num_bins;
+            fft.forward(time.data(), &ir_re[offset], &ir_im[offset]);
+        }
+    }
+
+    delay_re.assign((size_t)channels*num_partitions*num_bins, 0.0f);
+    delay_im.assign(delay_re.size(), 0.0f);
+    sum_re.assign(num_bins, 0.0f);
+    sum_im.assign(num_bins, 0.0f);
+    input.allocate(channels, fft_size);
+    output.allocate(channels, partition_size);
+    reset();
+}
+
+// Clears the input history and the delay line
+void Convolver::reset(){
+    std::fill(delay_re.begin(), delay_re.end(), 0.0f);
+    std::fill(delay_im.begin(), delay_im.end(), 0.0f);
+    input.view().clear();
+    output.view().clear();
+    delay_head = 0;
+    position = 0;
+}
+
+void Convolver::process(const AudioBufferView &buffer){
+    if(num_partitions == 0){
+        return;
+    }
+
+    size_t num_frames = buffer.getNumFrames();
+    size_t done = 0;
+    while(done < num_frames){
+        size_t n = std::min((size_t)(partition_size - position), num_frames - done);
+
+        // Input goes into the second half of the window, output comes from the last block
+        for(int channel = 0; channel < num_channels; ++channel){
+            float *x = buffer[channel] + done;
+            float *in = input[channel] + partition_size + position;
+            const float *out = output[channel] + position;
+            for(size_t i = 0; i < n; ++i){
+                in[i] = x[i];
+                x[i] = out[i];
+            }
+        }
+        position += (int)n;
+        done += n;
+
+        if(position == partition_size){
+            delay_head = (delay_head + 1) % num_partitions;
+            for(int channel = 0; channel < num_channels; ++channel){
+                convolveBlock(channel);
+            }
+            position = 0;
+        }
+    }
+}
+
+// Transforms the last block of channel, convolves it, and leaves the result in its output
+void Convolver::convolveBlock(int channel){
+    size_t channel_offset = (size_t)channel*num_partitions*num_bins;
+    float *window = input[channel];
+
+    float *newest_re = &delay_re[channel_offset + (size_t)delay_head*num_bins];
+    float *newest_im = &delay_im[channel_offset + (size_t)delay_head*num_bins];
+    fft.forward(window, newest_re, newest_im);
+
+    // Partition p of the response goes with the input spectrum from p blocks ago
+    int ir_channel = std::min(channel, ir.getNumChannels() - 1);
+    const float *h_re = &ir_re[(size_t)ir_channel*num_partitions*num_bins];
+    const float *h_im = &ir_im[(size_t)ir_channel*num_partitions*num_bins];
+    float *acc_re = sum_re.data();
+    float *acc_im = sum_im.data();
+    std::fill(sum_re.begin(), sum_re.end(), 0.0f);
+    std::fill(sum_im.begin(), sum_im.end(), 0.0f);
+
+    int slot = delay_head;
+    for(int p = 0; p < num_partitions; ++p){
+        const float *x_re = &delay_re[channel_offset + (size_t)slot*num_bins];
+        const float *x_im = &delay_im[channel_offset + (size_t)slot*num_bins];
+        multiplyAccumulate(x_re, x_im, h_re + (size_t)p*num_bins, h_im + (size_t)p*num_bins,
+                           acc_re, acc_im, num_bins);
+        slot = (slot == 0) ? num_partitions - 1 : slot - 1;
+    }
+
+    // Overlap-save: the first half of the result is wrapped around garbage, the second half is valid
+    fft.inverse(acc_re, acc_im, time.data());
+    memcpy(output[channel], time.data() + partition_size, partition_size*sizeof(float));
+
+    // Slide the window along for the next block
+    memcpy(window, window + partition_size, partition_size*sizeof(float));
+}
@@ -0,0 +1,100 @@
+//
+//  Convolver.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/4.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef Convolver_hpp
+#define Convolver_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "AudioEffect.hpp"
+#include "FFT.hpp"
+
+/* Convolver class
+ *
+ * Convolves every channel with an impulse response, for reverbs, cabinets
+ * and room correction
+ *
+ * Uses uniformly partitioned overlap-save convolution. The impulse
+ * response is cut into partitions of partition_size samples whose spectra
+ * are computed once by prepare. Every partition_size input samples, the
+ * last 2*partition_size samples are transformed and pushed onto a delay
+ * line of spectra, multiplied with the partitions and summed, and
+ * transformed back. The cost per sample grows with the log of the
+ * partition size rather than with the length of the response.
+ *
+ * The output is delayed by partition_size samples: smaller partitions
+ * mean less latency but more work per sample. Nothing is allocated while
+ * processing.
+ *
+ * A response recorded at a different rate than the stream is resampled
+ * by prepare.
+ *
+ * A mono response is used for every channel, otherwise channel c uses
+ * channel c of the response, or its last channel if it has fewer.
+ */
+class Convolver: public AudioEffect {
+public:
+
+    // Default Constructor
+    Convolver();
+
+    // Loads the impulse response from a wav file
+    void loadImpulseResponse(const std::string &path);
+
+    // Copies the impulse response out of ir, recorded at sample_rate
+    void setImpulseResponse(const AudioBufferView &ir, int sample_rate);
+
+    // Samples per partition, rounded up to a power of two
+    // Takes effect at the next prepare
+    void setPartitionSize(int size);
+    int getPartitionSize();
+
+    // Samples the output lags behind the input
+    int getLatency();
+
+    void prepare(int sample_rate, int max_block, int num_channels) override;
+    void reset() override;
+    void process(const AudioBufferView &buffer) override;
+
+protected:
+private:
+    // Transforms the last block of channel, convolves it, and leaves the result in its output
+    void convolveBlock(int channel);
+
+    AudioBuffer ir;
+    int ir_sample_rate;
+
+    int partition_size;
+    int num_partitions;
+    int num_bins; // partition_size + 1
+
+    FFT fft; // Size 2*partition_size
+
+    // Spectra of the partitions of each response channel, partition p of channel c
+    // starts at (c*num_partitions + p)*num_bins
+    std::vector<float> ir_re;
+    std::vector<float> ir_im;
+
+    // Per stream channel, the last num_partitions input spectra as a ring
+    std::vector<float> delay_re;
+    std::vector<float> delay_im;
+    int delay_head; // Slot holding the newest spectrum
+
+    AudioBuffer input; // The last 2*partition_size input samples of each channel
+    AudioBuffer output; // The output of the last block, read out while the next one fills
+    int position; // Samples into the current block
+
+    // Scratch
+    std::vector<float> sum_re;
+    std::vector<float> sum_im;
+    std::vector<float> time;
+};
+
+#endif /* Convolver_hpp */
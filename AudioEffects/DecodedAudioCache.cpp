@@ -0,0 +1,193 @@
+//
+//  DecodedAudioCache.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "DecodedAudioCache.hpp"
+#include <stdexcept>
+#include "WavReader.hpp"
+
+// Constructor
+// Decodes the whole wav file at path
+DecodedAudio::DecodedAudio(std::string path){
+    WavReader reader(path);
+    filename = reader.getFileName();
+    sample_rate = reader.getSampleRate();
+    samples.allocate(reader.getNumChannels(), reader.getNumSamples());
+    num_frames = reader.read(samples.view());
+}
+
+// View of all the samples
+AudioBufferView DecodedAudio::getData() const {
+    return samples.slice(0, num_frames);
+}
+
+// Getters
+std::string DecodedAudio::getFileName() const {
+    return filename;
+}
+
+uint16_t DecodedAudio::getNumChannels() const {
+    return (uint16_t)samples.getNumChannels();
+}
+
+uint32_t DecodedAudio::getSampleRate() const {
+    return sample_rate;
+}
+
+size_t DecodedAudio::getNumFrames() const {
+    return num_frames;
+}
+
+size_t DecodedAudio::getBytes() const {
+    return samples.getStride()*samples.getNumChannels()*sizeof(float);
+}
+
+// Constructor
+DecodedAudioCache::DecodedAudioCache(size_t byte_budget){
+    budget = byte_budget;
+    bytes_used = 0;
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+// The decoded samples of the wav file at path
+// The first thread to miss puts a placeholder in the cache and decodes the file
+// with the lock released, anyone else asking meanwhile waits on the placeholder
+std::shared_ptr<const DecodedAudio> DecodedAudioCache::get(const std::string &path){
+    FileStamp stamp;
+    if(!getFileStamp(path, stamp)){
+        throw std::runtime_error("DecodedAudioCache Error: Couldn't open " + path + "!");
+    }
+
+    std::promise<Audio> promise;
+    std::shared_future<Audio> future;
+    bool decode = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<std::string, Entry>::iterator it = entries.find(path);
+        if(it != entries.end() && compareStamps(it->second.stamp, stamp)){
+            ++hits;
+            recently_used.splice(recently_used.begin(), recently_used, it->second.recent);
+            future = it->second.audio;
+        } else {
+            if(it != entries.end()){
+                erase(it);
+            }
+            ++misses;
+            recently_used.push_front(path);
+            Entry &entry = entries[path];
+            entry.stamp = stamp;
+            entry.audio = promise.get_future().share();
+            entry.bytes = 0;
+            entry.recent = recently_used.begin();
+            decode = true;
+        }
+    }
+    if(!decode){
+        // Waits if another thread is still decoding it, and rethrows if that failed
+        return future.get();
+    }
+
+    // The placeholder is ours as long as it's still pending for this version of the file
+    Audio audio;
+    try {
+        audio = std::make_shared<DecodedAudio>(path);
+    } catch(...){
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> guard(lock);
+        std::map<std::string, Entry>::iterator it = entries.find(path);
+        if(it != entries.end() && it->second.bytes == 0 && compareStamps(it->second.stamp, stamp)){
+            erase(it);
+        }
+        throw;
+    }
+    promise.set_value(audio);
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Entry>::iterator it = entries.find(path);
+    if(it != entries.end() && it->second.bytes == 0 && compareStamps(it->second.stamp, stamp)){
+        it->second.bytes = audio->getBytes();
+        bytes_used += it->second.bytes;
+        if(it->second.bytes > budget){
+            erase(it);
+        } else {
+            evict();
+        }
+    }
+    return audio;
+}
+
+// Most bytes of samples kept
+void DecodedAudioCache::setBudget(size_t bytes){
+    std::lock_guard<std::mutex> guard(lock);
+    budget = bytes;
+    evict();
+}
+
+// Drops every file, anyone still holding one keeps it
+void DecodedAudioCache::clear(){
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    recently_used.clear();
+    bytes_used = 0;
+}
+
+// Drops least recently used files until the budget is kept
+// Files still being decoded don't count towards it yet, so they're passed over
+void DecodedAudioCache::evict(){
+    std::list<std::string>::iterator recent = recently_used.end();
+    while(bytes_used > budget && recent != recently_used.begin()){
+        --recent;
+        std::map<std::string, Entry>::iterator it = entries.find(*recent);
+        if(it->second.bytes == 0){
+            continue;
+        }
+        // Step past it before erase invalidates it
+        ++recent;
+        erase(it);
+        ++evictions;
+    }
+}
+
+// Drops the entry for path
+void DecodedAudioCache::erase(std::map<std::string, Entry>::iterator it){
+    bytes_used -= it->second.bytes;
+    recently_used.erase(it->second.recent);
+    entries.erase(it);
+}
+
+// Getters
+size_t DecodedAudioCache::getBudget(){
+    std::lock_guard<std::mutex> guard(lock);
+    return budget;
+}
+
+size_t DecodedAudioCache::getBytesUsed(){
+    std::lock_guard<std::mutex> guard(lock);
+    return bytes_used;
+}
+
+size_t DecodedAudioCache::getNumEntries(){
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+
+uint64_t DecodedAudioCache::getHits(){
+    std::lock_guard<std::mutex> guard(lock);
+    return hits;
+}
+
+uint64_t DecodedAudioCache::getMisses(){
+    std::lock_guard<std::mutex> guard(lock);
+    return misses;
+}
+
+uint64_t DecodedAudioCache::getEvictions(){
+    std::lock_guard<std::mutex> guard(lock);
+    return evictions;
+}
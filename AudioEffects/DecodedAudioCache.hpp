@@ -0,0 +1,124 @@
+//
+//  DecodedAudioCache.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef DecodedAudioCache_hpp
+#define DecodedAudioCache_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "AudioBuffer.hpp"
+#include "WavCommon.hpp"
+
+/* DecodedAudio class
+ *
+ * Every sample of a wav file, decoded once and never changed again
+ *
+ * Shared between everyone playing or rendering the file through
+ * shared_ptr<const DecodedAudio>. Nothing may write through the views it
+ * hands out, anyone that needs to change the samples copies them first.
+ */
+class DecodedAudio {
+public:
+
+    // Constructor
+    // Decodes the whole wav file at path
+    explicit DecodedAudio(std::string path);
+
+    // View of all the samples, valid as long as this object is
+    AudioBufferView getData() const;
+
+    // Getters
+    std::string getFileName() const;
+    uint16_t getNumChannels() const;
+    uint32_t getSampleRate() const;
+    size_t getNumFrames() const;
+    size_t getBytes() const; // Memory the samples take up
+
+protected:
+private:
+    DecodedAudio(const DecodedAudio &) = delete;
+    DecodedAudio &operator=(const DecodedAudio &) = delete;
+
+    std::string filename;
+    uint32_t sample_rate;
+    size_t num_frames; // Can be fewer than samples holds, if the file was cut short
+    AudioBuffer samples;
+};
+
+/* DecodedAudioCache class
+ *
+ * Decoded files shared between every player and renderer that asks for them
+ *
+ * Files are identified by path, size and modification time, so a file
+ * that changes on disk is decoded again. The least recently used files
+ * are dropped once their samples take up more than the byte budget, but
+ * stay alive for as long as anyone still holds them.
+ *
+ * Safe to use from several threads at once. Decoding happens outside the
+ * lock, and threads asking for a file that's already being decoded wait
+ * for that instead of decoding it again.
+ */
+class DecodedAudioCache {
+public:
+
+    // Constructor
+    explicit DecodedAudioCache(size_t byte_budget = 512 << 20);
+
+    // The decoded samples of the wav file at path, decoded now if they aren't cached
+    // Throws whatever decoding throws
+    std::shared_ptr<const DecodedAudio> get(const std::string &path);
+
+    // Most bytes of samples kept, dropping the least recently used files right away if needed
+    // Files larger than the whole budget are decoded but never kept
+    void setBudget(size_t bytes);
+
+    // Drops every file
+    void clear();
+
+    // Getters
+    size_t getBudget();
+    size_t getBytesUsed();
+    size_t getNumEntries();
+    uint64_t getHits();
+    uint64_t getMisses();
+    uint64_t getEvictions();
+
+protected:
+private:
+    typedef std::shared_ptr<const DecodedAudio> Audio;
+
+    struct Entry {
+        FileStamp stamp;
+        std::shared_future<Audio> audio; // Not ready while it's being decoded
+        size_t bytes; // 0 until it's decoded
+        std::list<std::string>::iterator recent; // Position in the recently used list
+    };
+
+    // Drops least recently used files until the budget is kept, lock must be held
+    void evict();
+
+    // Drops the entry for path, lock must be held
+    void erase(std::map<std::string, Entry>::iterator it);
+
+    std::map<std::string, Entry> entries;
+    std::list<std::string> recently_used; // Most recent first
+    size_t budget;
+    size_t bytes_used;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    std::mutex lock;
+};
+
+#endif /* DecodedAudioCache_hpp */
@@ -0,0 +1,224 @@
+//
+//  EffectChain.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/30.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "EffectChain.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+// Checks of a queue before a waiting stage goes to sleep on it
+// Long enough to catch a neighbour that's about to finish a block, short next to processing one
+static const int spin_checks = 256;
+
+static double secondsSince(Clock::time_point start){
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Constructor
+EffectChain::EffectChain(int block, int depth): failed(false){
+    block_frames = block > 0 ? block : 4096;
+    queue_blocks = depth > 0 ? depth : 1;
+}
+
+// Use every effect from chain onwards as a stage
+void EffectChain::setEffects(AudioEffect *chain){
+    stages.clear();
+    for(AudioEffect *ae = chain; ae; ae = ae->getNext()){
+        stages.push_back(ae);
+    }
+
+    stats.assign(stages.size(), StageStats());
+    queues.clear();
+    for(size_t i = 0; i < stages.size(); ++i){
+        queues.push_back(std::unique_ptr<Queue>(new Queue(queue_blocks)));
+    }
+}
+
+// Applies every stage to the whole of buffer in place
+void EffectChain::apply(const AudioBufferView &in, int sample_rate){
+    if(stages.empty()){
+        return;
+    }
+
+    buffer = in;
+    for(size_t i = 0; i < stages.size(); ++i){
+        stages[i]->prepare(sample_rate, block_frames, buffer.getNumChannels());
+        stages[i]->reset();
+        stats[i] = StageStats();
+        stats[i].effect = stages[i];
+    }
+    for(size_t i = 0; i < queues.size(); ++i){
+        queues[i]->items.clear();
+    }
+    failed = false;
+    error = nullptr;
+
+    std::vector<std::thread> workers;
+    for(size_t i = 0; i < stages.size(); ++i){
+        workers.push_back(std::thread(&EffectChain::runStage, this, (int)i));
+    }
+
+    // Feed the first stage, sleeping while its queue is full, and stop early once a stage has failed
+    // The last stage finishes blocks instead of passing them on, so joining it means everything is done
+    Queue &first = *queues.front();
+    size_t num_frames = buffer.getNumFrames();
+    for(size_t next = 0; next < num_frames && !failed; next += block_frames){
+        push(first, next);
+    }
+    push(first, end_of_stream);
+
+    for(size_t i = 0; i < workers.size(); ++i){
+        workers[i].join();
+    }
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+// Body of the thread running stage index
+void EffectChain::runStage(int index){
+    AudioEffect *effect = stages[index];
+    StageStats &s = stats[index];
+    Queue &in = *queues[index];
+    Queue *out = (index + 1 < (int)queues.size()) ? queues[index + 1].get() : NULL;
+    size_t num_frames = buffer.getNumFrames();
+    double total_queue = 0;
+    uint64_t blocks = 0;
+
+    while(true){
+        // Wait for the previous stage to hand over a block
+        size_t start;
+        size_t waiting;
+        s.wait_seconds += pop(in, start, waiting);
+        s.max_queue = std::max(s.max_queue, waiting);
+        total_queue += waiting;
+        ++blocks;
+
+        if(start == end_of_stream){
+            if(out){
+                s.wait_seconds += push(*out, start);
+            }
+            break;
+        }
+
+        // After a failure the blocks still in flight are only passed on, so every stage reaches the end
+        if(!failed){
+            size_t frames = std::min((size_t)block_frames, num_frames - start);
+            Clock::time_point busy_start = Clock::now();
+            try {
+                effect->processTimed(buffer.slice(start, frames));
+            } catch(...){
+                std::lock_guard<std::mutex> guard(error_lock);
+                if(!error){
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+            s.busy_seconds += secondsSince(busy_start);
+            s.frames += frames;
+        }
+
+        if(out){
+            s.wait_seconds += push(*out, start);
+        }
+    }
+
+    s.average_queue = blocks ? total_queue/blocks : 0;
+}
+
+// Blocks until an item is waiting and takes it
+// Spins briefly first, then sleeps until the stage before writes
+double EffectChain::pop(Queue &queue, size_t &item, size_t &waiting){
+    double waited = 0;
+    waiting = queue.items.readAvailable();
+    if(waiting == 0){
+        Clock::time_point wait_start = Clock::now();
+        for(int i = 0; i < spin_checks && waiting == 0; ++i){
+            waiting = queue.items.readAvailable();
+        }
+        if(waiting == 0){
+            sleep(queue, [&queue, &waiting](){
+                return (waiting = queue.items.readAvailable()) > 0;
+            });
+        }
+        waited = secondsSince(wait_start);
+    }
+
+    queue.items.read(&item, 1);
+    notify(queue);
+    return waited;
+}
+
+// Blocks until item can be pushed
+// Spins briefly first, then sleeps until the stage after reads
+double EffectChain::push(Queue &queue, size_t item){
+    double waited = 0;
+    if(queue.items.write(&item, 1) == 0){
+        Clock::time_point wait_start = Clock::now();
+        bool pushed = false;
+        for(int i = 0; i < spin_checks && !pushed; ++i){
+            pushed = queue.items.write(&item, 1) == 1;
+        }
+        if(!pushed){
+            sleep(queue, [&queue](){
+                return queue.items.writeAvailable() > 0;
+            });
+            queue.items.write(&item, 1);
+        }
+        waited = secondsSince(wait_start);
+    }
+
+    notify(queue);
+    return waited;
+}
+
+// Wakes the other end of queue, if it's asleep
+// The fence pairs with the one in sleep: either the sleeper's last check sees this read or write,
+// or this sees it sleeping. Taking the lock then orders the wake up after that last check.
+void EffectChain::notify(Queue &queue){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(queue.sleeping.load(std::memory_order_relaxed) == 0){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+    }
+    queue.changed.notify_all();
+}
+
+// Sleeps on queue until ready returns true
+// A count rather than a flag, the end that just woke may not have left yet when the other one sleeps
+template <typename Ready>
+void EffectChain::sleep(Queue &queue, Ready ready){
+    std::unique_lock<std::mutex> guard(queue.lock);
+    queue.sleeping.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    queue.changed.wait(guard, ready);
+    queue.sleeping.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Stats from the last apply
+int EffectChain::getNumStages(){
+    return (int)stages.size();
+}
+
+const EffectChain::StageStats &EffectChain::getStats(int stage){
+    if(stage < 0 || stage >= (int)stats.size()){
+        throw std::out_of_range("EffectChain Error: No such stage!");
+    }
+    return stats[stage];
+}
+
+// Frames per second the stage managed while busy
+double EffectChain::getThroughput(int stage){
+    const StageStats &s = getStats(stage);
+    return s.busy_seconds > 0 ? s.frames/s.busy_seconds : 0;
+}
@@ -0,0 +1,128 @@
+//
+//  EffectChain.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/30.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef EffectChain_hpp
+#define EffectChain_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "AudioEffect.hpp"
+#include "RingBuffer.hpp"
+
+/* EffectChain class
+ *
+ * Runs each effect of a chain on its own thread, as a pipeline
+ *
+ * The buffer is cut into blocks that are handed from stage to stage
+ * through bounded lock-free queues, so while the second effect works on
+ * block k-1 the first one is already on block k. Blocks are processed in
+ * place and in order by every stage, so the output is exactly the same as
+ * AudioEffect::apply.
+ *
+ * A stage that waits on its input queue is running faster than the one
+ * before it, and one whose input queue stays full is the bottleneck.
+ * getStats reports both for every stage after a run. Waiting stages spin
+ * for a moment and then sleep until the queue changes, so idle stages
+ * leave their cores to the busy ones. The mutex is only taken to sleep,
+ * and to wake a stage that's asleep.
+ *
+ * If an effect throws, the stages stop processing and pass the remaining
+ * blocks through so every thread finishes, then apply rethrows the first
+ * exception.
+ */
+class EffectChain {
+public:
+
+    // What one stage did during the last run
+    struct StageStats {
+        AudioEffect *effect;
+        uint64_t frames; // Frames processed
+        double busy_seconds; // Time spent inside process
+        double wait_seconds; // Time spent waiting for a block to arrive or for room to pass it on
+        double average_queue; // Blocks waiting in the input queue, averaged over every block taken
+        size_t max_queue; // Most blocks ever waiting in the input queue
+    };
+
+    // Constructor
+    // block_frames is the size of the blocks passed between stages,
+    // queue_blocks how many may wait between two stages
+    EffectChain(int block_frames = 4096, int queue_blocks = 4);
+
+    // Use every effect from chain onwards, following getNext, as a stage
+    void setEffects(AudioEffect *chain);
+
+    // Applies every stage to the whole of buffer in place
+    // Starts one thread per stage, and returns once they're all done
+    // Rethrows the first exception an effect threw, the buffer is then only partly processed
+    void apply(const AudioBufferView &buffer, int sample_rate);
+
+    // Stats from the last apply
+    int getNumStages();
+    const StageStats &getStats(int stage);
+
+    // Frames per second the stage managed while busy
+    double getThroughput(int stage);
+
+protected:
+private:
+    // Marks the end of the stream in a queue
+    static const size_t end_of_stream = (size_t)-1;
+
+    // A queue between two stages, and what its two ends sleep on while it's empty or full
+    struct Queue {
+        Queue(size_t capacity): items(capacity), sleeping(0){}
+
+        RingBuffer<size_t> items;
+        std::mutex lock;
+        std::condition_variable changed; // Signalled after a read or write while the other end sleeps
+        std::atomic<int> sleeping; // Ends waiting on changed, or about to
+    };
+
+    // Body of the thread running stage index
+    void runStage(int index);
+
+    // Blocks until an item is waiting and takes it, returns the time spent waiting
+    // waiting is set to the number of items there were
+    static double pop(Queue &queue, size_t &item, size_t &waiting);
+
+    // Blocks until item can be pushed, returns the time spent waiting
+    static double push(Queue &queue, size_t item);
+
+    // Wakes the other end of queue, if it's asleep
+    static void notify(Queue &queue);
+
+    // Sleeps on queue until ready returns true
+    template <typename Ready>
+    static void sleep(Queue &queue, Ready ready);
+
+    int block_frames;
+    int queue_blocks;
+
+    std::vector<AudioEffect *> stages;
+    std::vector<StageStats> stats;
+
+    // queues[i] feeds stage i, the last stage's blocks are done once it has processed them
+    // Each holds the start frame of blocks, or end_of_stream
+    std::vector<std::unique_ptr<Queue> > queues;
+
+    AudioBufferView buffer; // Being processed by the current apply
+
+    // The first exception a stage threw during the current apply
+    std::atomic<bool> failed;
+    std::mutex error_lock;
+    std::exception_ptr error;
+};
+
+#endif /* EffectChain_hpp */
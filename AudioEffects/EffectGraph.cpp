@@ -0,0 +1,285 @@
+//
+//  EffectGraph.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/31.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "EffectGraph.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Constructor
+EffectGraph::EffectGraph(ThreadPool *p){
+    pool = p;
+    output = 0;
+    current_level = NULL;
+
+    Node input;
+    input.type = NodeType::Input;
+    input.effect = NULL;
+    input.buffer = 0;
+    input.in_place = false;
+    nodes.push_back(input);
+}
+
+// The node holding the graph's input
+int EffectGraph::getInput(){
+    return 0;
+}
+
+// Adds a node running effect on the output of input
+int EffectGraph::addEffect(AudioEffect *effect, int input){
+    checkNode(input);
+    if(!effect){
+        throw std::invalid_argument("EffectGraph Error: Effect node needs an effect!");
+    }
+
+    // Nodes of a level run at the same time, and an effect's state belongs to one stream
+    for(size_t i = 0; i < nodes.size(); ++i){
+        if(nodes[i].type == NodeType::Effect && nodes[i].effect == effect){
+            throw std::invalid_argument("EffectGraph Error: Effect is already in the graph!");
+        }
+    }
+
+    Node node;
+    node.type = NodeType::Effect;
+    node.effect = effect;
+    node.inputs.push_back(input);
+    node.gains.push_back(1.0f);
+    node.buffer = 0;
+    node.in_place = false;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+// Adds a node summing the outputs of inputs, each scaled by its gain
+int EffectGraph::addMix(const std::vector<int> &inputs, const std::vector<float> &gains){
+    if(inputs.empty()){
+        throw std::invalid_argument("EffectGraph Error: Mix node needs at least one input!");
+    }
+    if(!gains.empty() && gains.size() != inputs.size()){
+        throw std::invalid_argument("EffectGraph Error: Mix node needs one gain per input!");
+    }
+    for(size_t i = 0; i < inputs.size(); ++i){
+        checkNode(inputs[i]);
+    }
+
+    Node node;
+    node.type = NodeType::Mix;
+    node.effect = NULL;
+    node.inputs = inputs;
+    node.gains = gains.empty() ? std::vector<float>(inputs.size(), 1.0f) : gains;
+    node.buffer = 0;
+    node.in_place = false;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+// The node whose output is the graph's output
+void EffectGraph::setOutput(int node){
+    checkNode(node);
+    output = node;
+}
+
+// Schedules the graph and allocates its buffers
+void EffectGraph::prepare(int rate, int block, int channels){
+    AudioEffect::prepare(rate, block, channels);
+    int num_nodes = (int)nodes.size();
+
+    // Only nodes the output depends on need to run
+    // Inputs always come before the node they feed, so one backwards pass finds them all
+    std::vector<bool> needed(num_nodes, false);
+    needed[output] = true;
+    for(int n = num_nodes - 1; n > 0; --n){
+        if(needed[n]){
+            for(size_t k = 0; k < nodes[n].inputs.size(); ++k){
+                needed[nodes[n].inputs[k]] = true;
+            }
+        }
+    }
+
+    // How many nodes read each output, the graph's output counts as a reader so it's never released
+    std::vector<int> readers(num_nodes, 0);
+    readers[output] = 1;
+    for(int n = 1; n < num_nodes; ++n){
+        if(needed[n]){
+            for(size_t k = 0; k < nodes[n].inputs.size(); ++k){
+                ++readers[nodes[n].inputs[k]];
+            }
+        }
+    }
+
+    // A node's level is one past the deepest of its inputs, the input is level 0
+    std::vector<int> depth(num_nodes, 0);
+    levels.clear();
+    for(int n = 1; n < num_nodes; ++n){
+        if(!needed[n]){
+            continue;
+        }
+        for(size_t k = 0; k < nodes[n].inputs.size(); ++k){
+            depth[n] = std::max(depth[n], depth[nodes[n].inputs[k]] + 1);
+        }
+        if((int)levels.size() < depth[n]){
+            levels.resize(depth[n]);
+        }
+        levels[depth[n] - 1].push_back(n);
+    }
+
+    // Hand out buffers level by level, a buffer comes back once every reader of it has run
+    int num_buffers = 0;
+    std::vector<int> free_buffers;
+    for(size_t l = 0; l < levels.size(); ++l){
+        for(size_t i = 0; i < levels[l].size(); ++i){
+            Node &node = nodes[levels[l][i]];
+
+            // The only reader of an input can just overwrite it
+            node.in_place = false;
+            for(size_t k = 0; k < node.inputs.size(); ++k){
+                if(readers[node.inputs[k]] == 1){
+                    std::swap(node.inputs[0], node.inputs[k]);
+                    std::swap(node.gains[0], node.gains[k]);
+                    node.in_place = true;
+                    break;
+                }
+            }
+
+            if(node.in_place){
+                node.buffer = nodes[node.inputs[0]].buffer;
+            } else if(!free_buffers.empty()){
+                node.buffer = free_buffers.back();
+                free_buffers.pop_back();
+            } else {
+                node.buffer = ++num_buffers;
+            }
+        }
+
+        for(size_t i = 0; i < levels[l].size(); ++i){
+            const Node &node = nodes[levels[l][i]];
+            for(size_t k = 0; k < node.inputs.size(); ++k){
+                int input = node.inputs[k];
+                bool taken = node.in_place && k == 0;
+                if(--readers[input] == 0 && !taken && nodes[input].buffer != 0){
+                    free_buffers.push_back(nodes[input].buffer);
+                }
+            }
+        }
+    }
+
+    buffers.clear();
+    buffers.resize(num_buffers);
+    for(int i = 0; i < num_buffers; ++i){
+        buffers[i].allocate(channels, block);
+    }
+    views.resize(num_buffers + 1);
+
+    for(int n = 1; n < num_nodes; ++n){
+        if(needed[n] && nodes[n].effect){
+            nodes[n].effect->prepare(rate, block, channels);
+        }
+    }
+}
+
+// Resets every effect in the graph
+void EffectGraph::reset(){
+    for(size_t n = 1; n < nodes.size(); ++n){
+        if(nodes[n].effect){
+            nodes[n].effect->reset();
+        }
+    }
+}
+
+// Runs the whole graph on buffer in place
+void EffectGraph::process(const AudioBufferView &buffer){
+    size_t num_frames = buffer.getNumFrames();
+    size_t block = max_block > 0 ? max_block : num_frames;
+
+    for(size_t start = 0; start < num_frames; start += block){
+        size_t frames = std::min(block, num_frames - start);
+        views[0] = buffer.slice(start, frames);
+        for(size_t i = 0; i < buffers.size(); ++i){
+            views[i + 1] = buffers[i].slice(0, frames);
+        }
+
+        for(size_t l = 0; l < levels.size(); ++l){
+            const std::vector<int> &level = levels[l];
+            if(pool && level.size() > 1){
+                current_level = &level;
+                pool->run(&EffectGraph::runNode, this, (int)level.size());
+            } else {
+                for(size_t i = 0; i < level.size(); ++i){
+                    run(level[i]);
+                }
+            }
+        }
+
+        if(nodes[output].buffer != 0){
+            views[0].copyFrom(views[nodes[output].buffer]);
+        }
+    }
+}
+
+// How the graph was scheduled by prepare
+int EffectGraph::getNumLevels(){
+    return (int)levels.size();
+}
+
+int EffectGraph::getNumBuffers(){
+    return (int)buffers.size();
+}
+
+// Throws if node isn't the index of an existing node
+void EffectGraph::checkNode(int node){
+    if(node < 0 || node >= (int)nodes.size()){
+        throw std::out_of_range("EffectGraph Error: No such node!");
+    }
+}
+
+// Runs node index of the current level
+void EffectGraph::runNode(void *context, int index){
+    EffectGraph *graph = static_cast<EffectGraph *>(context);
+    graph->run((*graph->current_level)[index]);
+}
+
+// Runs a single node into its buffer
+void EffectGraph::run(int n){
+    const Node &node = nodes[n];
+    const AudioBufferView &dst = views[node.buffer];
+
+    if(node.type == NodeType::Effect){
+        if(!node.in_place){
+            dst.copyFrom(views[nodes[node.inputs[0]].buffer]);
+        }
+        node.effect->processTimed(dst);
+        return;
+    }
+
+    // Mix, starting from the first input if it's already in dst
+    size_t first = 0;
+    if(node.in_place){
+        first = 1;
+        if(node.gains[0] != 1.0f){
+            for(int channel = 0; channel < dst.getNumChannels(); ++channel){
+                float *out = dst[channel];
+                for(size_t i = 0; i < dst.getNumFrames(); ++i){
+                    out[i] *= node.gains[0];
+                }
+            }
+        }
+    } else {
+        dst.clear();
+    }
+
+    for(size_t k = first; k < node.inputs.size(); ++k){
+        const AudioBufferView &src = views[nodes[node.inputs[k]].buffer];
+        float gain = node.gains[k];
+        for(int channel = 0; channel < dst.getNumChannels(); ++channel){
+            const float *in = src[channel];
+            float *out = dst[channel];
+            for(size_t i = 0; i < dst.getNumFrames(); ++i){
+                out[i] += gain*in[i];
+            }
+        }
+    }
+}
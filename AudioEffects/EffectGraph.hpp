@@ -0,0 +1,111 @@
+//
+//  EffectGraph.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/31.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef EffectGraph_hpp
+#define EffectGraph_hpp
+
+#include <stdio.h>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "AudioEffect.hpp"
+#include "ThreadPool.hpp"
+
+/* EffectGraph class
+ *
+ * Effects connected as a directed acyclic graph instead of a list
+ *
+ * Node 0 is the graph's input. Every other node is either an effect fed by
+ * one earlier node, or a mix that sums several earlier nodes with a gain
+ * each. Feeding more than one node from the same node splits the signal,
+ * for dry/wet, multiband or parallel compression patches. Since nodes can
+ * only be fed by nodes created before them, the graph can't have cycles.
+ *
+ * prepare groups the nodes into levels whose inputs are all in earlier
+ * levels, and the nodes of a level run at the same time on the pool.
+ * Each node's output lives in a shared buffer only until its last reader
+ * has run, after which the buffer is handed to a later node. A node that
+ * is the only reader of its input works on that buffer in place. Memory
+ * is bounded by how wide the graph is rather than how many nodes it has.
+ *
+ * The graph is itself an effect, so it can go anywhere a chain can.
+ * Its effects are processed on their own, their next pointers are ignored,
+ * and an effect can only be used by one node.
+ */
+class EffectGraph: public AudioEffect {
+public:
+
+    // Constructor
+    // Levels run on pool if one is given, otherwise on the calling thread
+    EffectGraph(ThreadPool *pool = NULL);
+
+    // The node holding the graph's input
+    int getInput();
+
+    // Adds a node running effect on the output of input, returns its index
+    // Each effect can only be in the graph once
+    int addEffect(AudioEffect *effect, int input);
+
+    // Adds a node summing the outputs of inputs, each scaled by its gain, returns its index
+    // gains may be empty for unity gain
+    int addMix(const std::vector<int> &inputs, const std::vector<float> &gains = std::vector<float>());
+
+    // The node whose output is the graph's output, the input until set
+    void setOutput(int node);
+
+    // Schedules the graph and allocates its buffers
+    // Nodes added afterwards need another prepare
+    void prepare(int sample_rate, int max_block, int num_channels) override;
+    void reset() override;
+
+    // Runs the whole graph on buffer in place
+    void process(const AudioBufferView &buffer) override;
+
+    // How the graph was scheduled by prepare
+    int getNumLevels();
+    int getNumBuffers(); // Not counting the buffer passed to process
+
+protected:
+private:
+    enum class NodeType {
+        Input,
+        Effect,
+        Mix
+    };
+
+    struct Node {
+        NodeType type;
+        AudioEffect *effect;
+        std::vector<int> inputs;
+        std::vector<float> gains;
+
+        // Filled in by prepare
+        int buffer; // Which buffer holds the output, 0 is the one passed to process
+        bool in_place; // The output overwrites the buffer of inputs[0]
+    };
+
+    // Throws if node isn't the index of an existing node
+    void checkNode(int node);
+
+    // Runs node index of the current level, called by the pool
+    static void runNode(void *context, int index);
+    void run(int node);
+
+    ThreadPool *pool;
+    std::vector<Node> nodes;
+    int output;
+
+    // The schedule, nodes that feed the output grouped by level
+    std::vector<std::vector<int> > levels;
+    std::vector<AudioBuffer> buffers; // buffers[i] backs buffer i + 1
+
+    // Views of every buffer for the block being processed
+    std::vector<AudioBufferView> views;
+    const std::vector<int> *current_level;
+};
+
+#endif /* EffectGraph_hpp */
@@ -0,0 +1,153 @@
+//
+//  FFT.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/4.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "FFT.hpp"
+#include <cmath>
+#include <stdexcept>
+
+// Default Constructor
+FFT::FFT(){
+    size = 0;
+    half = 0;
+}
+
+// Constructor
+FFT::FFT(int n){
+    size = 0;
+    half = 0;
+    setSize(n);
+}
+
+// Builds the plan for transforms of size real samples
+void FFT::setSize(int n){
+    if(n < 4 || (n & (n - 1)) != 0){
+        throw std::invalid_argument("FFT Error: Size must be a power of two of at least 4!");
+    }
+    if(n == size){
+        return;
+    }
+
+    size = n;
+    half = n/2;
+
+    int bits = 0;
+    while((1 << bits) < half){
+        ++bits;
+    }
+    bit_reverse.resize(half);
+    for(int i = 0; i < half; ++i){
+        int r = 0;
+        for(int b = 0; b < bits; ++b){
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bit_reverse[i] = r;
+    }
+
+    // Computed in double so the tables are as accurate as a float can hold
+    twiddle_cos.resize(half/2 > 0 ? half/2 : 1);
+    twiddle_sin.resize(twiddle_cos.size());
+    for(int k = 0; k < half/2; ++k){
+        double angle = 2*M_PI*k/half;
+        twiddle_cos[k] = (float)cos(angle);
+        twiddle_sin[k] = (float)sin(angle);
+    }
+
+    split_cos.resize(half + 1);
+    split_sin.resize(half + 1);
+    for(int k = 0; k <= half; ++k){
+        double angle = 2*M_PI*k/size;
+        split_cos[k] = (float)cos(angle);
+        split_sin[k] = (float)sin(angle);
+    }
+
+    scratch_re.resize(half);
+    scratch_im.resize(half);
+}
+
+int FFT::getSize(){
+    return size;
+}
+
+// Transforms size samples from in into size/2 + 1 bins
+//
+// The even samples go in the real part and the odd ones in the imaginary part
+// of a half size transform Z, then X[k] = E[k] + W^k O[k] with
+//     E[k] = (Z[k] + conj(Z[half - k]))/2
+//     O[k] = (Z[k] - conj(Z[half - k]))/2i
+void FFT::forward(const float *in, float *re, float *im){
+    float *zr = scratch_re.data();
+    float *zi = scratch_im.data();
+    for(int k = 0; k < half; ++k){
+        zr[bit_reverse[k]] = in[2*k];
+        zi[bit_reverse[k]] = in[2*k + 1];
+    }
+    transform(zr, zi, false);
+
+    for(int k = 0; k <= half; ++k){
+        int a = (k == half) ? 0 : k;
+        int b = (k == 0) ? 0 : half - k;
+        float er = 0.5f*(zr[a] + zr[b]);
+        float ei = 0.5f*(zi[a] - zi[b]);
+        float orr = 0.5f*(zi[a] + zi[b]);
+        float oi = -0.5f*(zr[a] - zr[b]);
+        float c = split_cos[k];
+        float s = split_sin[k];
+        re[k] = er + c*orr + s*oi;
+        im[k] = ei + c*oi - s*orr;
+    }
+}
+
+// Transforms size/2 + 1 bins back into size samples
+// Undoes the split in forward, then runs the half size transform backwards
+void FFT::inverse(const float *re, const float *im, float *out){
+    float *zr = scratch_re.data();
+    float *zi = scratch_im.data();
+    for(int k = 0; k < half; ++k){
+        int m = half - k;
+        float er = 0.5f*(re[k] + re[m]);
+        float ei = 0.5f*(im[k] - im[m]);
+        float dr = 0.5f*(re[k] - re[m]);
+        float di = 0.5f*(im[k] + im[m]);
+        float c = split_cos[k];
+        float s = split_sin[k];
+        float orr = dr*c - di*s;
+        float oi = dr*s + di*c;
+        zr[bit_reverse[k]] = er - oi;
+        zi[bit_reverse[k]] = ei + orr;
+    }
+    transform(zr, zi, true);
+
+    float scale = 1.0f/half;
+    for(int k = 0; k < half; ++k){
+        out[2*k] = zr[k]*scale;
+        out[2*k + 1] = zi[k]*scale;
+    }
+}
+
+// In place iterative radix-2 transform of half points
+void FFT::transform(float *re, float *im, bool inverse){
+    float sign = inverse ? 1.0f : -1.0f;
+    for(int length = 2; length <= half; length <<= 1){
+        int step = half/length;
+        int span = length/2;
+        for(int start = 0; start < half; start += length){
+            for(int j = 0; j < span; ++j){
+                float wr = twiddle_cos[j*step];
+                float wi = sign*twiddle_sin[j*step];
+                int a = start + j;
+                int b = a + span;
+                float vr = re[b]*wr - im[b]*wi;
+                float vi = re[b]*wi + im[b]*wr;
+                re[b] = re[a] - vr;
+                im[b] = im[a] - vi;
+                re[a] += vr;
+                im[a] += vi;
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+//
+//  FFT.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/4.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef FFT_hpp
+#define FFT_hpp
+
+#include <stdio.h>
+#include <vector>
+
+/* FFT class
+ *
+ * Real to complex fast Fourier transform of one power of two size
+ *
+ * The object is the plan: bit reversal and twiddle tables are built once
+ * by setSize, after which transforms don't allocate. A real transform of
+ * size N is done as a complex transform of size N/2 plus a pass that
+ * splits the even and odd halves back apart.
+ *
+ * Spectra are kept as separate real and imaginary arrays of N/2 + 1 bins.
+ * Transforms use scratch space inside the object, so each thread needs
+ * its own FFT.
+ */
+class FFT {
+public:
+
+    // Default Constructor
+    FFT();
+
+    // Constructor
+    // Builds the plan for size
+    explicit FFT(int size);
+
+    // Builds the plan for transforms of size real samples, a power of two of at least 4
+    void setSize(int size);
+    int getSize();
+
+    // Transforms size samples from in into size/2 + 1 bins of re and im
+    void forward(const float *in, float *re, float *im);
+
+    // Transforms size/2 + 1 bins back into size samples of out
+    // Scaled so inverse(forward(x)) gives x back
+    void inverse(const float *re, const float *im, float *out);
+
+protected:
+private:
+    // In place complex transform of half points, input in bit reversed order
+    void transform(float *re, float *im, bool inverse);
+
+    int size;
+    int half;
+
+    std::vector<int> bit_reverse;
+    std::vector<float> twiddle_cos; // e^(-2 pi i k/half) for the complex transform
+    std::vector<float> twiddle_sin;
+    std::vector<float> split_cos; // e^(-2 pi i k/size) for splitting the halves
+    std::vector<float> split_sin;
+
+    std::vector<float> scratch_re;
+    std::vector<float> scratch_im;
+};
+
+#endif /* FFT_hpp */
@@ -0,0 +1,41 @@
+//
+//  Gain.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/1.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "Gain.hpp"
+#include <cmath>
+
+// Constructor
+Gain::Gain(float g){
+    gain = g;
+}
+
+void Gain::setGain(float g){
+    gain = g;
+}
+
+// Sets the gain in decibels, 0 dB is unity
+void Gain::setGainDecibels(float db){
+    gain = powf(10.0f, db/20.0f);
+}
+
+float Gain::getGain(){
+    return gain;
+}
+
+// No state to clear
+void Gain::reset(){
+}
+
+// Every sample is independent
+bool Gain::supportsChannelParallel(){
+    return true;
+}
+
+bool Gain::supportsInterleaved(){
+    return true;
+}
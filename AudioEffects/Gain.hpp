@@ -0,0 +1,63 @@
+//
+//  Gain.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/1.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef Gain_hpp
+#define Gain_hpp
+
+#include <stdio.h>
+#include "AudioEffect.hpp"
+
+/* Gain class
+ *
+ * Scales every sample by a constant factor
+ *
+ * The per sample loops are defined here rather than in the .cpp so a
+ * StaticChain can inline them instead of calling out for every piece.
+ */
+class Gain final: public AudioEffect {
+public:
+
+    // Constructor
+    // gain is a linear factor, 1 leaves the signal alone
+    Gain(float gain = 1.0f);
+
+    void setGain(float gain);
+    void setGainDecibels(float db);
+    float getGain();
+
+    void reset() override;
+
+    void process(const AudioBufferView &buffer) override {
+        processChannels(buffer, 0, buffer.getNumChannels());
+    }
+
+    bool supportsChannelParallel() override;
+    void processChannels(const AudioBufferView &buffer, int first, int count) override {
+        size_t num_frames = buffer.getNumFrames();
+        for(int channel = first; channel < first + count; ++channel){
+            float *samples = buffer[channel];
+            for(size_t i = 0; i < num_frames; ++i){
+                samples[i] *= gain;
+            }
+        }
+    }
+
+    bool supportsInterleaved() override;
+    void processInterleaved(float *buffer, int num_frames) override {
+        size_t count = (size_t)num_frames*num_channels;
+        for(size_t i = 0; i < count; ++i){
+            buffer[i] *= gain;
+        }
+    }
+
+protected:
+private:
+    float gain;
+};
+
+#endif /* Gain_hpp */
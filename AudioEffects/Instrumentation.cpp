@@ -0,0 +1,252 @@
+//
+//  Instrumentation.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/7.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "Instrumentation.hpp"
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <typeinfo>
+#include "AudioEffect.hpp"
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+std::atomic<bool> Instrumentation::enabled(false);
+
+// Bytes and ticks of one direction of wav conversion
+struct Throughput {
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> ticks;
+};
+
+// The process wide counters
+static std::atomic<double> ticks_per_second(0.0);
+static Throughput decode_counters;
+static Throughput encode_counters;
+static std::atomic<uint64_t> callbacks(0);
+static std::atomic<uint64_t> underruns(0);
+static std::atomic<uint64_t> histogram[Instrumentation::histogram_buckets];
+
+// Default Constructor
+EffectCounters::EffectCounters(){
+    reset();
+}
+
+// Copies take the counts as they are at that moment
+EffectCounters::EffectCounters(const EffectCounters &other){
+    *this = other;
+}
+
+EffectCounters &EffectCounters::operator=(const EffectCounters &other){
+    blocks.store(other.blocks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    frames.store(other.frames.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    ticks.store(other.ticks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    max_ticks.store(other.max_ticks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+}
+
+// Adds one block of frames that took t ticks
+// There's only one writer, so plain loads and stores are enough and no locked instructions are needed
+void EffectCounters::record(size_t n, uint64_t t){
+    blocks.store(blocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    frames.store(frames.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    ticks.store(ticks.load(std::memory_order_relaxed) + t, std::memory_order_relaxed);
+    if(t > max_ticks.load(std::memory_order_relaxed)){
+        max_ticks.store(t, std::memory_order_relaxed);
+    }
+}
+
+void EffectCounters::reset(){
+    blocks.store(0, std::memory_order_relaxed);
+    frames.store(0, std::memory_order_relaxed);
+    ticks.store(0, std::memory_order_relaxed);
+    max_ticks.store(0, std::memory_order_relaxed);
+}
+
+// Getters
+uint64_t EffectCounters::getBlocks(){
+    return blocks.load(std::memory_order_relaxed);
+}
+
+uint64_t EffectCounters::getFrames(){
+    return frames.load(std::memory_order_relaxed);
+}
+
+uint64_t EffectCounters::getTicks(){
+    return ticks.load(std::memory_order_relaxed);
+}
+
+uint64_t EffectCounters::getMaxTicks(){
+    return max_ticks.load(std::memory_order_relaxed);
+}
+
+// Turns recording on or off
+// The clock is calibrated here so the audio thread never has to
+void Instrumentation::setEnabled(bool on){
+#if AUDIOEFFECTS_INSTRUMENTATION
+    if(on){
+        getTicksPerSecond();
+    }
+    enabled.store(on, std::memory_order_relaxed);
+#endif
+}
+
+// How many ticks now advances per second, measured once against the steady clock
+double Instrumentation::getTicksPerSecond(){
+    double tps = ticks_per_second.load(std::memory_order_relaxed);
+    if(tps > 0){
+        return tps;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t end_ticks = now();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    tps = (end_ticks - start_ticks)/seconds;
+#else
+    tps = 1e9;
+#endif
+
+    ticks_per_second.store(tps, std::memory_order_relaxed);
+    return tps;
+}
+
+// An audio callback took ticks to fill a buffer of buffer_seconds of audio
+void Instrumentation::recordCallback(uint64_t ticks, double buffer_seconds){
+    double tps = ticks_per_second.load(std::memory_order_relaxed);
+    if(tps <= 0 || buffer_seconds <= 0){
+        return;
+    }
+    int bucket = (int)(ticks/tps/buffer_seconds*(histogram_buckets - 1));
+    if(bucket > histogram_buckets - 1){
+        bucket = histogram_buckets - 1;
+    }
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The callback ran out of audio before the end of the stream
+void Instrumentation::recordUnderrun(){
+    underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+// bytes of wav data were decoded or encoded in ticks
+void Instrumentation::recordDecode(size_t bytes, uint64_t ticks){
+    decode_counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    decode_counters.ticks.fetch_add(ticks, std::memory_order_relaxed);
+}
+
+void Instrumentation::recordEncode(size_t bytes, uint64_t ticks){
+    encode_counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    encode_counters.ticks.fetch_add(ticks, std::memory_order_relaxed);
+}
+
+// Readable class name of an effect
+static std::string effectName(AudioEffect *effect){
+    const char *mangled = typeid(*effect).name();
+#ifdef __GNUC__
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+    if(demangled){
+        std::string name = demangled;
+        free(demangled);
+        return name;
+    }
+#endif
+    return mangled;
+}
+
+// Escapes the characters JSON doesn't allow in strings
+static std::string jsonString(const std::string &s){
+    std::string out = "\"";
+    for(size_t i = 0; i < s.size(); ++i){
+        if(s[i] == '"' || s[i] == '\\'){
+            out += '\\';
+        }
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+static void writeThroughput(std::stringstream &s, Throughput &t, double tps){
+    uint64_t bytes = t.bytes.load(std::memory_order_relaxed);
+    double seconds = t.ticks.load(std::memory_order_relaxed)/tps;
+    s << "{\"bytes\": " << bytes << ", \"seconds\": " << seconds;
+    s << ", \"bytes_per_second\": " << (seconds > 0 ? bytes/seconds : 0) << "}";
+}
+
+// Everything recorded so far as a JSON object
+std::string Instrumentation::snapshot(AudioEffect *chain){
+    double tps = getTicksPerSecond();
+    std::stringstream s;
+    s << std::setprecision(9);
+
+    s << "{\"enabled\": " << (isEnabled() ? "true" : "false");
+    s << ", \"ticks_per_second\": " << tps;
+
+    s << ", \"decode\": ";
+    writeThroughput(s, decode_counters, tps);
+    s << ", \"encode\": ";
+    writeThroughput(s, encode_counters, tps);
+
+    s << ", \"callbacks\": {\"count\": " << callbacks.load(std::memory_order_relaxed);
+    s << ", \"deadline_misses\": " << histogram[histogram_buckets - 1].load(std::memory_order_relaxed);
+    s << ", \"underruns\": " << underruns.load(std::memory_order_relaxed);
+    s << ", \"fill_time_histogram\": [";
+    for(int i = 0; i < histogram_buckets; ++i){
+        // Fractions of the buffer duration, the last bucket has no upper end
+        s << (i ? ", " : "") << "{\"from\": " << i*0.1 << ", \"to\": ";
+        if(i == histogram_buckets - 1){
+            s << "null";
+        } else {
+            s << (i + 1)*0.1;
+        }
+        s << ", \"count\": " << histogram[i].load(std::memory_order_relaxed) << "}";
+    }
+    s << "]}";
+
+    s << ", \"effects\": [";
+    for(AudioEffect *ae = chain; ae; ae = ae->getNext()){
+        EffectCounters &c = ae->getCounters();
+        uint64_t blocks = c.getBlocks();
+        uint64_t frames = c.getFrames();
+        uint64_t ticks = c.getTicks();
+        double seconds = ticks/tps;
+        double audio_seconds = ae->getSampleRate() ? (double)frames/ae->getSampleRate() : 0;
+
+        s << (ae == chain ? "" : ", ") << "{\"name\": " << jsonString(effectName(ae));
+        s << ", \"blocks\": " << blocks << ", \"frames\": " << frames;
+        s << ", \"ticks\": " << ticks << ", \"max_block_ticks\": " << c.getMaxTicks();
+        s << ", \"ticks_per_block\": " << (blocks ? (double)ticks/blocks : 0);
+        s << ", \"ticks_per_frame\": " << (frames ? (double)ticks/frames : 0);
+        s << ", \"seconds\": " << seconds;
+        s << ", \"realtime_factor\": " << (seconds > 0 ? audio_seconds/seconds : 0) << "}";
+    }
+    s << "]}";
+    return s.str();
+}
+
+// Clears the process wide counters, and the counters of every effect of chain
+void Instrumentation::reset(AudioEffect *chain){
+    decode_counters.bytes = 0;
+    decode_counters.ticks = 0;
+    encode_counters.bytes = 0;
+    encode_counters.ticks = 0;
+    callbacks = 0;
+    underruns = 0;
+    for(int i = 0; i < histogram_buckets; ++i){
+        histogram[i] = 0;
+    }
+    for(AudioEffect *ae = chain; ae; ae = ae->getNext()){
+        ae->getCounters().reset();
+    }
+}
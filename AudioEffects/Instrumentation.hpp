@@ -0,0 +1,128 @@
+//
+//  Instrumentation.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/7.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef Instrumentation_hpp
+#define Instrumentation_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Builds without any instrumentation when defined to 0, every check below
+// is then a constant false and the timing code is compiled out
+#ifndef AUDIOEFFECTS_INSTRUMENTATION
+#define AUDIOEFFECTS_INSTRUMENTATION 1
+#endif
+
+class AudioEffect;
+
+/* EffectCounters class
+ *
+ * How long one effect has spent processing, kept by the effect itself
+ *
+ * Only the thread processing the effect writes to it, anyone can read it.
+ */
+class EffectCounters {
+public:
+
+    // Default Constructor
+    EffectCounters();
+
+    // Copies take the counts as they are at that moment
+    EffectCounters(const EffectCounters &other);
+    EffectCounters &operator=(const EffectCounters &other);
+
+    // Adds one block of frames that took ticks
+    void record(size_t frames, uint64_t ticks);
+    void reset();
+
+    // Getters
+    uint64_t getBlocks();
+    uint64_t getFrames();
+    uint64_t getTicks(); // Total, in Instrumentation::now ticks
+    uint64_t getMaxTicks(); // Of the slowest block
+
+protected:
+private:
+    std::atomic<uint64_t> blocks;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> ticks;
+    std::atomic<uint64_t> max_ticks;
+};
+
+/* Instrumentation class
+ *
+ * Process wide counters for finding where the time goes
+ *
+ * Collects per effect timing per block (see AudioEffect::processTimed),
+ * how much of each audio callback's buffer duration it took to fill, with
+ * underruns, and the throughput of decoding and encoding wav files.
+ *
+ * Off until setEnabled(true), when it costs one relaxed load per block.
+ * Timing uses the CPU's cycle counter where there is one.
+ */
+class Instrumentation {
+public:
+
+    // True when counters should be recorded
+    static bool isEnabled(){
+#if AUDIOEFFECTS_INSTRUMENTATION
+        return enabled.load(std::memory_order_relaxed);
+#else
+        return false;
+#endif
+    }
+
+    // Turns recording on or off, has no effect when compiled out
+    static void setEnabled(bool on);
+
+    // Current time in ticks, CPU cycles on x86 and nanoseconds elsewhere
+    static uint64_t now(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // How many ticks now advances per second, measured once
+    static double getTicksPerSecond();
+
+    // An audio callback took ticks to fill a buffer of buffer_seconds of audio
+    static void recordCallback(uint64_t ticks, double buffer_seconds);
+
+    // The callback ran out of audio before the end of the stream
+    static void recordUnderrun();
+
+    // bytes of wav data were decoded or encoded in ticks
+    static void recordDecode(size_t bytes, uint64_t ticks);
+    static void recordEncode(size_t bytes, uint64_t ticks);
+
+    // Everything recorded so far as a JSON object, including every effect of chain (which may be NULL)
+    static std::string snapshot(AudioEffect *chain = NULL);
+
+    // Clears the process wide counters, and the counters of every effect of chain (which may be NULL)
+    static void reset(AudioEffect *chain = NULL);
+
+    // Callback fill times are counted in buckets of a tenth of the buffer duration,
+    // the last bucket being the callbacks that missed their deadline
+    static const int histogram_buckets = 11;
+
+protected:
+private:
+    static std::atomic<bool> enabled;
+};
+
+#endif /* Instrumentation_hpp */
@@ -0,0 +1,56 @@
+//
+//  LinearRecursiveEffect.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/2.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef LinearRecursiveEffect_hpp
+#define LinearRecursiveEffect_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include "AudioEffect.hpp"
+
+/* LinearRecursiveEffect Interface (Abstract class)
+ *
+ * An effect that is a first order linear recurrence on every channel,
+ *     y[n] = a[n]*y[n-1] + b[n]
+ * which lets SegmentParallelExecutor split one long stream into segments
+ * that are processed at the same time
+ *
+ * The stream is cut into segments up front with beginSegment, then each
+ * segment's coefficients are asked for with coefficients, possibly on
+ * several threads at once and possibly more than once. a may only depend
+ * on the position in the stream, not on the input, since the second pass
+ * over a segment asks for it again after the input has been overwritten.
+ */
+class LinearRecursiveEffect: public AudioEffect {
+public:
+
+    // Marks the next num_frames frames of the stream as segment index
+    // Called in order on one thread, it should remember where the segment
+    // starts and move the effect's own state past it
+    virtual void beginSegment(int index, size_t num_frames) = 0;
+
+    // Fills a and b for the input.getNumFrames() frames starting offset frames into segment index
+    //
+    // offset 0 starts over from the start of the segment, after that offsets follow on
+    // from the previous call for the same segment. Calls for different segments may
+    // run at the same time.
+    virtual void coefficients(int index, size_t offset, const AudioBufferView &input,
+                              const AudioBufferView &a, const AudioBufferView &b) = 0;
+
+    // y[n-1] of channel before the first segment
+    virtual float getOutputState(int channel) = 0;
+
+    // Called once every segment is finished with y of the last frame of each channel,
+    // so the effect can carry on from the end of the last segment
+    virtual void endSegments(const float *last_outputs) = 0;
+
+protected:
+private:
+};
+
+#endif /* LinearRecursiveEffect_hpp */
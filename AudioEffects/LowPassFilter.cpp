@@ -10,38 +10,280 @@
 #include <cmath>
 #include "LowPassFilter.hpp"
 #include <algorithm>
-#include <iostream>
+#include <climits>
+#include <cstring>
+
+// Highest filter parameter the sweep goes to, at 1 or above the filter stops decaying and blows up
+static const float max_sweep = 0.9999f;
 
-LowPassFilter::LowPassFilter(){
-    min_param = 0.0f;
-    max_param = 0.95f;
-    auto_period = 5.0f;
-    next = NULL;
+LowPassFilter::LowPassFilter(): automation(num_parameters){
+    automation.jump(SweepMin, 0.0f);
+    automation.jump(SweepMax, 0.95f);
+    automation.jump(SweepPeriod, 5.0f);
+    
+    // Long enough to take the click out of a jump, short enough to still feel immediate
+    automation.setSmoothing(256);
+    started = false;
+    first_block = false;
+    sweep_pending = false;
 }
 
 LowPassFilter::~LowPassFilter(){
     // Nothing to dealloc
 }
 
-float LowPassFilter::tri_lfo_next(int sample_rate){
-    int period_in_samples = roundf(auto_period*sample_rate);
-    int half_period = period_in_samples/2;
-    float param = ((max_param - min_param)/half_period) * (half_period - abs(cur_sample % (2*half_period) - half_period)) + min_param;
-    ++cur_sample;
-    return param;
+// Number of samples between evaluations of the filter parameter
+void LowPassFilter::setControlInterval(int interval){
+    param.setInterval(interval);
+}
+
+// Moves parameter to value over ramp_seconds, from the next block on
+bool LowPassFilter::setParameter(int parameter, float value, float ramp_seconds){
+    return automation.set(parameter, value, (uint32_t)std::max(0.0f, roundf(ramp_seconds*sample_rate)));
+}
+
+ParameterAutomation &LowPassFilter::getAutomation(){
+    return automation;
+}
+
+// The sweep the current parameter values ask for
+// Values can be posted from anywhere, so they're clamped to what keeps the filter stable,
+// NaN included, and the period to at least a sample
+LowPassFilter::SweepChange LowPassFilter::getSweep(size_t offset){
+    SweepChange sweep;
+    sweep.offset = offset;
+    sweep.min_value = std::min(std::max(0.0f, automation.getValue(SweepMin)), max_sweep);
+    sweep.max_value = std::min(std::max(0.0f, automation.getValue(SweepMax)), max_sweep);
+    sweep.period = std::max(1.0f, roundf(automation.getValue(SweepPeriod)*sample_rate));
+    return sweep;
 }
 
-float ** LowPassFilter::apply(float **in_buffer, int num_samples, int num_channels, int sample_rate){
+// Points lfo at sweep
+void LowPassFilter::applySweep(TriangleLFO &lfo, const SweepChange &sweep){
+    lfo.setRange(sweep.min_value, sweep.max_value);
+    lfo.setPeriod(sweep.period);
+}
+
+// Moves the sweep forward num_frames, following the automation at every control period
+// While the parameters move, the frames are taken a control period at a time and the sweep is
+// updated right where param asks lfo for its next value, so it only depends on the stream position
+void LowPassFilter::advanceSweep(float *out, size_t num_frames, std::vector<SweepChange> *changes){
+    automation.update();
+    
+    size_t done = 0;
+    while(done < num_frames){
+        size_t n = num_frames - done;
+        if(sweep_pending || automation.isChanging((int)std::min(n, (size_t)INT_MAX))){
+            int left = param.getFramesToNextPeriod();
+            if(left == 0){
+                if(sweep_pending){
+                    SweepChange sweep = getSweep(done);
+                    applySweep(lfo, sweep);
+                    if(changes){
+                        changes->push_back(sweep);
+                    }
+                    sweep_pending = false;
+                }
+                left = param.getInterval();
+            }
+            n = std::min(n, (size_t)left);
+            if(automation.isChanging((int)n)){
+                sweep_pending = true;
+            }
+        }
+        
+        if(out){
+            param.render(lfo, out + done, (int)n);
+        } else {
+            param.skip(lfo, n);
+        }
+        automation.advance((int)n);
+        done += n;
+    }
+}
+
+void LowPassFilter::prepare(int rate, int block, int channels){
+    AudioEffect::prepare(rate, block, channels);
+    
+    params.resize(block > 0 ? block : 1);
+    last_output.assign(channels, 0.0f);
+    reset();
+}
+
+void LowPassFilter::reset(){
+    automation.reset();
+    lfo.reset();
+    applySweep(lfo, getSweep(0));
+    sweep_pending = false;
+    param.reset(lfo);
+    std::fill(last_output.begin(), last_output.end(), 0.0f);
+    started = false;
+    first_block = false;
+}
+
+// Filters the next block of every channel in place
+void LowPassFilter::process(const AudioBufferView &buffer){
+    size_t num_frames = buffer.getNumFrames();
+    size_t capacity = params.size();
+    
+    for(size_t start = 0; start < num_frames; start += capacity){
+        AudioBufferView block = buffer.slice(start, std::min(capacity, num_frames - start));
+        beginBlock((int)block.getNumFrames());
+        processChannels(block, 0, num_channels);
+    }
+}
+
+// Channels only share the sweep, which beginBlock renders up front
+bool LowPassFilter::supportsChannelParallel(){
+    return true;
+}
+
+// Renders the sweep for the next num_frames frames, every channel follows the same one
+void LowPassFilter::beginBlock(int num_frames){
+    // The very first sample has nothing before it, so it passes through
+    first_block = !started && num_frames > 0;
+    if(first_block){
+        started = true;
+        automation.advance(1);
+    }
+    
+    int filtered = num_frames - (first_block ? 1 : 0);
+    if((size_t)filtered > params.size()){
+        params.resize(filtered);
+    }
+    advanceSweep(params.data(), filtered, NULL);
+}
+
+// Filters channels [first, first + count) of the block given to beginBlock
+void LowPassFilter::processChannels(const AudioBufferView &buffer, int first, int count){
+    size_t num_frames = buffer.getNumFrames();
+    size_t start = first_block ? 1 : 0;
+    
+    for(int channel = first; channel < first + count; ++channel){
+        float *block = buffer[channel];
+        float y = first_block ? block[0] : last_output[channel];
+        
+        // Simple in place Auto Recursive filtering algorithm
+        // y_n = (1-b)*x_n + b*y_{n-1}, rearranged to a single multiply-add
+        for(size_t sample = start; sample < num_frames; ++sample){
+            y = block[sample] + params[sample - start]*(y - block[sample]);
+            block[sample] = y;
+        }
+        last_output[channel] = y;
+    }
+}
+
+// Remembers where the sweep is, then moves it past the segment
+void LowPassFilter::beginSegment(int index, size_t num_frames){
+    if((int)segments.size() <= index){
+        segments.resize(index + 1);
+    }
+    Segment &segment = segments[index];
+    
+    // Segments are rendered independently later, so each one keeps the sweep it starts with
+    // and every change the automation makes to it along the way
+    segment.start_lfo = lfo;
+    segment.start_param = param;
+    segment.changes.clear();
+    segment.first_sample = !started && num_frames > 0;
+    
+    if(segment.first_sample){
+        started = true;
+        automation.advance(1);
+        --num_frames;
+    }
+    advanceSweep(NULL, num_frames, &segment.changes);
+}
+
+// a is the sweep and b the scaled input, the first sample of the stream passes through with a = 0
+void LowPassFilter::coefficients(int index, size_t offset, const AudioBufferView &input,
+                                 const AudioBufferView &a, const AudioBufferView &b){
+    Segment &segment = segments[index];
+    if(offset == 0){
+        segment.lfo = segment.start_lfo;
+        segment.param = segment.start_param;
+        segment.next_change = 0;
+        segment.position = 0;
+    }
+    
+    int num_frames = (int)input.getNumFrames();
+    float *p = a[0];
+    int start = 0;
+    if(offset == 0 && segment.first_sample && num_frames > 0){
+        p[0] = 0.0f;
+        start = 1;
+    }
+    
+    // Replays the automation exactly where beginSegment met it
+    while(start < num_frames){
+        const std::vector<SweepChange> &changes = segment.changes;
+        while(segment.next_change < changes.size() && changes[segment.next_change].offset == segment.position){
+            applySweep(segment.lfo, changes[segment.next_change++]);
+        }
+        int n = num_frames - start;
+        if(segment.next_change < changes.size()){
+            n = (int)std::min((size_t)n, changes[segment.next_change].offset - segment.position);
+        }
+        segment.param.render(segment.lfo, p + start, n);
+        segment.position += n;
+        start += n;
+    }
+    
     for(int channel = 0; channel < num_channels; ++channel){
-        cur_sample = 0;
-        for(int sample = 1; sample < num_samples; ++sample){
-            float param = tri_lfo_next(sample_rate);
-            
-            // Simple in place Auto Recursive filtering algorithm
-            // y_n = (1-b)*x_n + b*y_{n-1}
-            in_buffer[channel][sample] = (1-param)*in_buffer[channel][sample] + param*in_buffer[channel][sample-1];
+        if(channel > 0){
+            memcpy(a[channel], p, num_frames*sizeof(float));
+        }
+        const float *x = input[channel];
+        float *bc = b[channel];
+        for(int i = 0; i < num_frames; ++i){
+            bc[i] = (1.0f - p[i])*x[i];
         }
     }
+}
+
+float LowPassFilter::getOutputState(int channel){
+    return last_output[channel];
+}
+
+// Carries on from the end of the last segment, the sweep is already there
+void LowPassFilter::endSegments(const float *last_outputs){
+    for(int channel = 0; channel < num_channels; ++channel){
+        last_output[channel] = last_outputs[channel];
+    }
+}
+
+// The interleaved path runs the same recurrence, so it's bit identical to process
+bool LowPassFilter::supportsInterleaved(){
+    return true;
+}
+
+// Filters the next num_frames interleaved frames in place
+void LowPassFilter::processInterleaved(float *buffer, int num_frames){
+    int start = 0;
+    
+    if(!started && num_frames > 0){
+        for(int channel = 0; channel < num_channels; ++channel){
+            last_output[channel] = buffer[channel];
+        }
+        started = true;
+        automation.advance(1);
+        start = 1;
+    }
     
-    return (next ? next->apply(in_buffer, num_samples, num_channels, sample_rate) : in_buffer);
-}
\ No newline at end of file
+    int capacity = (int)params.size();
+    float *y = last_output.data();
+    while(start < num_frames){
+        int n = std::min(capacity, num_frames - start);
+        advanceSweep(params.data(), n, NULL);
+        
+        float *frame = buffer + (size_t)start*num_channels;
+        for(int sample = 0; sample < n; ++sample, frame += num_channels){
+            float p = params[sample];
+            for(int channel = 0; channel < num_channels; ++channel){
+                y[channel] = frame[channel] + p*(y[channel] - frame[channel]);
+                frame[channel] = y[channel];
+            }
+        }
+        start += n;
+    }
+}
@@ -10,11 +10,22 @@
 #define LowPassFilter_hpp
 
 #include <stdio.h>
-#include "AudioEffect.hpp"
+#include <vector>
+#include "ControlParameter.hpp"
+#include "LinearRecursiveEffect.hpp"
+#include "ParameterAutomation.hpp"
 
-class LowPassFilter: public AudioEffect {
+class LowPassFilter: public LinearRecursiveEffect {
 public:
     
+    // Parameters that can be changed while the filter is running
+    enum {
+        SweepMin, // Filter parameter at the bottom of the sweep, 0 lets everything through
+        SweepMax, // Filter parameter at the top of the sweep, towards 1 filters harder, kept below 1
+        SweepPeriod, // Seconds per sweep, at least a sample
+        num_parameters
+    };
+    
     // Default constructor
     LowPassFilter();
     
@@ -26,23 +37,86 @@ public:
     // Deallocates any allocated memory
     ~LowPassFilter();
     
+    void prepare(int sample_rate, int max_block, int num_channels) override;
+    void reset() override;
+    
+    // Filters the next block of every channel in place
+    void process(const AudioBufferView &buffer) override;
+    
+    // Channels only share the sweep, so they can be filtered in parallel
+    bool supportsChannelParallel() override;
+    void beginBlock(int num_frames) override;
+    void processChannels(const AudioBufferView &buffer, int first, int count) override;
+    
+    // Same filter, straight on interleaved frames
+    bool supportsInterleaved() override;
+    void processInterleaved(float *buffer, int num_frames) override;
+    
+    // The filter as y_n = p_n*y_{n-1} + (1-p_n)*x_n, for SegmentParallelExecutor
+    void beginSegment(int index, size_t num_frames) override;
+    void coefficients(int index, size_t offset, const AudioBufferView &input,
+                      const AudioBufferView &a, const AudioBufferView &b) override;
+    float getOutputState(int channel) override;
+    void endSegments(const float *last_outputs) override;
+    
+    // Number of samples between evaluations of the filter parameter, from the next evaluation on
+    void setControlInterval(int interval);
+    
+    // Moves parameter to value over ramp_seconds, from the next block on
+    // Safe from any thread while the filter is running, returns false if the change was dropped
+    bool setParameter(int parameter, float value, float ramp_seconds = 0.0f);
     
-    // Applies this audio effect to the sample in in_buffer, then
-    // calls apply on the next effect in the chain (if it exists);
-    //
-    // in_buffer must have num_channels sub_buffers, each with room for num_samples floats
-    //
-    // returns the result once it goes through all the audio effects
-    float **apply(float **in_buffer, int num_samples, int num_channels, int sample_rate) override;
+    // The parameters, for scheduling changes at exact frames
+    // The sweep picks them up at the start of every control period, the only time it's read,
+    // and the filter parameter is interpolated in between. Periods are counted from the start
+    // of the stream, so how it's cut into blocks or segments makes no difference.
+    ParameterAutomation &getAutomation();
     
 protected:
 private:
     
-    float tri_lfo_next(int sample_rate);
-    float min_param;
-    float max_param;
-    float auto_period;
-    int cur_sample;
+    // The sweep as set by the parameters at one point in the stream
+    struct SweepChange {
+        size_t offset; // Sweep frames into the segment
+        float min_value;
+        float max_value;
+        float period; // In samples
+    };
+    
+    // The sweep the current parameter values ask for
+    SweepChange getSweep(size_t offset);
+    
+    // Points lfo at sweep
+    static void applySweep(TriangleLFO &lfo, const SweepChange &sweep);
+    
+    // Moves the sweep forward num_frames, following the automation at every control period
+    // Renders the filter parameter into out unless it's NULL, and records every change to
+    // the sweep in changes unless that's NULL
+    void advanceSweep(float *out, size_t num_frames, std::vector<SweepChange> *changes);
+    
+    ParameterAutomation automation;
+    bool sweep_pending; // The parameters have moved since they were last given to lfo
+    
+    TriangleLFO lfo; // Sweeps the filter parameter between min_param and max_param
+    ControlParameter param; // Evaluates lfo at the control rate
+    std::vector<float> params; // Per sample parameter values for the current block
+    
+    std::vector<float> last_output; // y_{n-1} for each channel
+    bool started; // False until the first sample of the stream has been seen
+    bool first_block; // The current block starts with the first sample of the stream
+    
+    // Where the sweep was at the start of a segment, and where it has got to since
+    struct Segment {
+        TriangleLFO start_lfo;
+        ControlParameter start_param;
+        TriangleLFO lfo;
+        ControlParameter param;
+        bool first_sample; // The segment starts with the first sample of the stream
+        std::vector<SweepChange> changes; // Made by the automation during the segment, in order
+        size_t next_change; // First change not yet given to lfo
+        size_t position; // Sweep frames rendered so far
+    };
+    std::vector<Segment> segments;
 };
 
 #endif /* LowPassFilter_hpp */
@@ -0,0 +1,223 @@
+//
+//  MappedWavFile.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/21.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "MappedWavFile.hpp"
+#include "Instrumentation.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Sets/Resets all fields to zero
+void MappedWavFile::init(){
+    memset(&info, 0, sizeof(info));
+    map = NULL;
+    map_size = 0;
+    data = NULL;
+    data_size = 0;
+    container = WavContainer::Riff;
+    num_samples = 0;
+    packed = false;
+}
+
+// Default Constructor
+MappedWavFile::MappedWavFile(){
+    init();
+}
+
+// Constructor
+// Maps the specified wav file
+MappedWavFile::MappedWavFile(std::string path){
+    init();
+    open(path);
+}
+
+// Destructor
+// Unmaps the file
+MappedWavFile::~MappedWavFile(){
+    close();
+}
+
+// Unmap the current file
+void MappedWavFile::close(){
+    if(map){
+        munmap(map, map_size);
+    }
+    init();
+}
+
+// Map a new wav file
+// Unmaps the old file if necessary
+void MappedWavFile::open(std::string path){
+    close();
+
+    unsigned long i = path.rfind('/');
+    filename = (i != std::string::npos) ? path.substr(i+1) : path;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        throw std::runtime_error("MappedWavFile Error: Could not open file\n");
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 12){
+        ::close(fd);
+        throw std::runtime_error("MappedWavFile Error: Not a Wave File!");
+    }
+
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if(m == MAP_FAILED){
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        throw std::runtime_error("MappedWavFile Error: Could not map file\n");
+    }
+    map = (unsigned char *)m;
+    map_size = (size_t)st.st_size;
+
+    try {
+        parseHeader();
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+// Copies size bytes at offset of the MappedWavFile context, for parseWavLayout
+size_t MappedWavFile::readMapping(void *context, uint64_t offset, void *out, size_t size){
+    MappedWavFile *file = static_cast<MappedWavFile *>(context);
+    if(offset >= file->map_size){
+        return 0;
+    }
+    size = (size_t)std::min<uint64_t>(size, file->map_size - offset);
+    memcpy(out, file->map + offset, size);
+    return size;
+}
+
+// Walks the chunks inside the mapping until the data chunk is found
+void MappedWavFile::parseHeader(){
+    WavLayout layout;
+    parseWavLayout(readMapping, this, map_size, layout);
+    info = layout.info;
+    if(!isDecodable(info)){
+        throw std::runtime_error("MappedWavFile Error: Unsupported sample format!");
+    }
+    container = layout.container;
+    data = map + layout.data_offset;
+    data_size = (size_t)layout.data_size;
+    num_samples = layout.data_size/info.block_align;
+
+    // Pick the conversion kernel once for the whole file
+    decoder = selectDecoder(info);
+    packed = (info.block_align == info.num_channels*decoder.bytes_per_sample);
+}
+
+// Decodes frames [start, start + out.getNumFrames()) into out
+size_t MappedWavFile::decode(const AudioBufferView &out, uint64_t start){
+    if(!map){
+        throw std::runtime_error("MappedWavFile Error: No file open!");
+    }
+    if(out.getNumChannels() != info.num_channels){
+        throw std::invalid_argument("MappedWavFile Error: Buffer has the wrong number of channels!");
+    }
+    if(start >= num_samples){
+        return 0;
+    }
+    size_t frames = (size_t)std::min<uint64_t>(out.getNumFrames(), num_samples - start);
+
+    bool timed = Instrumentation::isEnabled();
+    uint64_t begin = timed ? Instrumentation::now() : 0;
+
+    const unsigned char *src = data + (size_t)start*info.block_align;
+    if(!packed){
+        decodeFrames(src, out.slice(0, frames), info);
+    } else {
+        // Convert through a small interleaved buffer that stays in cache
+        const size_t chunk_frames = 4096;
+        scratch.resize(chunk_frames*info.num_channels);
+        for(size_t done = 0; done < frames; done += chunk_frames){
+            size_t n = std::min(chunk_frames, frames - done);
+            decoder.decode(src + done*info.block_align, scratch.data(), n*info.num_channels);
+            deinterleave(scratch.data(), out.slice(done, n));
+        }
+    }
+
+    if(timed){
+        Instrumentation::recordDecode(frames*info.block_align, Instrumentation::now() - begin);
+    }
+    return frames;
+}
+
+// Tells the OS that the region [start, start + frames) will be decoded soon
+void MappedWavFile::prefetch(uint64_t start, size_t frames){
+    if(!map || start >= num_samples){
+        return;
+    }
+    if(frames > num_samples - start){
+        frames = (size_t)(num_samples - start);
+    }
+
+    // madvise wants a page aligned address
+    long page = sysconf(_SC_PAGESIZE);
+    size_t begin = (size_t)(data - map) + (size_t)start*info.block_align;
+    size_t aligned = begin - begin % page;
+    madvise(map + aligned, begin - aligned + (size_t)frames*info.block_align, MADV_WILLNEED);
+}
+
+// Read-only view of the undecoded data chunk
+const unsigned char *MappedWavFile::getRawData(){
+    return data;
+}
+
+size_t MappedWavFile::getRawDataSize(){
+    return data_size;
+}
+
+// Getters
+std::string MappedWavFile::getFileName(){
+    return filename;
+}
+
+uint16_t MappedWavFile::getFormat(){
+    return info.format;
+}
+
+uint16_t MappedWavFile::getNumChannels(){
+    return info.num_channels;
+}
+
+uint32_t MappedWavFile::getSampleRate(){
+    return info.sample_rate;
+}
+
+uint32_t MappedWavFile::getByteRate(){
+    return info.byte_rate;
+}
+
+uint16_t MappedWavFile::getBlockAlign(){
+    return info.block_align;
+}
+
+uint16_t MappedWavFile::getBitsPerSample(){
+    return info.bits_per_sample;
+}
+
+WavContainer MappedWavFile::getContainer(){
+    return container;
+}
+
+uint64_t MappedWavFile::getNumSamples(){
+    return num_samples;
+}
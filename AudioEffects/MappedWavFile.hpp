@@ -0,0 +1,105 @@
+//
+//  MappedWavFile.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/21.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef MappedWavFile_hpp
+#define MappedWavFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "WavCommon.hpp"
+#include "SampleConversion.hpp"
+
+/* MappedWavFile class
+ *
+ * Maps a wav file read-only into memory instead of reading it
+ *
+ * The header is parsed in place and the data chunk is exposed as a view
+ * into the mapping, so opening does no copying and the pages are shared
+ * with every other process mapping the same file. Samples are only
+ * decoded to floats for the regions that are asked for.
+ *
+ * RIFF, RF64 and Wave64 files are all understood, the OS only pages in
+ * what's decoded so files larger than memory can be mapped whole.
+ */
+class MappedWavFile {
+public:
+
+    // Default Constructor
+    MappedWavFile();
+
+    // Constructor
+    // Maps the specified wav file
+    MappedWavFile(std::string path);
+
+    // Destructor
+    // Unmaps the file
+    ~MappedWavFile();
+
+    // The mapping can't be shared between two owners
+    MappedWavFile(const MappedWavFile &) = delete;
+    MappedWavFile &operator=(const MappedWavFile &) = delete;
+
+    // Map a new wav file
+    // Unmaps the old file if necessary
+    void open(std::string path);
+
+    // Unmap the current file
+    void close();
+
+    // Decodes frames [start, start + out.getNumFrames()) into out
+    //
+    // out must have num_channels channels
+    //
+    // returns the number of frames decoded, fewer than asked for if the region runs past the end
+    size_t decode(const AudioBufferView &out, uint64_t start);
+
+    // Tells the OS that the region [start, start + frames) will be decoded soon
+    void prefetch(uint64_t start, size_t frames);
+
+    // Read-only view of the undecoded data chunk
+    const unsigned char *getRawData();
+    size_t getRawDataSize();
+
+    // Getters
+    std::string getFileName();
+    uint16_t getFormat();
+    uint16_t getNumChannels();
+    uint32_t getSampleRate();
+    uint32_t getByteRate();
+    uint16_t getBlockAlign();
+    uint16_t getBitsPerSample();
+    WavContainer getContainer();
+    uint64_t getNumSamples();
+
+protected:
+private:
+    void init(); // Sets/Resets all fields to zero
+    void parseHeader(); // Finds the fmt and data chunks inside the mapping
+
+    // Copies bytes out of the mapping for parseWavLayout
+    static size_t readMapping(void *context, uint64_t offset, void *out, size_t size);
+
+    std::string filename;
+    WavFormatInfo info;
+
+    unsigned char *map; // Start of the mapping
+    size_t map_size; // Size of the mapping in bytes
+    const unsigned char *data; // Start of the data chunk inside the mapping
+    size_t data_size; // Size of the data chunk in bytes
+    WavContainer container;
+    uint64_t num_samples; // The number of samples per channel in the file
+
+    SampleDecoder decoder; // Picked once per file
+    bool packed; // True if frames have no padding, so the vector kernels can be used
+    std::vector<float> scratch; // Decoded but still interleaved samples
+};
+
+#endif /* MappedWavFile_hpp */
@@ -0,0 +1,92 @@
+//
+//  OfflineSink.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/27.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "OfflineSink.hpp"
+#include "WavWriter.hpp"
+#include <chrono>
+
+// Constructor
+// Discards everything it renders
+OfflineSink::OfflineSink(int block){
+    encoding = SampleEncoding::Float32;
+    block_frames = block;
+    frames_rendered = 0;
+    elapsed_seconds = 0;
+    realtime_factor = 0;
+    clipped_samples = 0;
+}
+
+// Constructor
+// Writes everything it renders to a new wav file at path
+OfflineSink::OfflineSink(std::string p, SampleEncoding enc, int block){
+    path = p;
+    encoding = enc;
+    block_frames = block;
+    frames_rendered = 0;
+    elapsed_seconds = 0;
+    realtime_factor = 0;
+    clipped_samples = 0;
+}
+
+// Renders the whole stream
+void OfflineSink::run(PlaybackStream &stream){
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    WavWriter out;
+    if(!path.empty()){
+        out.open(path, stream.getNumChannels(), stream.getSampleRate(), encoding);
+    }
+    
+    buffer.resize((size_t)block_frames*stream.getNumChannels());
+    frames_rendered = 0;
+    
+    while(true){
+        // Sleep until the producer has a whole block ready instead of rendering silence,
+        // so the core is left to the producer rather than spent polling it
+        stream.waitForFill(block_frames);
+        int n = stream.read(buffer.data(), block_frames);
+        if(n == 0){
+            if(stream.isFinished()){
+                break;
+            }
+            continue;
+        }
+        
+        if(out.isOpen()){
+            out.writeInterleaved(buffer.data(), n);
+        }
+        frames_rendered += n;
+    }
+    
+    clipped_samples = 0;
+    if(out.isOpen()){
+        out.close();
+        clipped_samples = out.getClippedSamples();
+    }
+    
+    elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double audio_seconds = stream.getSampleRate() ? (double)frames_rendered/stream.getSampleRate() : 0;
+    realtime_factor = elapsed_seconds > 0 ? audio_seconds/elapsed_seconds : 0;
+}
+
+// Results of the last run
+uint64_t OfflineSink::getFramesRendered(){
+    return frames_rendered;
+}
+
+double OfflineSink::getElapsedSeconds(){
+    return elapsed_seconds;
+}
+
+double OfflineSink::getRealtimeFactor(){
+    return realtime_factor;
+}
+
+uint64_t OfflineSink::getClippedSamples(){
+    return clipped_samples;
+}
@@ -0,0 +1,60 @@
+//
+//  OfflineSink.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/27.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef OfflineSink_hpp
+#define OfflineSink_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AudioSink.hpp"
+#include "SampleConversion.hpp"
+
+/* OfflineSink class
+ *
+ * Renders a stream as fast as the CPU allows
+ *
+ * The audio is written to a wav file, or thrown away when no path is
+ * given (for benchmarking). Nothing waits on a clock, so the realtime
+ * factor reported afterwards is the speed of the decode/effects path.
+ */
+class OfflineSink: public AudioSink {
+public:
+    
+    // Constructor
+    // Discards everything it renders
+    OfflineSink(int block_frames = 4096);
+    
+    // Constructor
+    // Writes everything it renders to a new wav file at path
+    OfflineSink(std::string path, SampleEncoding encoding = SampleEncoding::Float32, int block_frames = 4096);
+    
+    // Renders the whole stream
+    void run(PlaybackStream &stream) override;
+    
+    // Results of the last run
+    uint64_t getFramesRendered();
+    double getElapsedSeconds(); // Wall clock time taken
+    double getRealtimeFactor(); // Seconds of audio rendered per second of wall clock time
+    uint64_t getClippedSamples(); // Samples clipped when writing an integer format
+    
+protected:
+private:
+    std::string path; // Empty to discard
+    SampleEncoding encoding;
+    int block_frames;
+    std::vector<float> buffer;
+    
+    uint64_t frames_rendered;
+    double elapsed_seconds;
+    double realtime_factor;
+    uint64_t clipped_samples;
+};
+
+#endif /* OfflineSink_hpp */
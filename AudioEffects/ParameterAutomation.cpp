@@ -0,0 +1,216 @@
+//
+//  ParameterAutomation.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/8.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "ParameterAutomation.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Constructor
+// Slot i starts out free for the producer posting at position i
+ParameterQueue::ParameterQueue(size_t min_capacity){
+    size_t capacity = 1;
+    while(capacity < min_capacity){
+        capacity <<= 1;
+    }
+    slots.reset(new Slot[capacity]);
+    for(size_t i = 0; i < capacity; ++i){
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask = capacity - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+}
+
+// Adds change to the queue, returns false if it was full
+bool ParameterQueue::post(const ParameterChange &change){
+    size_t position = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    while(true){
+        slot = &slots[position & mask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if(difference == 0){
+            // The slot is free, claim it if nobody else got there first
+            if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                break;
+            }
+        } else if(difference < 0){
+            // Still holding a change from a lap ago that hasn't been popped
+            return false;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->change = change;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// Takes the oldest change out, returns false if there wasn't one
+bool ParameterQueue::pop(ParameterChange &change){
+    size_t position = tail.load(std::memory_order_relaxed);
+    Slot &slot = slots[position & mask];
+    if(slot.sequence.load(std::memory_order_acquire) != position + 1){
+        return false;
+    }
+
+    change = slot.change;
+
+    // Free for the producer that gets here on the next lap
+    slot.sequence.store(position + mask + 1, std::memory_order_release);
+    tail.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// Constructor
+ParameterAutomation::ParameterAutomation(int num_parameters, size_t cap): queue(cap){
+    capacity = std::max(cap, (size_t)1);
+    smoothing = 0;
+    frame = 0;
+
+    parameters.resize(num_parameters);
+    for(size_t i = 0; i < parameters.size(); ++i){
+        Parameter &p = parameters[i];
+        p.value = p.target = p.increment = 0.0f;
+        p.remaining = 0;
+        p.scheduled.reserve(capacity);
+    }
+}
+
+// Moves parameter to value over ramp_frames, starting with the next block
+bool ParameterAutomation::set(int parameter, float value, uint32_t ramp_frames){
+    return schedule(parameter, value, 0, ramp_frames);
+}
+
+// Moves parameter to value over ramp_frames, starting exactly at stream frame
+bool ParameterAutomation::schedule(int parameter, float value, uint64_t at, uint32_t ramp_frames){
+    if(parameter < 0 || parameter >= (int)parameters.size()){
+        throw std::out_of_range("ParameterAutomation Error: No such parameter!");
+    }
+    ParameterChange change;
+    change.parameter = parameter;
+    change.value = value;
+    change.ramp_frames = ramp_frames;
+    change.frame = at;
+    return queue.post(change);
+}
+
+// Shortest ramp any change gets
+void ParameterAutomation::setSmoothing(uint32_t frames){
+    smoothing = frames;
+}
+
+// Sets parameter to value immediately
+void ParameterAutomation::jump(int parameter, float value){
+    Parameter &p = parameters.at(parameter);
+    p.value = p.target = value;
+    p.increment = 0.0f;
+    p.remaining = 0;
+}
+
+// Takes every posted change and schedules it
+// Each parameter's schedule is kept in frame order, changes for the same frame stay in the order
+// they were posted. When a schedule is full the change that's furthest out is replaced.
+void ParameterAutomation::update(){
+    ParameterChange change;
+    while(queue.pop(change)){
+        std::vector<ParameterChange> &scheduled = parameters[change.parameter].scheduled;
+        if(scheduled.size() == capacity){
+            scheduled.pop_back();
+        }
+        std::vector<ParameterChange>::iterator at = scheduled.end();
+        while(at != scheduled.begin() && (at - 1)->frame > change.frame){
+            --at;
+        }
+        scheduled.insert(at, change);
+    }
+}
+
+// True if any parameter moves during the next num_frames frames
+bool ParameterAutomation::isChanging(int num_frames){
+    for(size_t i = 0; i < parameters.size(); ++i){
+        const Parameter &p = parameters[i];
+        if(p.remaining > 0 || (!p.scheduled.empty() && p.scheduled.front().frame < frame + num_frames)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves every parameter forward num_frames
+// Each ramp starts on the frame it was scheduled for, even in the middle of the block
+void ParameterAutomation::advance(int num_frames){
+    uint64_t end = frame + num_frames;
+    for(size_t i = 0; i < parameters.size(); ++i){
+        Parameter &p = parameters[i];
+        uint64_t at = frame;
+        size_t next = 0;
+        while(next < p.scheduled.size() && p.scheduled[next].frame < end){
+            const ParameterChange &change = p.scheduled[next++];
+            if(change.frame > at){
+                ramp(p, (uint32_t)(change.frame - at));
+                at = change.frame;
+            }
+            begin(p, change);
+        }
+        if(next > 0){
+            p.scheduled.erase(p.scheduled.begin(), p.scheduled.begin() + next);
+        }
+        ramp(p, (uint32_t)(end - at));
+    }
+    frame = end;
+}
+
+// Starts change's ramp from wherever the parameter is now
+void ParameterAutomation::begin(Parameter &p, const ParameterChange &change){
+    uint32_t frames = std::max(change.ramp_frames, smoothing);
+    p.target = change.value;
+    if(frames == 0){
+        p.value = p.target;
+        p.increment = 0.0f;
+        p.remaining = 0;
+    } else {
+        p.increment = (p.target - p.value)/frames;
+        p.remaining = frames;
+    }
+}
+
+// Moves p forward num_frames frames of ramp, landing exactly on the target at the end
+// The value is worked out from the frames left rather than added up step by step, so it's the
+// same on every frame however the ramp was split into blocks
+void ParameterAutomation::ramp(Parameter &p, uint32_t num_frames){
+    if(p.remaining == 0){
+        return;
+    }
+    if(num_frames >= p.remaining){
+        p.value = p.target;
+        p.remaining = 0;
+    } else {
+        p.remaining -= num_frames;
+        p.value = p.target - p.increment*p.remaining;
+    }
+}
+
+// Value at the current frame
+float ParameterAutomation::getValue(int parameter){
+    return parameters[parameter].value;
+}
+
+uint64_t ParameterAutomation::getFrame(){
+    return frame;
+}
+
+// Goes back to frame 0, keeping the values and anything scheduled
+void ParameterAutomation::reset(){
+    frame = 0;
+}
+
+int ParameterAutomation::getNumParameters(){
+    return (int)parameters.size();
+}
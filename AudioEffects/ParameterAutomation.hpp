@@ -0,0 +1,157 @@
+//
+//  ParameterAutomation.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/8.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef ParameterAutomation_hpp
+#define ParameterAutomation_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A parameter change posted by a control thread
+struct ParameterChange {
+    int parameter;
+    float value; // Where the parameter ends up
+    uint32_t ramp_frames; // How long it takes to get there
+    uint64_t frame; // Stream frame the ramp starts at, anything already played means as soon as possible
+};
+
+/* ParameterQueue class
+ *
+ * Lock-free multiple producer/single consumer queue of parameter changes
+ *
+ * Any number of threads may post at once while one other thread pops.
+ * Each slot carries a sequence number that says whether it's free for the
+ * producer that claimed it or ready for the consumer, so producers only
+ * contend on a single compare and swap and popping never waits. Neither
+ * side allocates after construction.
+ */
+class ParameterQueue {
+public:
+
+    // Constructor
+    // The capacity is rounded up to a power of two
+    explicit ParameterQueue(size_t min_capacity = 256);
+
+    // Adds change to the queue, returns false if it was full
+    // Safe from any thread
+    bool post(const ParameterChange &change);
+
+    // Takes the oldest change out, returns false if there wasn't one
+    // Consumer side only
+    bool pop(ParameterChange &change);
+
+protected:
+private:
+    ParameterQueue(const ParameterQueue &) = delete;
+    ParameterQueue &operator=(const ParameterQueue &) = delete;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        ParameterChange change;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    // Padded apart, producers hammer one and the consumer the other
+    std::atomic<size_t> head; // Next position to post to
+    char padding[64];
+    std::atomic<size_t> tail; // Next position to pop from
+};
+
+/* ParameterAutomation class
+ *
+ * A set of effect parameters that other threads can change while the effect plays
+ *
+ * Control threads post changes, either as soon as possible or at an exact
+ * stream frame, each with a linear ramp. The audio thread moves posted
+ * changes over at block boundaries with update, then advances through the
+ * block, starting each ramp on the exact frame it was scheduled for. Changes
+ * asking for a shorter ramp than the smoothing time are stretched to it, so
+ * jumps don't click.
+ *
+ * Only the audio side keeps state, and everything it needs is allocated by
+ * the constructor: the audio thread never locks or allocates.
+ */
+class ParameterAutomation {
+public:
+
+    // Constructor
+    // capacity is how many changes can be waiting in the queue, and how many
+    // can be scheduled ahead per parameter
+    explicit ParameterAutomation(int num_parameters, size_t capacity = 256);
+
+    // ---- Control side, safe from any thread
+
+    // Moves parameter to value over ramp_frames, starting with the next block
+    // returns false if the queue was full and the change was dropped
+    bool set(int parameter, float value, uint32_t ramp_frames = 0);
+
+    // Moves parameter to value over ramp_frames, starting exactly at stream frame
+    bool schedule(int parameter, float value, uint64_t frame, uint32_t ramp_frames);
+
+    // ---- Audio side, or any thread while nothing is being processed
+
+    // Shortest ramp any change gets
+    void setSmoothing(uint32_t frames);
+
+    // Sets parameter to value immediately, dropping any ramp in progress
+    void jump(int parameter, float value);
+
+    // Takes every posted change and schedules it
+    // Called at a block boundary, before advance
+    void update();
+
+    // True if any parameter moves during the next num_frames frames
+    bool isChanging(int num_frames);
+
+    // Moves every parameter forward num_frames
+    void advance(int num_frames);
+
+    // Value at the current frame
+    float getValue(int parameter);
+
+    // Stream frame the parameters are at, restarts at 0 with reset
+    uint64_t getFrame();
+
+    // Goes back to frame 0, keeping the values and anything scheduled
+    void reset();
+
+    int getNumParameters();
+
+protected:
+private:
+    // State of one parameter, only touched by the audio side
+    struct Parameter {
+        float value;
+        float target;
+        float increment; // Per frame, while ramping
+        uint32_t remaining; // Frames left in the ramp
+
+        // Changes waiting for their frame, in order, with room for capacity of them
+        std::vector<ParameterChange> scheduled;
+    };
+
+    // Starts change's ramp
+    void begin(Parameter &p, const ParameterChange &change);
+
+    // Moves p forward num_frames frames of ramp
+    void ramp(Parameter &p, uint32_t num_frames);
+
+    ParameterQueue queue;
+    std::vector<Parameter> parameters;
+    size_t capacity;
+    uint32_t smoothing;
+    uint64_t frame;
+};
+
+#endif /* ParameterAutomation_hpp */
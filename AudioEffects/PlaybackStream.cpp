@@ -0,0 +1,306 @@
+//
+//  PlaybackStream.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/26.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "PlaybackStream.hpp"
+#include "Instrumentation.hpp"
+#include "SampleConversion.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+PlaybackStream::PlaybackStream(float seconds, int block){
+    buffer_seconds = seconds;
+    block_frames = block;
+    from_memory = false;
+    memory_position = 0;
+    effects = NULL;
+    interleaved_path = false;
+    num_channels = 0;
+    sample_rate = 0;
+    output_rate = 0;
+    running = false;
+    producer_done = true;
+    frames_played = 0;
+    underruns = 0;
+    min_fill = 0;
+}
+
+PlaybackStream::~PlaybackStream(){
+    stop();
+}
+
+// Starts streaming the wav file at path through effects
+void PlaybackStream::start(std::string path, AudioEffect *ae){
+    stop();
+    reader.open(path);
+    from_memory = false;
+    launch(reader.getNumChannels(), reader.getSampleRate(), ae);
+}
+
+// Starts streaming an already loaded file through effects
+void PlaybackStream::start(WavFile &w, AudioEffect *ae){
+    stop();
+    startMemory(w.getData(), w.getSampleRate(), ae);
+}
+
+// Starts streaming shared decoded audio through effects
+void PlaybackStream::start(std::shared_ptr<const DecodedAudio> audio, AudioEffect *ae){
+    stop();
+    held = audio;
+    startMemory(audio->getData(), audio->getSampleRate(), ae);
+}
+
+// Starts streaming from samples already in memory
+void PlaybackStream::startMemory(const AudioBufferView &samples, uint32_t rate, AudioEffect *ae){
+    reader.close();
+    from_memory = true;
+    memory = samples;
+    memory_position = 0;
+    launch((uint16_t)samples.getNumChannels(), rate, ae);
+}
+
+// Resamples every source to rate from the next start
+void PlaybackStream::setOutputRate(uint32_t rate){
+    output_rate = rate;
+}
+
+// Allocates the buffers and launches the producer
+void PlaybackStream::launch(uint16_t channels, uint32_t rate, AudioEffect *ae){
+    num_channels = channels;
+    sample_rate = output_rate ? output_rate : rate;
+    effects = ae;
+
+    // A block of source frames can come out of the resampler a little longer,
+    // and the last one is followed by whatever was still in the filter
+    resampler.prepare(rate, sample_rate, num_channels, block_frames);
+    int max_frames = block_frames;
+    if(!resampler.isPassthrough()){
+        max_frames = (int)resampler.getMaxOutput(block_frames) + (int)ceil(resampler.getLatency());
+        resampled.allocate(num_channels, max_frames);
+    }
+
+    size_t capacity = std::max((size_t)max_frames, (size_t)(buffer_seconds*sample_rate))*num_channels;
+    ring.reset(new RingBuffer<float>(capacity));
+
+    planar.allocate(num_channels, block_frames);
+    interleaved.resize((size_t)max_frames*num_channels);
+
+    if(effects){
+        effects->prepareChain(sample_rate, max_frames, num_channels);
+        effects->resetChain();
+    }
+
+    // The ring holds interleaved frames, so when the reader and every effect
+    // can work on those directly, the planar round trip is skipped entirely
+    interleaved_path = !from_memory && resampler.isPassthrough() && (!effects || effects->chainSupportsInterleaved());
+
+    frames_played = 0;
+    underruns = 0;
+    min_fill = INT_MAX;
+    error = nullptr;
+    producer_done = false;
+    running = true;
+    producer = std::thread(&PlaybackStream::run, this);
+}
+
+// Stops the producer thread and drops anything still buffered
+void PlaybackStream::stop(){
+    running = false;
+    notifyFill();
+    if(producer.joinable()){
+        producer.join();
+    }
+    producer_done = true;
+    held.reset();
+    if(ring){
+        ring->clear();
+    }
+}
+
+// Reads the next block of the source
+int PlaybackStream::readSource(const AudioBufferView &out){
+    if(!from_memory){
+        return (int)reader.read(out);
+    }
+
+    size_t n = std::min(out.getNumFrames(), memory.getNumFrames() - memory_position);
+    out.slice(0, n).copyFrom(memory.slice(memory_position, n));
+    memory_position += n;
+    return (int)n;
+}
+
+// Body of the producer thread
+// Nothing may escape the thread, a failure ends the stream and is kept for getError
+void PlaybackStream::run(){
+    try {
+        produce();
+    } catch(...){
+        error = std::current_exception();
+    }
+    producer_done.store(true, std::memory_order_release);
+    notifyFill();
+}
+
+// Decodes, processes and pushes blocks until the source runs out or the stream is stopped
+void PlaybackStream::produce(){
+    bool drained = false;
+    while(running){
+        int n;
+        if(interleaved_path){
+            n = (int)reader.readInterleaved(interleaved.data(), block_frames);
+            if(n == 0){
+                break;
+            }
+            if(effects){
+                effects->processChainInterleaved(interleaved.data(), n);
+            }
+        } else {
+            n = readSource(planar.view());
+            AudioBufferView block = planar.slice(0, n);
+            if(!resampler.isPassthrough()){
+                // Once the source runs out, the end of it is still in the filter
+                size_t m;
+                if(n > 0){
+                    m = resampler.process(block, resampled.view());
+                } else if(!drained){
+                    m = resampler.drain(resampled.view());
+                    drained = true;
+                } else {
+                    break;
+                }
+                block = resampled.slice(0, m);
+                n = (int)m;
+            } else if(n == 0){
+                break;
+            }
+            if(effects){
+                effects->processChain(block);
+            }
+            interleave(block, interleaved.data());
+        }
+
+        // Wait for the callback to make room, a few milliseconds at a time
+        size_t total = (size_t)n*num_channels;
+        size_t written = 0;
+        while(running){
+            written += ring->write(interleaved.data() + written, total - written);
+            notifyFill();
+            if(written == total){
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+}
+
+// Wakes anyone in waitForFill
+// Taking the lock orders the wake up after a waiter's check of the fill level
+void PlaybackStream::notifyFill(){
+    {
+        std::lock_guard<std::mutex> guard(fill_lock);
+    }
+    fill_changed.notify_all();
+}
+
+// Blocks until at least frames frames are buffered, the producer is done or the stream is stopped
+int PlaybackStream::waitForFill(int frames){
+    if(!ring || num_channels == 0){
+        return 0;
+    }
+    frames = std::min(frames, (int)(ring->capacity()/num_channels));
+
+    std::unique_lock<std::mutex> guard(fill_lock);
+    fill_changed.wait(guard, [this, frames](){
+        return getFillLevel() >= frames || producer_done.load(std::memory_order_acquire) ||
+               !running.load(std::memory_order_relaxed);
+    });
+    return getFillLevel();
+}
+
+// Copies up to frames interleaved frames into out, and fills the rest with silence
+int PlaybackStream::pull(float *out, int frames){
+    int got = read(out, frames);
+
+    if(got < frames){
+        memset(out + (size_t)got*num_channels, 0, (size_t)(frames - got)*num_channels*sizeof(float));
+
+        // Running dry at the end of the stream is expected, anywhere else it's an underrun
+        if(!producer_done.load(std::memory_order_acquire)){
+            underruns.fetch_add(1, std::memory_order_relaxed);
+            if(Instrumentation::isEnabled()){
+                Instrumentation::recordUnderrun();
+            }
+        }
+    }
+
+    int fill = getFillLevel();
+    if(fill < min_fill.load(std::memory_order_relaxed)){
+        min_fill.store(fill, std::memory_order_relaxed);
+    }
+    return got;
+}
+
+// Copies up to frames interleaved frames that are ready into out
+int PlaybackStream::read(float *out, int frames){
+    if(!ring){
+        return 0;
+    }
+
+    // The producer may have written part of a frame, only take whole ones
+    size_t available = ring->readAvailable();
+    available -= available % num_channels;
+    size_t got = ring->read(out, std::min((size_t)frames*num_channels, available));
+
+    int got_frames = (int)(got/num_channels);
+    frames_played.fetch_add(got_frames, std::memory_order_relaxed);
+    return got_frames;
+}
+
+// True once the source is exhausted and everything has been pulled, or the producer failed
+bool PlaybackStream::isFinished(){
+    if(!producer_done.load(std::memory_order_acquire)){
+        return false;
+    }
+    return error || !ring || ring->readAvailable() == 0;
+}
+
+// What the producer threw, null if it didn't
+std::exception_ptr PlaybackStream::getError(){
+    if(!producer_done.load(std::memory_order_acquire)){
+        return nullptr;
+    }
+    return error;
+}
+
+// Getters
+uint16_t PlaybackStream::getNumChannels(){
+    return num_channels;
+}
+
+uint32_t PlaybackStream::getSampleRate(){
+    return sample_rate;
+}
+
+uint64_t PlaybackStream::getFramesPlayed(){
+    return frames_played.load(std::memory_order_relaxed);
+}
+
+uint64_t PlaybackStream::getUnderruns(){
+    return underruns.load(std::memory_order_relaxed);
+}
+
+int PlaybackStream::getFillLevel(){
+    return (ring && num_channels) ? (int)(ring->readAvailable()/num_channels) : 0;
+}
+
+int PlaybackStream::getMinFillLevel(){
+    int m = min_fill.load(std::memory_order_relaxed);
+    return m == INT_MAX ? getFillLevel() : m;
+}
@@ -0,0 +1,171 @@
+//
+//  PlaybackStream.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/26.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef PlaybackStream_hpp
+#define PlaybackStream_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "AudioEffect.hpp"
+#include "DecodedAudioCache.hpp"
+#include "Resampler.hpp"
+#include "RingBuffer.hpp"
+#include "WavFile.hpp"
+#include "WavReader.hpp"
+
+/* PlaybackStream class
+ *
+ * Feeds an audio callback from a producer thread
+ *
+ * The producer decodes the source block by block, runs each block through
+ * the effect chain and pushes it into a lock-free ring buffer. The audio
+ * callback only copies interleaved frames back out with pull, which never
+ * blocks, locks or allocates. Playback can start as soon as the first
+ * blocks are ready instead of after the whole file has been processed.
+ *
+ * With an output rate set, sources at any other rate are resampled before
+ * the effects, so the effects and the callback always see that rate.
+ *
+ * Anything the producer throws (a damaged file, a failing effect) ends the
+ * stream early and is kept for getError, so whoever started it can report
+ * it once the sink returns.
+ */
+class PlaybackStream {
+public:
+
+    // Constructor
+    // buffer_seconds is how much audio the ring buffer can hold
+    // block_frames is how many frames the producer processes at a time
+    PlaybackStream(float buffer_seconds = 1.0f, int block_frames = 1024);
+
+    // Destructor
+    // Stops the producer thread
+    ~PlaybackStream();
+
+    // Starts streaming the wav file at path through effects (which may be NULL)
+    // Only a block at a time of the file is ever in memory
+    void start(std::string path, AudioEffect *effects);
+
+    // Starts streaming an already loaded file through effects (which may be NULL)
+    // The file's samples are copied block by block and not modified
+    void start(WavFile &wav, AudioEffect *effects);
+
+    // Starts streaming decoded audio, usually from a DecodedAudioCache, through effects (which may be NULL)
+    // The stream holds on to it until stopped, and copies it block by block for the effects
+    // to work on, so the shared samples are never modified
+    void start(std::shared_ptr<const DecodedAudio> audio, AudioEffect *effects);
+
+    // Stops the producer thread and drops anything still buffered
+    // Never throws, a failure of the producer stays available from getError
+    void stop();
+
+    // Resamples every source to rate from the next start, 0 keeps each source's own rate
+    void setOutputRate(uint32_t rate);
+
+    // Copies up to frames interleaved frames into out, and fills the rest with silence
+    // Wait-free, safe to call from the audio callback
+    //
+    // returns the number of frames that came from the stream
+    int pull(float *out, int frames);
+
+    // Copies up to frames interleaved frames that are ready into out, without padding
+    // For consumers that can wait for the producer instead of playing silence
+    //
+    // returns the number of frames copied
+    int read(float *out, int frames);
+
+    // Blocks until at least frames frames are buffered, the producer is done or the stream is stopped
+    // Asking for more than the ring holds waits for it to be full
+    // Never call this from the audio callback
+    //
+    // returns the number of frames buffered
+    int waitForFill(int frames);
+
+    // True once the source is exhausted and everything has been pulled, or the producer failed
+    bool isFinished();
+
+    // What the producer threw, null if it didn't
+    // Valid once isFinished returns true, and kept until the next start
+    std::exception_ptr getError();
+
+    // Getters
+    uint16_t getNumChannels();
+    uint32_t getSampleRate(); // Of the output, after resampling
+    uint64_t getFramesPlayed();
+    uint64_t getUnderruns(); // Pulls that came up short before the end of the stream
+    int getFillLevel(); // Frames currently buffered
+    int getMinFillLevel(); // Lowest fill level seen by pull since start
+
+protected:
+private:
+    PlaybackStream(const PlaybackStream &) = delete;
+    PlaybackStream &operator=(const PlaybackStream &) = delete;
+
+    // Allocates the buffers and launches the producer
+    void launch(uint16_t channels, uint32_t rate, AudioEffect *effects);
+
+    // Body of the producer thread, catches anything produce throws
+    void run();
+
+    // Decodes, processes and pushes blocks until the source runs out or the stream is stopped
+    void produce();
+
+    // Wakes anyone in waitForFill, producer side
+    void notifyFill();
+
+    // Reads the next block of the source, returns the number of frames read
+    int readSource(const AudioBufferView &out);
+
+    float buffer_seconds;
+    int block_frames;
+
+    // Starts streaming from samples already in memory
+    void startMemory(const AudioBufferView &samples, uint32_t rate, AudioEffect *effects);
+
+    // The source, either a reader or samples already in memory
+    WavReader reader;
+    bool from_memory;
+    AudioBufferView memory;
+    size_t memory_position;
+    std::shared_ptr<const DecodedAudio> held; // Kept alive while memory points into it
+
+    AudioEffect *effects;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t output_rate; // 0 for the source's rate
+
+    std::unique_ptr<RingBuffer<float> > ring;
+    std::thread producer;
+    std::atomic<bool> running;
+    std::atomic<bool> producer_done;
+    std::exception_ptr error; // Written by the producer before producer_done is set
+    std::mutex fill_lock;
+    std::condition_variable fill_changed;
+
+    // Producer side scratch space
+    AudioBuffer planar;
+    Resampler resampler;
+    AudioBuffer resampled;
+    bool interleaved_path; // Decode and process straight into interleaved, picked at launch
+    std::vector<float> interleaved;
+
+    // Counters, written by the consumer and readable from anywhere
+    std::atomic<uint64_t> frames_played;
+    std::atomic<uint64_t> underruns;
+    std::atomic<int> min_fill;
+};
+
+#endif /* PlaybackStream_hpp */
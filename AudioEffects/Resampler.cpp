@@ -0,0 +1,411 @@
+//
+//  Resampler.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/5.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "Resampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "SampleConversion.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AUDIOEFFECTS_X86 1
+#include <immintrin.h>
+#endif
+
+// Filter design
+// The pass band ends where the transition band has to start so that it's
+// over by the lower Nyquist frequency, and the Kaiser window's beta gives
+// about 80dB of stop band rejection
+static const double cutoff = 0.93; // Of the lower of the two Nyquist frequencies
+static const double zero_crossings = 32; // Of the sinc on each side, at the cutoff
+static const double kaiser_beta = 8.0;
+
+// ---- Kernels, each computes count output samples of one channel
+// Output n is the inner product of taps input samples from x + inputs[n]
+// with the taps coefficients at rows + rows_offsets[n]
+
+typedef void (*ResampleKernel)(const float *x, const float *rows, const size_t *inputs,
+                               const size_t *row_offsets, size_t count, int taps, float *out);
+
+#ifndef AUDIOEFFECTS_X86
+static void resampleScalar(const float *x, const float *rows, const size_t *inputs,
+                           const size_t *row_offsets, size_t count, int taps, float *out){
+    for(size_t n = 0; n < count; ++n){
+        const float *w = x + inputs[n];
+        const float *h = rows + row_offsets[n];
+        float sum = 0.0f;
+        for(int k = 0; k < taps; ++k){
+            sum += w[k]*h[k];
+        }
+        out[n] = sum;
+    }
+}
+#else
+// Taps are always a multiple of 8, two accumulators hide the add latency
+static void resampleSSE(const float *x, const float *rows, const size_t *inputs,
+                        const size_t *row_offsets, size_t count, int taps, float *out){
+    for(size_t n = 0; n < count; ++n){
+        const float *w = x + inputs[n];
+        const float *h = rows + row_offsets[n];
+        __m128 a = _mm_setzero_ps();
+        __m128 b = _mm_setzero_ps();
+        for(int k = 0; k < taps; k += 8){
+            a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(w + k), _mm_loadu_ps(h + k)));
+            b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(w + k + 4), _mm_loadu_ps(h + k + 4)));
+        }
+        a = _mm_add_ps(a, b);
+        a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+        out[n] = _mm_cvtss_f32(a);
+    }
+}
+
+__attribute__((target("avx")))
+static void resampleAVX(const float *x, const float *rows, const size_t *inputs,
+                        const size_t *row_offsets, size_t count, int taps, float *out){
+    for(size_t n = 0; n < count; ++n){
+        const float *w = x + inputs[n];
+        const float *h = rows + row_offsets[n];
+        __m256 a = _mm256_setzero_ps();
+        int k = 0;
+        if(taps >= 16){
+            __m256 b = _mm256_setzero_ps();
+            for(; k + 16 <= taps; k += 16){
+                a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(h + k)));
+                b = _mm256_add_ps(b, _mm256_mul_ps(_mm256_loadu_ps(w + k + 8), _mm256_loadu_ps(h + k + 8)));
+            }
+            a = _mm256_add_ps(a, b);
+        }
+        if(k < taps){
+            a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(h + k)));
+        }
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        out[n] = _mm_cvtss_f32(s);
+    }
+}
+#endif /* AUDIOEFFECTS_X86 */
+
+// Picks the widest kernel this CPU has
+static ResampleKernel selectKernel(const char **name){
+#ifdef AUDIOEFFECTS_X86
+    if(cpuHasAVX()){
+        *name = "avx";
+        return resampleAVX;
+    }
+    *name = "sse";
+    return resampleSSE;
+#else
+    *name = "scalar";
+    return resampleScalar;
+#endif
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x){
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 50; ++k){
+        term *= (x/(2*k))*(x/(2*k));
+        sum += term;
+        if(term < sum*1e-12){
+            break;
+        }
+    }
+    return sum;
+}
+
+static int greatestCommonDivisor(int a, int b){
+    while(b != 0){
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Default Constructor
+Resampler::Resampler(){
+    input_rate = 0;
+    output_rate = 0;
+    num_channels = 0;
+    max_input = 0;
+    available = 0;
+    skip = 0;
+    phase = 0;
+}
+
+// The table for up/down, built on first use and cached for the rest of the program
+std::shared_ptr<const Resampler::Table> Resampler::getTable(int up, int down){
+    static std::mutex lock;
+    static std::map<std::pair<int, int>, std::shared_ptr<const Table> > cache;
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::shared_ptr<const Table> &cached = cache[std::make_pair(up, down)];
+    if(cached){
+        return cached;
+    }
+
+    std::shared_ptr<Table> t(new Table());
+    t->up = up;
+    t->down = down;
+    t->num_phases = std::min(up, (int)max_phases);
+
+    // Cutoff relative to the input's Nyquist frequency, the filter gets longer as it gets narrower
+    double fc = cutoff*std::min(1.0, (double)up/down);
+    int half = (int)ceil(zero_crossings/fc);
+    t->taps = (2*half + 7) & ~7;
+
+    // Row r is the filter for an output r/num_phases of the way from one input frame to the next
+    // The window of taps inputs is centered taps/2 - 1 frames in
+    int taps = t->taps;
+    double center = taps/2 - 1;
+    t->rows.resize((size_t)(t->num_phases + 1)*taps);
+    for(int r = 0; r <= t->num_phases; ++r){
+        float *row = &t->rows[(size_t)r*taps];
+        double fraction = (double)r/t->num_phases;
+        double sum = 0;
+        for(int k = 0; k < taps; ++k){
+            double x = fraction + center - k;
+            double u = x/(taps/2);
+            double window = (fabs(u) < 1) ? besselI0(kaiser_beta*sqrt(1 - u*u))/besselI0(kaiser_beta) : 0;
+            double sinc = (x == 0) ? 1 : sin(M_PI*fc*x)/(M_PI*fc*x);
+            double value = fc*sinc*window;
+            row[k] = (float)value;
+            sum += value;
+        }
+
+        // Every phase passes DC at exactly unity gain
+        for(int k = 0; k < taps; ++k){
+            row[k] = (float)(row[k]/sum);
+        }
+    }
+
+    cached = t;
+    return cached;
+}
+
+// Sets up conversion from input_rate to output_rate for num_channels
+void Resampler::prepare(int in_rate, int out_rate, int channels, int max_in){
+    if(in_rate <= 0 || out_rate <= 0){
+        throw std::invalid_argument("Resampler Error: Sample rates must be positive!");
+    }
+    input_rate = in_rate;
+    output_rate = out_rate;
+    num_channels = channels;
+    max_input = std::max(max_in, 1);
+
+    int g = greatestCommonDivisor(output_rate, input_rate);
+    int up = output_rate/g;
+    int down = input_rate/g;
+    if(up == down){
+        table.reset();
+        history.free();
+        return;
+    }
+
+    table = getTable(up, down);
+    history.allocate(num_channels, table->taps - 1 + max_input);
+    step_input.resize(getMaxOutput(max_input));
+    step_row.resize(step_input.size());
+    reset();
+}
+
+// Clears the input history
+// The filter starts with a full window of silence, which is where the latency comes from
+void Resampler::reset(){
+    restart(table ? table->taps - 1 : 0);
+}
+
+// Empties the history and primes it with frames of silence
+void Resampler::restart(size_t frames){
+    if(table){
+        history.view().clear();
+    }
+    available = frames;
+    skip = 0;
+    phase = 0;
+}
+
+// Consumes every frame of input and writes the frames that are ready to output
+size_t Resampler::process(const AudioBufferView &input, const AudioBufferView &output){
+    if(input.getNumChannels() != num_channels || output.getNumChannels() != num_channels){
+        throw std::invalid_argument("Resampler Error: Buffers don't have the prepared number of channels!");
+    }
+    return run(&input, input.getNumFrames(), output);
+}
+
+// Pushes the latency's worth of silence through
+size_t Resampler::drain(const AudioBufferView &output){
+    if(!table){
+        return 0;
+    }
+    return run(NULL, table->taps/2, output);
+}
+
+// Runs num_frames frames of input through, NULL input being silence
+size_t Resampler::run(const AudioBufferView *input, size_t num_frames, const AudioBufferView &output){
+    static const char *name;
+    static const ResampleKernel kernel = selectKernel(&name);
+
+    if(!table){
+        if(num_frames > output.getNumFrames()){
+            throw std::out_of_range("Resampler Error: Output buffer is too small!");
+        }
+        AudioBufferView out = output.slice(0, num_frames);
+        if(input){
+            out.copyFrom(*input);
+        } else {
+            out.clear();
+        }
+        return num_frames;
+    }
+
+    const int taps = table->taps;
+    const int up = table->up;
+    const int down = table->down;
+    const bool exact = (table->num_phases == up);
+    const float *rows = table->rows.data();
+
+    size_t written = 0;
+    size_t done = 0;
+    while(done < num_frames){
+        size_t n = std::min((size_t)max_input, num_frames - done);
+
+        // The filter already stepped over these
+        size_t dropped = std::min(skip, n);
+        skip -= dropped;
+        done += dropped;
+        n -= dropped;
+        if(n == 0){
+            continue;
+        }
+
+        for(int c = 0; c < num_channels; ++c){
+            float *h = history[c] + available;
+            if(input){
+                memcpy(h, (*input)[c] + done, n*sizeof(float));
+            } else {
+                memset(h, 0, n*sizeof(float));
+            }
+        }
+        available += n;
+        done += n;
+
+        // Work out every output's window once, all channels share them
+        size_t capacity = std::min(output.getNumFrames() - written, step_input.size());
+        size_t count = 0;
+        size_t position = 0;
+        while(position + taps <= available){
+            if(count == capacity){
+                throw std::out_of_range("Resampler Error: Output buffer is too small!");
+            }
+            size_t row = exact ? phase : ((uint64_t)phase*table->num_phases*2 + up)/(2*(uint64_t)up);
+            step_input[count] = position;
+            step_row[count] = row*taps;
+            ++count;
+
+            phase += down;
+            position += phase/up;
+            phase %= up;
+        }
+
+        for(int c = 0; c < num_channels; ++c){
+            kernel(history[c], rows, step_input.data(), step_row.data(), count, taps, output[c] + written);
+        }
+        written += count;
+
+        // Keep what the next window still needs
+        if(position < available){
+            for(int c = 0; c < num_channels; ++c){
+                memmove(history[c], history[c] + position, (available - position)*sizeof(float));
+            }
+            available -= position;
+        } else {
+            skip = position - available;
+            available = 0;
+        }
+    }
+    return written;
+}
+
+// Most frames process can write for input_frames frames of input
+size_t Resampler::getMaxOutput(size_t input_frames){
+    if(!table){
+        return input_frames;
+    }
+    return (size_t)((uint64_t)input_frames*table->up/table->down) + 2;
+}
+
+// Output frames between a sample going in and its filtered version coming out
+double Resampler::getLatency(){
+    if(!table){
+        return 0;
+    }
+    return (table->taps/2)*(double)table->up/table->down;
+}
+
+int Resampler::getInputRate(){
+    return input_rate;
+}
+
+int Resampler::getOutputRate(){
+    return output_rate;
+}
+
+bool Resampler::isPassthrough(){
+    return !table;
+}
+
+// Converts all of input at once into output
+void Resampler::convert(const AudioBufferView &input, int input_rate, int output_rate, AudioBuffer &output){
+    const size_t block = 65536;
+    int channels = input.getNumChannels();
+    size_t num_frames = input.getNumFrames();
+
+    Resampler r;
+    r.prepare(input_rate, output_rate, channels, (int)block);
+    if(r.isPassthrough()){
+        output.allocate(channels, num_frames);
+        output.copyFrom(input);
+        return;
+    }
+
+    // Starting with half a window of silence lines output frame 0 up with input frame 0
+    const Table &t = *r.table;
+    r.restart(t.taps/2 - 1);
+
+    size_t wanted = (size_t)(((uint64_t)num_frames*t.up + t.down - 1)/t.down);
+    output.allocate(channels, wanted);
+
+    AudioBuffer scratch(channels, r.getMaxOutput(block));
+    size_t written = 0;
+    for(size_t start = 0; start < num_frames + block && written < wanted; start += block){
+        // Once the input runs out, the last frames are still in the window
+        size_t got;
+        if(start < num_frames){
+            got = r.process(input.slice(start, std::min(block, num_frames - start)), scratch.view());
+        } else {
+            got = r.drain(scratch.view());
+        }
+        size_t n = std::min(got, wanted - written);
+        output.slice(written, n).copyFrom(scratch.slice(0, n));
+        written += n;
+    }
+}
+
+// Which kernel process uses on this CPU
+const char *Resampler::getKernelName(){
+    const char *name;
+    selectKernel(&name);
+    return name;
+}
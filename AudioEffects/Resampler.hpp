@@ -0,0 +1,115 @@
+//
+//  Resampler.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/5.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef Resampler_hpp
+#define Resampler_hpp
+
+#include <stdio.h>
+#include <memory>
+#include <vector>
+#include "AudioBuffer.hpp"
+
+/* Resampler class
+ *
+ * Converts a stream from one sample rate to another with a polyphase filter
+ *
+ * For a ratio of up/down (reduced, so 44.1k to 48k is 160/147) the
+ * Kaiser windowed sinc low pass is split into one short filter per output
+ * phase, each an inner product over the same window of input. The
+ * tables are built once per ratio and shared by every Resampler using it.
+ * Ratios with more than max_phases phases use the nearest of max_phases
+ * evenly spaced phases instead.
+ *
+ * Streaming output is delayed by a constant half the filter length, see
+ * getLatency. Resampling between equal rates passes samples through
+ * untouched.
+ */
+class Resampler {
+public:
+
+    // Default Constructor
+    Resampler();
+
+    // Sets up conversion from input_rate to output_rate for num_channels
+    // max_input is the most frames a single call to process will be given
+    void prepare(int input_rate, int output_rate, int num_channels, int max_input);
+
+    // Clears the input history, as if nothing had been processed since prepare
+    void reset();
+
+    // Consumes every frame of input and writes the frames that are ready to output
+    // output needs at least getMaxOutput(input.getNumFrames()) frames
+    //
+    // returns the number of frames written
+    size_t process(const AudioBufferView &input, const AudioBufferView &output);
+
+    // Pushes the latency's worth of silence through, to get the end of the stream out
+    // returns the number of frames written
+    size_t drain(const AudioBufferView &output);
+
+    // Most frames process can write for input_frames frames of input
+    size_t getMaxOutput(size_t input_frames);
+
+    // Output frames between a sample going in and its filtered version coming out
+    double getLatency();
+
+    int getInputRate();
+    int getOutputRate();
+
+    // True when the rates are equal and samples are copied straight through
+    bool isPassthrough();
+
+    // Converts all of input at once into output, which is reallocated
+    // The output starts at the same instant as the input, without the streaming latency,
+    // and is as long as the input
+    static void convert(const AudioBufferView &input, int input_rate, int output_rate, AudioBuffer &output);
+
+    // Which kernel process uses on this CPU, for diagnostics
+    static const char *getKernelName();
+
+protected:
+private:
+    // Phases of the ratio's filter, rows of taps coefficients
+    struct Table {
+        int up;
+        int down;
+        int taps;
+        int num_phases; // up, or max_phases when up is larger
+        std::vector<float> rows; // num_phases + 1 rows, the last is phase 0 one sample later
+    };
+
+    static const int max_phases = 1024;
+
+    // The table for up/down, built on first use and cached for the rest of the program
+    static std::shared_ptr<const Table> getTable(int up, int down);
+
+    // Empties the history and primes it with frames of silence
+    void restart(size_t frames);
+
+    // Runs num_frames frames of input through, NULL input being silence
+    size_t run(const AudioBufferView *input, size_t num_frames, const AudioBufferView &output);
+
+    int input_rate;
+    int output_rate;
+    int num_channels;
+    int max_input;
+
+    std::shared_ptr<const Table> table;
+
+    // The last taps - 1 frames of input of each channel, followed by room for max_input more
+    AudioBuffer history;
+    size_t available; // Frames of history in use
+    size_t skip; // Input frames still to drop, when the filter stepped past the end of the history
+    int phase; // Output phase within the current input frame, in [0, up)
+
+    // Per output frame of the current block, where its window starts and which row it uses
+    std::vector<size_t> step_input;
+    std::vector<size_t> step_row;
+};
+
+#endif /* Resampler_hpp */
@@ -0,0 +1,122 @@
+//
+//  RingBuffer.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/26.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef RingBuffer_hpp
+#define RingBuffer_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+/* RingBuffer class
+ *
+ * Lock-free single producer/single consumer queue of T
+ *
+ * One thread may write and one other thread may read at the same time.
+ * Neither side ever blocks or allocates: read and write move as many
+ * elements as fit and return how many that was, which makes the reading
+ * side safe to use from an audio callback.
+ *
+ * T must be trivially copyable.
+ */
+template <typename T>
+class RingBuffer {
+public:
+
+    // Constructor
+    // The capacity is rounded up to a power of two
+    RingBuffer(size_t min_capacity = 1024){
+        size_t capacity = 1;
+        while(capacity < min_capacity){
+            capacity <<= 1;
+        }
+        data.resize(capacity);
+        mask = capacity - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Copies up to count elements in, returns how many were copied
+    // Producer side only
+    size_t write(const T *in, size_t count){
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        size_t n = std::min(count, capacity() - (h - t));
+        copyIn(h, in, n);
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Copies up to count elements out, returns how many were copied
+    // Consumer side only
+    size_t read(T *out, size_t count){
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        size_t n = std::min(count, h - t);
+        copyOut(t, out, n);
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Elements waiting to be read
+    size_t readAvailable() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Room left for writing
+    size_t writeAvailable() const {
+        return capacity() - readAvailable();
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // Empties the buffer
+    // Only safe while neither side is in use
+    void clear(){
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+protected:
+private:
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // Copies n elements in at position pos, wrapping around the end
+    void copyIn(size_t pos, const T *in, size_t n){
+        size_t start = pos & mask;
+        size_t first = std::min(n, capacity() - start);
+        memcpy(&data[start], in, first*sizeof(T));
+        memcpy(&data[0], in + first, (n - first)*sizeof(T));
+    }
+
+    // Copies n elements out from position pos, wrapping around the end
+    void copyOut(size_t pos, T *out, size_t n){
+        size_t start = pos & mask;
+        size_t first = std::min(n, capacity() - start);
+        memcpy(out, &data[start], first*sizeof(T));
+        memcpy(out + first, &data[0], (n - first)*sizeof(T));
+    }
+
+    std::vector<T> data;
+    size_t mask;
+
+    // Total elements ever written and read, padded onto separate cache lines
+    // so the two threads don't fight over them
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif /* RingBuffer_hpp */
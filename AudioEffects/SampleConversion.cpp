@@ -0,0 +1,725 @@
+//
+//  SampleConversion.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/22.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "SampleConversion.hpp"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AUDIOEFFECTS_X86 1
+#include <immintrin.h>
+#endif
+
+// Runtime CPU feature checks
+bool cpuHasSSSE3(){
+#ifdef AUDIOEFFECTS_X86
+    static const bool has = __builtin_cpu_supports("ssse3");
+    return has;
+#else
+    return false;
+#endif
+}
+
+bool cpuHasAVX(){
+#ifdef AUDIOEFFECTS_X86
+    static const bool has = __builtin_cpu_supports("avx");
+    return has;
+#else
+    return false;
+#endif
+}
+
+bool cpuHasAVX2(){
+#ifdef AUDIOEFFECTS_X86
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+// ---- Scalar kernels, also used for the tails of the vector kernels
+
+static void decodeU8Scalar(const unsigned char *in, float *out, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        // Subtract one because the normalization factor maps to [0,2] and not [-1,1]
+        out[i] = uint8normalize*(float)in[i] - 1;
+    }
+}
+
+static void decodeS16Scalar(const unsigned char *in, float *out, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        int16_t temp16bit;
+        memcpy(&temp16bit, in + 2*i, 2);
+        out[i] = int16normalize*(float)temp16bit;
+    }
+}
+
+static void decodeS24Scalar(const unsigned char *in, float *out, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        out[i] = int24normalize*(float)int24to32(in + 3*i);
+    }
+}
+
+static void decodeS32Scalar(const unsigned char *in, float *out, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        int32_t temp32bit;
+        memcpy(&temp32bit, in + 4*i, 4);
+        out[i] = int32normalize*(float)temp32bit;
+    }
+}
+
+static void decodeF32(const unsigned char *in, float *out, size_t count){
+    memcpy(out, in, count*sizeof(float));
+}
+
+static void decodeF64Scalar(const unsigned char *in, float *out, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        double temp64bit;
+        memcpy(&temp64bit, in + 8*i, 8);
+        out[i] = (float)temp64bit;
+    }
+}
+
+// ---- Scalar encoders
+
+// Largest magnitudes of each output format, matching the normalizing factors used for decoding
+const float int16scale = 0x7fff;
+const float int24scale = 8388607.0f;
+const float int32scale = 2147483647.0f;
+
+// The largest float that still fits in an int32
+const float int32max = 2147483520.0f;
+
+// Clamps v to [lo, hi] and rounds it to the nearest integer, counting clipped samples
+// NaN is written as silence, lrintf would make it the most negative value
+static inline int32_t quantize(float v, float lo, float hi, uint64_t &clipped){
+    if(std::isnan(v)){
+        return 0;
+    }
+    if(v > hi){
+        v = hi;
+        ++clipped;
+    } else if(v < lo){
+        v = lo;
+        ++clipped;
+    }
+    return (int32_t)lrintf(v);
+}
+
+static uint64_t encodeS16Scalar(const float *in, const float *dither, unsigned char *out, size_t count){
+    uint64_t clipped = 0;
+    for(size_t i = 0; i < count; ++i){
+        float v = in[i]*int16scale + (dither ? dither[i] : 0.0f);
+        int16_t temp16bit = (int16_t)quantize(v, -32768.0f, int16scale, clipped);
+        memcpy(out + 2*i, &temp16bit, 2);
+    }
+    return clipped;
+}
+
+static uint64_t encodeS24Scalar(const float *in, const float *dither, unsigned char *out, size_t count){
+    uint64_t clipped = 0;
+    for(size_t i = 0; i < count; ++i){
+        float v = in[i]*int24scale + (dither ? dither[i] : 0.0f);
+        int32_t temp = quantize(v, -8388608.0f, int24scale, clipped);
+        out[3*i] = temp & 0xff;
+        out[3*i + 1] = (temp >> 8) & 0xff;
+        out[3*i + 2] = (temp >> 16) & 0xff;
+    }
+    return clipped;
+}
+
+static uint64_t encodeS32Scalar(const float *in, const float *dither, unsigned char *out, size_t count){
+    uint64_t clipped = 0;
+    for(size_t i = 0; i < count; ++i){
+        float v = in[i]*int32scale + (dither ? dither[i] : 0.0f);
+        int32_t temp32bit = quantize(v, -2147483648.0f, int32max, clipped);
+        memcpy(out + 4*i, &temp32bit, 4);
+    }
+    return clipped;
+}
+
+// Floats are written as they are, nothing is ever clipped
+static uint64_t encodeF32(const float *in, const float *, unsigned char *out, size_t count){
+    memcpy(out, in, count*sizeof(float));
+    return 0;
+}
+
+#ifdef AUDIOEFFECTS_X86
+
+// ---- SSE2 kernels, always available on x86_64
+
+__attribute__((target("sse2")))
+static void decodeU8SSE2(const unsigned char *in, float *out, size_t count){
+    const __m128 scale = _mm_set1_ps(uint8normalize);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(out + i,      _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero))), one));
+        _mm_storeu_ps(out + i + 4,  _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero))), one));
+        _mm_storeu_ps(out + i + 8,  _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero))), one));
+        _mm_storeu_ps(out + i + 12, _mm_sub_ps(_mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero))), one));
+    }
+    decodeU8Scalar(in + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeS16SSE2(const unsigned char *in, float *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int16normalize);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + 2*i));
+
+        // Put each sample in the top half of a 32 bit lane, then shift it down to sign extend
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i,     _mm_mul_ps(scale, _mm_cvtepi32_ps(lo)));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(scale, _mm_cvtepi32_ps(hi)));
+    }
+    decodeS16Scalar(in + 2*i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeS32SSE2(const unsigned char *in, float *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int32normalize);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + 4*i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(scale, _mm_cvtepi32_ps(v)));
+    }
+    decodeS32Scalar(in + 4*i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeF64SSE2(const unsigned char *in, float *out, size_t count){
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(in + 8*i)));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(in + 8*i + 16)));
+        _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+    }
+    decodeF64Scalar(in + 8*i, out + i, count - i);
+}
+
+// ---- SSSE3 kernels
+
+// Moves 4 packed 24 bit samples into the top 3 bytes of 32 bit lanes
+#define SHUFFLE_24_TO_32 -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11
+
+__attribute__((target("ssse3")))
+static void decodeS24SSSE3(const unsigned char *in, float *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int24normalize);
+    const __m128i shuffle = _mm_setr_epi8(SHUFFLE_24_TO_32);
+    size_t i = 0;
+
+    // Each load reads 16 bytes but only uses 12, stop before running off the end
+    for(; 3*i + 16 <= 3*count; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + 3*i));
+        __m128i s = _mm_srai_epi32(_mm_shuffle_epi8(v, shuffle), 8);
+        _mm_storeu_ps(out + i, _mm_mul_ps(scale, _mm_cvtepi32_ps(s)));
+    }
+    decodeS24Scalar(in + 3*i, out + i, count - i);
+}
+
+// ---- AVX2 kernels
+
+__attribute__((target("avx2")))
+static void decodeU8AVX2(const unsigned char *in, float *out, size_t count){
+    const __m256 scale = _mm256_set1_ps(uint8normalize);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_mul_ps(scale, _mm256_cvtepi32_ps(v)), one));
+    }
+    decodeU8Scalar(in + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeS16AVX2(const unsigned char *in, float *out, size_t count){
+    const __m256 scale = _mm256_set1_ps(int16normalize);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + 2*i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(v)));
+    }
+    decodeS16Scalar(in + 2*i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeS24AVX2(const unsigned char *in, float *out, size_t count){
+    const __m256 scale = _mm256_set1_ps(int24normalize);
+    const __m256i shuffle = _mm256_setr_epi8(SHUFFLE_24_TO_32, SHUFFLE_24_TO_32);
+    size_t i = 0;
+
+    // The second half is loaded from 12 bytes in, and reads 4 bytes past its last sample
+    for(; 3*i + 28 <= 3*count; i += 8){
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + 3*i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + 3*i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m256i s = _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(s)));
+    }
+    decodeS24Scalar(in + 3*i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeS32AVX2(const unsigned char *in, float *out, size_t count){
+    const __m256 scale = _mm256_set1_ps(int32normalize);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + 4*i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(scale, _mm256_cvtepi32_ps(v)));
+    }
+    decodeS32Scalar(in + 4*i, out + i, count - i);
+}
+
+// ---- Vector encoders
+
+// Scales 4 samples, adds dither and clamps them, counting clipped samples
+// NaNs are zeroed first, max would otherwise turn them into lo
+__attribute__((target("sse2")))
+static inline __m128 scaleAndClamp(const float *in, const float *dither, __m128 scale, __m128 lo, __m128 hi, uint64_t &clipped){
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(in), scale);
+    if(dither){
+        v = _mm_add_ps(v, _mm_loadu_ps(dither));
+    }
+    v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+    __m128 out_of_range = _mm_or_ps(_mm_cmpgt_ps(v, hi), _mm_cmplt_ps(v, lo));
+    clipped += __builtin_popcount(_mm_movemask_ps(out_of_range));
+    return _mm_min_ps(_mm_max_ps(v, lo), hi);
+}
+
+__attribute__((target("sse2")))
+static uint64_t encodeS16SSE2(const float *in, const float *dither, unsigned char *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int16scale);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(int16scale);
+    uint64_t clipped = 0;
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128 a = scaleAndClamp(in + i, dither ? dither + i : NULL, scale, lo, hi, clipped);
+        __m128 b = scaleAndClamp(in + i + 4, dither ? dither + i + 4 : NULL, scale, lo, hi, clipped);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + 2*i), packed);
+    }
+    return clipped + encodeS16Scalar(in + i, dither ? dither + i : NULL, out + 2*i, count - i);
+}
+
+__attribute__((target("sse2")))
+static uint64_t encodeS32SSE2(const float *in, const float *dither, unsigned char *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int32scale);
+    const __m128 lo = _mm_set1_ps(-2147483648.0f);
+    const __m128 hi = _mm_set1_ps(int32max);
+    uint64_t clipped = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 a = scaleAndClamp(in + i, dither ? dither + i : NULL, scale, lo, hi, clipped);
+        _mm_storeu_si128((__m128i *)(out + 4*i), _mm_cvtps_epi32(a));
+    }
+    return clipped + encodeS32Scalar(in + i, dither ? dither + i : NULL, out + 4*i, count - i);
+}
+
+// Moves the low 3 bytes of 4 32 bit lanes into 12 packed bytes
+#define SHUFFLE_32_TO_24 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+
+__attribute__((target("ssse3")))
+static uint64_t encodeS24SSSE3(const float *in, const float *dither, unsigned char *out, size_t count){
+    const __m128 scale = _mm_set1_ps(int24scale);
+    const __m128 lo = _mm_set1_ps(-8388608.0f);
+    const __m128 hi = _mm_set1_ps(int24scale);
+    const __m128i shuffle = _mm_setr_epi8(SHUFFLE_32_TO_24);
+    uint64_t clipped = 0;
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 a = scaleAndClamp(in + i, dither ? dither + i : NULL, scale, lo, hi, clipped);
+        __m128i packed = _mm_shuffle_epi8(_mm_cvtps_epi32(a), shuffle);
+
+        // Store exactly 12 bytes so nothing past the end is touched
+        _mm_storel_epi64((__m128i *)(out + 3*i), packed);
+        int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        memcpy(out + 3*i + 8, &last, 4);
+    }
+    return clipped + encodeS24Scalar(in + i, dither ? dither + i : NULL, out + 3*i, count - i);
+}
+
+#endif /* AUDIOEFFECTS_X86 */
+
+// Picks the fastest kernel for the format described by info on this CPU
+SampleDecoder selectDecoder(const WavFormatInfo &info){
+    SampleDecoder d;
+    d.bytes_per_sample = info.bits_per_sample/8;
+
+    if((WavFormat)info.format == WavFormat::IEEEFloatingPoint){
+        if(info.bits_per_sample == 32){
+            d.decode = decodeF32;
+            d.name = "f32";
+        } else {
+            d.decode = decodeF64Scalar;
+            d.name = "f64 scalar";
+#ifdef AUDIOEFFECTS_X86
+            d.decode = decodeF64SSE2;
+            d.name = "f64 sse2";
+#endif
+        }
+        return d;
+    }
+
+    switch(info.bits_per_sample){
+        case 8:
+            d.decode = decodeU8Scalar;
+            d.name = "u8 scalar";
+#ifdef AUDIOEFFECTS_X86
+            d.decode = cpuHasAVX2() ? decodeU8AVX2 : decodeU8SSE2;
+            d.name = cpuHasAVX2() ? "u8 avx2" : "u8 sse2";
+#endif
+            break;
+        case 16:
+            d.decode = decodeS16Scalar;
+            d.name = "s16 scalar";
+#ifdef AUDIOEFFECTS_X86
+            d.decode = cpuHasAVX2() ? decodeS16AVX2 : decodeS16SSE2;
+            d.name = cpuHasAVX2() ? "s16 avx2" : "s16 sse2";
+#endif
+            break;
+        case 24:
+            d.decode = decodeS24Scalar;
+            d.name = "s24 scalar";
+#ifdef AUDIOEFFECTS_X86
+            if(cpuHasAVX2()){
+                d.decode = decodeS24AVX2;
+                d.name = "s24 avx2";
+            } else if(cpuHasSSSE3()){
+                d.decode = decodeS24SSSE3;
+                d.name = "s24 ssse3";
+            }
+#endif
+            break;
+        default:
+            d.decode = decodeS32Scalar;
+            d.name = "s32 scalar";
+#ifdef AUDIOEFFECTS_X86
+            d.decode = cpuHasAVX2() ? decodeS32AVX2 : decodeS32SSE2;
+            d.name = cpuHasAVX2() ? "s32 avx2" : "s32 sse2";
+#endif
+            break;
+    }
+    return d;
+}
+
+// Picks the fastest kernel for writing encoding on this CPU
+SampleEncoder selectEncoder(SampleEncoding encoding){
+    SampleEncoder e;
+    e.bytes_per_sample = encodingBitsPerSample(encoding)/8;
+
+    switch(encoding){
+        case SampleEncoding::Int16:
+            e.encode = encodeS16Scalar;
+            e.name = "s16 scalar";
+#ifdef AUDIOEFFECTS_X86
+            e.encode = encodeS16SSE2;
+            e.name = "s16 sse2";
+#endif
+            break;
+        case SampleEncoding::Int24:
+            e.encode = encodeS24Scalar;
+            e.name = "s24 scalar";
+#ifdef AUDIOEFFECTS_X86
+            if(cpuHasSSSE3()){
+                e.encode = encodeS24SSSE3;
+                e.name = "s24 ssse3";
+            }
+#endif
+            break;
+        case SampleEncoding::Int32:
+            e.encode = encodeS32Scalar;
+            e.name = "s32 scalar";
+#ifdef AUDIOEFFECTS_X86
+            e.encode = encodeS32SSE2;
+            e.name = "s32 sse2";
+#endif
+            break;
+        case SampleEncoding::Float32:
+            e.encode = encodeF32;
+            e.name = "f32";
+            break;
+    }
+    return e;
+}
+
+// The fmt chunk fields for writing encoding
+uint16_t encodingFormatTag(SampleEncoding encoding){
+    if(encoding == SampleEncoding::Float32){
+        return (uint16_t)WavFormat::IEEEFloatingPoint;
+    }
+    return (uint16_t)WavFormat::PulseCodeModulation;
+}
+
+uint16_t encodingBitsPerSample(SampleEncoding encoding){
+    switch(encoding){
+        case SampleEncoding::Int16:
+            return 16;
+        case SampleEncoding::Int24:
+            return 24;
+        default:
+            return 32;
+    }
+}
+
+// ---- Interleaving kernels
+//
+// One kernel per common layout: mono, stereo, quad, 5.1 and 7.1
+// Everything else goes through the generic loop, with the channel count
+// fixed at compile time for the small layouts so the inner loop unrolls
+
+template<int N>
+static void deinterleaveFixed(const float *in, const AudioBufferView &out){
+    size_t frames = out.getNumFrames();
+    for(int channel = 0; channel < N; ++channel){
+        const float *src = in + channel;
+        float *dst = out[channel];
+        for(size_t frame = 0; frame < frames; ++frame, src += N){
+            dst[frame] = *src;
+        }
+    }
+}
+
+template<int N>
+static void interleaveFixed(const AudioBufferView &in, float *out){
+    size_t frames = in.getNumFrames();
+    for(int channel = 0; channel < N; ++channel){
+        const float *src = in[channel];
+        float *dst = out + channel;
+        for(size_t frame = 0; frame < frames; ++frame, dst += N){
+            *dst = src[frame];
+        }
+    }
+}
+
+static void deinterleaveGeneric(const float *in, const AudioBufferView &out){
+    int num_channels = out.getNumChannels();
+    size_t frames = out.getNumFrames();
+    for(int channel = 0; channel < num_channels; ++channel){
+        const float *src = in + channel;
+        float *dst = out[channel];
+        for(size_t frame = 0; frame < frames; ++frame, src += num_channels){
+            dst[frame] = *src;
+        }
+    }
+}
+
+static void interleaveGeneric(const AudioBufferView &in, float *out){
+    int num_channels = in.getNumChannels();
+    size_t frames = in.getNumFrames();
+    for(int channel = 0; channel < num_channels; ++channel){
+        const float *src = in[channel];
+        float *dst = out + channel;
+        for(size_t frame = 0; frame < frames; ++frame, dst += num_channels){
+            *dst = src[frame];
+        }
+    }
+}
+
+static void deinterleaveStereo(const float *in, const AudioBufferView &out){
+    size_t frames = out.getNumFrames();
+    float *left = out[0];
+    float *right = out[1];
+    size_t frame = 0;
+#ifdef __SSE2__
+    for(; frame + 4 <= frames; frame += 4){
+        __m128 a = _mm_loadu_ps(in + 2*frame);
+        __m128 b = _mm_loadu_ps(in + 2*frame + 4);
+        _mm_storeu_ps(left + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#endif
+    for(; frame < frames; ++frame){
+        left[frame] = in[2*frame];
+        right[frame] = in[2*frame + 1];
+    }
+}
+
+static void interleaveStereo(const AudioBufferView &in, float *out){
+    size_t frames = in.getNumFrames();
+    const float *left = in[0];
+    const float *right = in[1];
+    size_t frame = 0;
+#ifdef __SSE2__
+    for(; frame + 4 <= frames; frame += 4){
+        __m128 l = _mm_loadu_ps(left + frame);
+        __m128 r = _mm_loadu_ps(right + frame);
+        _mm_storeu_ps(out + 2*frame, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + 2*frame + 4, _mm_unpackhi_ps(l, r));
+    }
+#endif
+    for(; frame < frames; ++frame){
+        out[2*frame] = left[frame];
+        out[2*frame + 1] = right[frame];
+    }
+}
+
+#ifdef __SSE2__
+// Transposes 4 frames of channels [first, first + 4) of an N channel stream
+// between interleaved and planar, 4x4 floats at a time
+template<int N>
+static inline void deinterleaveQuad(const float *in, float *c0, float *c1, float *c2, float *c3){
+    __m128 r0 = _mm_loadu_ps(in);
+    __m128 r1 = _mm_loadu_ps(in + N);
+    __m128 r2 = _mm_loadu_ps(in + 2*N);
+    __m128 r3 = _mm_loadu_ps(in + 3*N);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(c0, r0);
+    _mm_storeu_ps(c1, r1);
+    _mm_storeu_ps(c2, r2);
+    _mm_storeu_ps(c3, r3);
+}
+
+template<int N>
+static inline void interleaveQuad(const float *c0, const float *c1, const float *c2, const float *c3, float *out){
+    __m128 r0 = _mm_loadu_ps(c0);
+    __m128 r1 = _mm_loadu_ps(c1);
+    __m128 r2 = _mm_loadu_ps(c2);
+    __m128 r3 = _mm_loadu_ps(c3);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(out, r0);
+    _mm_storeu_ps(out + N, r1);
+    _mm_storeu_ps(out + 2*N, r2);
+    _mm_storeu_ps(out + 3*N, r3);
+}
+#endif
+
+// Quad and 7.1, whole 4x4 blocks
+template<int N>
+static void deinterleaveBlocks(const float *in, const AudioBufferView &out){
+    size_t frames = out.getNumFrames();
+    size_t frame = 0;
+#ifdef __SSE2__
+    for(; frame + 4 <= frames; frame += 4){
+        for(int channel = 0; channel < N; channel += 4){
+            deinterleaveQuad<N>(in + N*frame + channel,
+                                out[channel] + frame, out[channel + 1] + frame,
+                                out[channel + 2] + frame, out[channel + 3] + frame);
+        }
+    }
+#endif
+    deinterleaveFixed<N>(in + N*frame, out.slice(frame, frames - frame));
+}
+
+template<int N>
+static void interleaveBlocks(const AudioBufferView &in, float *out){
+    size_t frames = in.getNumFrames();
+    size_t frame = 0;
+#ifdef __SSE2__
+    for(; frame + 4 <= frames; frame += 4){
+        for(int channel = 0; channel < N; channel += 4){
+            interleaveQuad<N>(in[channel] + frame, in[channel + 1] + frame,
+                              in[channel + 2] + frame, in[channel + 3] + frame,
+                              out + N*frame + channel);
+        }
+    }
+#endif
+    interleaveFixed<N>(in.slice(frame, frames - frame), out + N*frame);
+}
+
+// 5.1, a 4x4 block for the front channels plus a pair for LFE and surround
+static void deinterleave51(const float *in, const AudioBufferView &out){
+    size_t frames = out.getNumFrames();
+    size_t frame = 0;
+#ifdef __SSE2__
+    float *lfe = out[4];
+    float *surround = out[5];
+    for(; frame + 4 <= frames; frame += 4){
+        const float *src = in + 6*frame;
+        deinterleaveQuad<6>(src, out[0] + frame, out[1] + frame, out[2] + frame, out[3] + frame);
+
+        __m128 lo = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(src + 4)), (const __m64 *)(src + 10));
+        __m128 hi = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(src + 16)), (const __m64 *)(src + 22));
+        _mm_storeu_ps(lfe + frame, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(surround + frame, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#endif
+    deinterleaveFixed<6>(in + 6*frame, out.slice(frame, frames - frame));
+}
+
+static void interleave51(const AudioBufferView &in, float *out){
+    size_t frames = in.getNumFrames();
+    size_t frame = 0;
+#ifdef __SSE2__
+    const float *lfe = in[4];
+    const float *surround = in[5];
+    for(; frame + 4 <= frames; frame += 4){
+        float *dst = out + 6*frame;
+        __m128 a = _mm_loadu_ps(lfe + frame);
+        __m128 b = _mm_loadu_ps(surround + frame);
+        __m128 lo = _mm_unpacklo_ps(a, b);
+        __m128 hi = _mm_unpackhi_ps(a, b);
+        interleaveQuad<6>(in[0] + frame, in[1] + frame, in[2] + frame, in[3] + frame, dst);
+        _mm_storel_pi((__m64 *)(dst + 4), lo);
+        _mm_storeh_pi((__m64 *)(dst + 10), lo);
+        _mm_storel_pi((__m64 *)(dst + 16), hi);
+        _mm_storeh_pi((__m64 *)(dst + 22), hi);
+    }
+#endif
+    interleaveFixed<6>(in.slice(frame, frames - frame), out + 6*frame);
+}
+
+// Splits interleaved frames into separate channel buffers
+void deinterleave(const float *in, const AudioBufferView &out){
+    switch(out.getNumChannels()){
+        case 1:
+            memcpy(out[0], in, out.getNumFrames()*sizeof(float));
+            break;
+        case 2:
+            deinterleaveStereo(in, out);
+            break;
+        case 3:
+            deinterleaveFixed<3>(in, out);
+            break;
+        case 4:
+            deinterleaveBlocks<4>(in, out);
+            break;
+        case 6:
+            deinterleave51(in, out);
+            break;
+        case 8:
+            deinterleaveBlocks<8>(in, out);
+            break;
+        default:
+            deinterleaveGeneric(in, out);
+    }
+}
+
+// Merges separate channel buffers into interleaved frames
+void interleave(const AudioBufferView &in, float *out){
+    switch(in.getNumChannels()){
+        case 1:
+            memcpy(out, in[0], in.getNumFrames()*sizeof(float));
+            break;
+        case 2:
+            interleaveStereo(in, out);
+            break;
+        case 3:
+            interleaveFixed<3>(in, out);
+            break;
+        case 4:
+            interleaveBlocks<4>(in, out);
+            break;
+        case 6:
+            interleave51(in, out);
+            break;
+        case 8:
+            interleaveBlocks<8>(in, out);
+            break;
+        default:
+            interleaveGeneric(in, out);
+    }
+}
@@ -0,0 +1,78 @@
+//
+//  SampleConversion.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/22.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef SampleConversion_hpp
+#define SampleConversion_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include "AudioBuffer.hpp"
+#include "WavCommon.hpp"
+
+/* Sample conversion kernels
+ *
+ * Bulk conversion between floats and the sample formats stored in .wav files
+ *
+ * Every format has a scalar kernel, and SSE2/SSSE3/AVX2 kernels where the
+ * CPU supports them. The kernel is picked once per file by selectDecoder
+ * or selectEncoder, so the inner loops never branch on the format.
+ */
+
+// Sample formats that can be written
+enum class SampleEncoding {
+    Int16,
+    Int24,
+    Int32,
+    Float32
+};
+
+// Converts count packed, interleaved samples into count floats
+typedef void (*DecodeFunction)(const unsigned char *in, float *out, size_t count);
+
+struct SampleDecoder {
+    DecodeFunction decode;
+    int bytes_per_sample;
+    const char *name; // Which kernel was picked, for diagnostics
+};
+
+// Picks the fastest kernel for the format described by info on this CPU
+// info must be decodable (see isDecodable)
+SampleDecoder selectDecoder(const WavFormatInfo &info);
+
+// Converts count interleaved floats into packed samples
+//
+// dither holds count values (in units of the output LSB) added before rounding, or is NULL
+// returns the number of samples that had to be clipped to fit the output range
+typedef uint64_t (*EncodeFunction)(const float *in, const float *dither, unsigned char *out, size_t count);
+
+struct SampleEncoder {
+    EncodeFunction encode;
+    int bytes_per_sample;
+    const char *name; // Which kernel was picked, for diagnostics
+};
+
+// Picks the fastest kernel for writing encoding on this CPU
+SampleEncoder selectEncoder(SampleEncoding encoding);
+
+// The fmt chunk fields for writing encoding
+uint16_t encodingFormatTag(SampleEncoding encoding);
+uint16_t encodingBitsPerSample(SampleEncoding encoding);
+
+// Splits out.getNumFrames() interleaved frames into the channels of out
+// Mono, stereo, quad, 5.1 and 7.1 have their own vector kernels
+void deinterleave(const float *in, const AudioBufferView &out);
+
+// Merges the channels of in into interleaved frames
+void interleave(const AudioBufferView &in, float *out);
+
+// Runtime CPU feature checks, false on non x86 CPUs
+bool cpuHasSSSE3();
+bool cpuHasAVX();
+bool cpuHasAVX2();
+
+#endif /* SampleConversion_hpp */
@@ -0,0 +1,171 @@
+//
+//  SegmentParallelExecutor.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/2.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "SegmentParallelExecutor.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Once a segment's incoming state contributes less than this to a sample, the fix up pass stops
+static const float fix_up_cutoff = 1e-9f;
+
+// Constructor
+SegmentParallelExecutor::SegmentParallelExecutor(ThreadPool &p) : pool(p){
+    effect = NULL;
+    num_segments = 0;
+}
+
+// Processes buffer with effect in place
+void SegmentParallelExecutor::process(LinearRecursiveEffect &ae, const AudioBufferView &in){
+    size_t num_frames = in.getNumFrames();
+    int num_channels = in.getNumChannels();
+    int segments = (int)std::min((size_t)pool.getNumThreads(), num_frames/min_segment_frames);
+    if(segments < 2){
+        ae.process(in);
+        return;
+    }
+
+    effect = &ae;
+    buffer = in;
+    num_segments = segments;
+
+    // Only grows, so repeated calls with the same layout don't allocate
+    if((int)a_blocks.size() < segments || a_blocks[0].getNumChannels() != num_channels){
+        a_blocks.clear();
+        b_blocks.clear();
+        a_blocks.resize(segments);
+        b_blocks.resize(segments);
+        for(int s = 0; s < segments; ++s){
+            a_blocks[s].allocate(num_channels, block_frames);
+            b_blocks[s].allocate(num_channels, block_frames);
+        }
+    }
+    products.resize((size_t)segments*num_channels);
+    ends.resize((size_t)segments*num_channels);
+    carries.resize((size_t)segments*num_channels);
+
+    starts.resize(segments + 1);
+    for(int s = 0; s <= segments; ++s){
+        starts[s] = (size_t)((double)num_frames*s/segments);
+    }
+    for(int s = 0; s < segments; ++s){
+        effect->beginSegment(s, starts[s + 1] - starts[s]);
+    }
+    for(int channel = 0; channel < num_channels; ++channel){
+        carries[channel] = effect->getOutputState(channel);
+    }
+
+    pool.run(&SegmentParallelExecutor::filterSegment, this, segments);
+
+    // Carry the true state through the segments in order
+    for(int s = 1; s < segments; ++s){
+        for(int channel = 0; channel < num_channels; ++channel){
+            size_t i = (size_t)s*num_channels + channel;
+            carries[i] = ends[i - num_channels];
+            ends[i] += products[i]*carries[i];
+        }
+    }
+
+    // The first segment already started from the right state
+    pool.run(&SegmentParallelExecutor::fixUpSegment, this, segments);
+
+    effect->endSegments(&ends[(size_t)(segments - 1)*num_channels]);
+}
+
+// Prepares and resets effect, then processes the whole of buffer
+void SegmentParallelExecutor::apply(LinearRecursiveEffect &ae, const AudioBufferView &in, int rate){
+    ae.prepare(rate, block_frames, in.getNumChannels());
+    ae.reset();
+    process(ae, in);
+}
+
+// Filters one segment starting from y = 0, or the effect's state for the first one
+void SegmentParallelExecutor::filterSegment(void *context, int s){
+    SegmentParallelExecutor *ex = static_cast<SegmentParallelExecutor *>(context);
+    int num_channels = ex->buffer.getNumChannels();
+    float *product = &ex->products[(size_t)s*num_channels];
+    float *y = &ex->ends[(size_t)s*num_channels];
+    for(int channel = 0; channel < num_channels; ++channel){
+        product[channel] = 1.0f;
+        y[channel] = (s == 0) ? ex->carries[channel] : 0.0f;
+    }
+
+    size_t begin = ex->starts[s];
+    size_t end = ex->starts[s + 1];
+    for(size_t start = begin; start < end; start += block_frames){
+        size_t n = std::min((size_t)block_frames, end - start);
+        AudioBufferView x = ex->buffer.slice(start, n);
+        AudioBufferView a = ex->a_blocks[s].slice(0, n);
+        AudioBufferView b = ex->b_blocks[s].slice(0, n);
+        ex->effect->coefficients(s, start - begin, x, a, b);
+
+        for(int channel = 0; channel < num_channels; ++channel){
+            const float *ac = a[channel];
+            const float *bc = b[channel];
+            float *out = x[channel];
+            float yc = y[channel];
+            float pc = product[channel];
+            for(size_t i = 0; i < n; ++i){
+                yc = ac[i]*yc + bc[i];
+                out[i] = yc;
+                pc *= ac[i];
+            }
+            y[channel] = yc;
+            product[channel] = pc;
+        }
+    }
+}
+
+// Adds the incoming state's contribution to one segment, until it has decayed away
+void SegmentParallelExecutor::fixUpSegment(void *context, int s){
+    if(s == 0){
+        return;
+    }
+
+    SegmentParallelExecutor *ex = static_cast<SegmentParallelExecutor *>(context);
+    int num_channels = ex->buffer.getNumChannels();
+    const float *carry = &ex->carries[(size_t)s*num_channels];
+
+    // Running product of a for each channel, 0 once the channel is done
+    // The products from the first pass aren't needed any more, so they're reused
+    float *running = &ex->products[(size_t)s*num_channels];
+    int remaining = 0;
+    for(int channel = 0; channel < num_channels; ++channel){
+        running[channel] = (carry[channel] != 0.0f) ? 1.0f : 0.0f;
+        remaining += (carry[channel] != 0.0f);
+    }
+
+    size_t begin = ex->starts[s];
+    size_t end = ex->starts[s + 1];
+    for(size_t start = begin; start < end && remaining > 0; start += block_frames){
+        size_t n = std::min((size_t)block_frames, end - start);
+        AudioBufferView x = ex->buffer.slice(start, n);
+        AudioBufferView a = ex->a_blocks[s].slice(0, n);
+
+        // Only a is needed, b comes out wrong since the input has been overwritten
+        ex->effect->coefficients(s, start - begin, x, a, ex->b_blocks[s].slice(0, n));
+
+        for(int channel = 0; channel < num_channels; ++channel){
+            if(running[channel] == 0.0f){
+                continue;
+            }
+            const float *ac = a[channel];
+            float *out = x[channel];
+            float c = carry[channel];
+            float p = running[channel];
+            for(size_t i = 0; i < n; ++i){
+                p *= ac[i];
+                out[i] += p*c;
+            }
+            if(fabsf(p*c) < fix_up_cutoff){
+                p = 0.0f;
+                --remaining;
+            }
+            running[channel] = p;
+        }
+    }
+}
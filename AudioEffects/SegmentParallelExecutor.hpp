@@ -0,0 +1,82 @@
+//
+//  SegmentParallelExecutor.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/2.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef SegmentParallelExecutor_hpp
+#define SegmentParallelExecutor_hpp
+
+#include <stdio.h>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "LinearRecursiveEffect.hpp"
+#include "ThreadPool.hpp"
+
+/* SegmentParallelExecutor class
+ *
+ * Runs a LinearRecursiveEffect over one long buffer with the time axis
+ * split across a ThreadPool, so even a single channel uses every core
+ *
+ * The buffer is cut into one segment per thread and processed in three passes:
+ *  1. Every segment is filtered at the same time starting from y = 0,
+ *     keeping the product of its a coefficients
+ *  2. The true state at the end of each segment is carried through the
+ *     segments in order, y_end = z_end + A*y_end_before
+ *  3. Every segment adds its incoming state's contribution, prod(a)*y,
+ *     at the same time. That contribution decays, so the pass stops as
+ *     soon as it drops below fix_up_cutoff
+ *
+ * The recurrence is evaluated as a*y + b rather than in the effect's own
+ * form, so the result isn't bit identical to process, but it stays within
+ * 1e-6 of it for full scale signals.
+ *
+ * Buffers shorter than two segments of min_segment_frames are processed
+ * serially with process.
+ */
+class SegmentParallelExecutor {
+public:
+
+    // Shortest segment worth its own thread
+    static const size_t min_segment_frames = 1 << 16;
+
+    // Frames of coefficients worked on at once
+    static const int block_frames = 4096;
+
+    // Constructor
+    // pool must outlive the executor
+    SegmentParallelExecutor(ThreadPool &pool);
+
+    // Processes buffer with effect in place, carrying on from the effect's current state
+    void process(LinearRecursiveEffect &effect, const AudioBufferView &buffer);
+
+    // Prepares and resets effect, then processes the whole of buffer
+    void apply(LinearRecursiveEffect &effect, const AudioBufferView &buffer, int sample_rate);
+
+protected:
+private:
+    // The passes, called by the pool once per segment
+    static void filterSegment(void *context, int index);
+    static void fixUpSegment(void *context, int index);
+
+    ThreadPool &pool;
+
+    // The current process call
+    LinearRecursiveEffect *effect;
+    AudioBufferView buffer;
+    int num_segments;
+    std::vector<size_t> starts; // Frame each segment starts at, plus the end of the buffer
+
+    // Per segment scratch, reused between calls
+    std::vector<AudioBuffer> a_blocks;
+    std::vector<AudioBuffer> b_blocks;
+
+    // Per segment and channel, index segment*num_channels + channel
+    std::vector<float> products; // Product of a over the segment
+    std::vector<float> ends; // y at the end of the segment
+    std::vector<float> carries; // True y just before the segment
+};
+
+#endif /* SegmentParallelExecutor_hpp */
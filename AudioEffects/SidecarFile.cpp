@@ -0,0 +1,338 @@
+//
+//  SidecarFile.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/11.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "SidecarFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes before the samples, a page so the samples start page aligned in the mapping
+static const size_t header_block = 4096;
+
+static const char sidecar_magic[8] = {'A', 'E', 'P', 'L', 'A', 'N', 'A', 'R'};
+static const uint32_t sidecar_version = 2;
+
+// Layout of the header, every field in the byte order of the machine that wrote it
+struct SidecarHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size; // Bytes before the samples
+    uint16_t format; // Of the source, so it can be saved the way it came in
+    uint16_t num_channels;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint64_t num_frames;
+    uint64_t stride; // Floats from the start of one channel to the next
+    uint64_t overview_offset; // Bytes from the start of the file, 0 if there is no overview
+    uint64_t num_overview; // Points per channel
+    uint32_t overview_frames;
+    uint32_t source_modified_nanoseconds;
+    uint64_t source_size;
+    int64_t source_modified;
+    uint64_t source_checksum;
+    uint64_t checksum; // Of every field above
+};
+
+// FNV-1a, continuing from hash
+static uint64_t fnv1a(const unsigned char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL){
+    for(size_t i = 0; i < size; ++i){
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t headerChecksum(const SidecarHeader &h){
+    return fnv1a((const unsigned char *)&h, offsetof(SidecarHeader, checksum));
+}
+
+// Sets/Resets all fields to zero
+void SidecarFile::init(){
+    filename.clear();
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+}
+
+// Default Constructor
+SidecarFile::SidecarFile(){
+    init();
+}
+
+// Constructor
+// Maps the specified sidecar
+SidecarFile::SidecarFile(std::string path){
+    init();
+    open(path);
+}
+
+// Destructor
+// Unmaps the file
+SidecarFile::~SidecarFile(){
+    close();
+}
+
+// Unmap the current file
+void SidecarFile::close(){
+    if(map){
+        munmap(map, map_size);
+    }
+    init();
+}
+
+// Map a new sidecar, unmapping the old one if necessary
+// Everything the header says is checked against the size of the file before it's trusted
+void SidecarFile::open(std::string path){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("SidecarFile Error: Could not open " + path + ": " + strerror(errno) + "!");
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < header_block){
+        ::close(fd);
+        throw std::runtime_error("SidecarFile Error: " + path + " is not a sidecar!");
+    }
+
+    // Private and writable, so the samples can be changed in memory without touching the file
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if(m == MAP_FAILED){
+        throw std::runtime_error("SidecarFile Error: Could not map " + path + ": " + strerror(errno) + "!");
+    }
+    map = (unsigned char *)m;
+    map_size = (size_t)st.st_size;
+
+    const SidecarHeader *h = (const SidecarHeader *)map;
+    const size_t floats_per_block = AudioBuffer::alignment/sizeof(float);
+    bool valid = memcmp(h->magic, sidecar_magic, sizeof(sidecar_magic)) == 0 &&
+                 h->version == sidecar_version && h->checksum == headerChecksum(*h) &&
+                 h->header_size == header_block && h->num_channels > 0 &&
+                 h->stride >= h->num_frames && h->stride%floats_per_block == 0 &&
+                 h->stride <= (map_size - header_block)/sizeof(float)/h->num_channels;
+    if(valid && h->overview_offset){
+        uint64_t overview_bytes = (uint64_t)h->num_channels*h->num_overview*2*sizeof(float);
+        valid = h->overview_frames > 0 && h->overview_offset <= map_size &&
+                overview_bytes <= map_size - h->overview_offset;
+    }
+    if(!valid){
+        close();
+        throw std::runtime_error("SidecarFile Error: " + path + " is not a sidecar or is damaged!");
+    }
+
+    header = h;
+    unsigned long i = path.rfind('/');
+    filename = (i != std::string::npos) ? path.substr(i+1) : path;
+}
+
+// Writes samples to a sidecar at path
+// Written next to it first, then renamed over it
+void SidecarFile::write(std::string path, const AudioBufferView &samples, const WavFormatInfo &format,
+                        std::string source_path, int overview_frames){
+    int num_channels = samples.getNumChannels();
+    size_t num_frames = samples.getNumFrames();
+    if(num_channels <= 0 || num_channels > 0xffff){
+        throw std::invalid_argument("SidecarFile Error: Can't write a sidecar without channels!");
+    }
+
+    SidecarHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, sidecar_magic, sizeof(sidecar_magic));
+    h.version = sidecar_version;
+    h.header_size = header_block;
+    h.format = format.format;
+    h.num_channels = (uint16_t)num_channels;
+    h.block_align = format.block_align;
+    h.bits_per_sample = format.bits_per_sample;
+    h.sample_rate = format.sample_rate;
+    h.byte_rate = format.byte_rate;
+    h.num_frames = num_frames;
+
+    // Channels padded the same way AudioBuffer pads them
+    const size_t floats_per_block = AudioBuffer::alignment/sizeof(float);
+    h.stride = std::max((num_frames + floats_per_block - 1)/floats_per_block*floats_per_block, floats_per_block);
+
+    if(overview_frames > 0){
+        h.overview_frames = overview_frames;
+        h.num_overview = (num_frames + overview_frames - 1)/overview_frames;
+        h.overview_offset = header_block + h.stride*num_channels*sizeof(float);
+    }
+
+    if(!source_path.empty()){
+        FileStamp stamp;
+        if(!getFileStamp(source_path, stamp)){
+            throw std::runtime_error("SidecarFile Error: Could not open " + source_path + "!");
+        }
+        h.source_size = stamp.size;
+        h.source_modified = stamp.modified;
+        h.source_modified_nanoseconds = stamp.modified_nanoseconds;
+        h.source_checksum = checksumFile(source_path);
+    }
+    h.checksum = headerChecksum(h);
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if(!out){
+            throw std::runtime_error("SidecarFile Error: Couldn't write " + temporary + "!");
+        }
+
+        std::vector<char> zeros(std::max(header_block, (size_t)AudioBuffer::alignment), 0);
+        out.write((const char *)&h, sizeof(h));
+        out.write(zeros.data(), header_block - sizeof(h));
+        for(int c = 0; c < num_channels; ++c){
+            out.write((const char *)samples[c], num_frames*sizeof(float));
+            out.write(zeros.data(), (h.stride - num_frames)*sizeof(float));
+        }
+
+        // Peak then RMS of each block, channel by channel
+        std::vector<float> levels(2*h.num_overview);
+        for(int c = 0; c < num_channels && overview_frames > 0; ++c){
+            const float *x = samples[c];
+            for(size_t b = 0; b < h.num_overview; ++b){
+                size_t begin = b*overview_frames;
+                size_t end = std::min(num_frames, begin + overview_frames);
+                float peak = 0.0f;
+                double squares = 0.0;
+                for(size_t n = begin; n < end; ++n){
+                    peak = std::max(peak, fabsf(x[n]));
+                    squares += (double)x[n]*x[n];
+                }
+                levels[2*b] = peak;
+                levels[2*b + 1] = (float)sqrt(squares/(end - begin));
+            }
+            out.write((const char *)levels.data(), levels.size()*sizeof(float));
+        }
+
+        if(!out.flush()){
+            throw std::runtime_error("SidecarFile Error: Couldn't write " + temporary + "!");
+        }
+    }
+    if(rename(temporary.c_str(), path.c_str()) != 0){
+        remove(temporary.c_str());
+        throw std::runtime_error("SidecarFile Error: Couldn't replace " + path + "!");
+    }
+}
+
+// Where the sidecar of the wav file at source_path goes
+std::string SidecarFile::pathFor(const std::string &source_path){
+    return source_path + ".planar";
+}
+
+// 64 bit FNV-1a of every byte of the file at path
+uint64_t SidecarFile::checksumFile(const std::string &path){
+    std::ifstream in(path, std::ios::binary);
+    if(!in){
+        throw std::runtime_error("SidecarFile Error: Could not open " + path + "!");
+    }
+    std::vector<char> chunk(1 << 20);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while(in){
+        in.read(chunk.data(), chunk.size());
+        hash = fnv1a((const unsigned char *)chunk.data(), (size_t)in.gcount(), hash);
+    }
+    return hash;
+}
+
+// True if the wav file at source_path is still the one the sidecar was made from
+bool SidecarFile::matchesSource(const std::string &source_path, bool verify){
+    FileStamp stamp;
+    if(!header || !getFileStamp(source_path, stamp)){
+        return false;
+    }
+    if(!compareStamps(stamp, getSourceStamp())){
+        return false;
+    }
+    return !verify || checksumFile(source_path) == header->source_checksum;
+}
+
+// View of every sample, inside the mapping
+AudioBufferView SidecarFile::getData(){
+    if(!header){
+        return AudioBufferView();
+    }
+    return AudioBufferView((float *)(map + header->header_size), header->num_channels,
+                           header->num_frames, header->stride);
+}
+
+// Peak and RMS of every block of channel, interleaved
+const float *SidecarFile::getOverview(int channel){
+    if(!header || !header->overview_offset){
+        return NULL;
+    }
+    if(channel < 0 || channel >= header->num_channels){
+        throw std::out_of_range("SidecarFile Error: Tried to access a channel that doesn't exist!");
+    }
+    return (const float *)(map + header->overview_offset) + channel*header->num_overview*2;
+}
+
+size_t SidecarFile::getNumOverviewPoints(){
+    return header && header->overview_offset ? header->num_overview : 0;
+}
+
+int SidecarFile::getOverviewFrames(){
+    return header && header->overview_offset ? header->overview_frames : 0;
+}
+
+// Getters
+std::string SidecarFile::getFileName(){
+    return filename;
+}
+
+WavFormatInfo SidecarFile::getFormatInfo(){
+    WavFormatInfo info;
+    memset(&info, 0, sizeof(info));
+    if(header){
+        info.format = header->format;
+        info.num_channels = header->num_channels;
+        info.sample_rate = header->sample_rate;
+        info.byte_rate = header->byte_rate;
+        info.block_align = header->block_align;
+        info.bits_per_sample = header->bits_per_sample;
+    }
+    return info;
+}
+
+uint16_t SidecarFile::getNumChannels(){
+    return header ? header->num_channels : 0;
+}
+
+uint32_t SidecarFile::getSampleRate(){
+    return header ? header->sample_rate : 0;
+}
+
+uint64_t SidecarFile::getNumSamples(){
+    return header ? header->num_frames : 0;
+}
+
+FileStamp SidecarFile::getSourceStamp(){
+    FileStamp stamp;
+    stamp.size = header ? header->source_size : 0;
+    stamp.modified = header ? header->source_modified : 0;
+    stamp.modified_nanoseconds = header ? header->source_modified_nanoseconds : 0;
+    return stamp;
+}
+
+uint64_t SidecarFile::getSourceChecksum(){
+    return header ? header->source_checksum : 0;
+}
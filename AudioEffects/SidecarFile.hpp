@@ -0,0 +1,107 @@
+//
+//  SidecarFile.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/9/11.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef SidecarFile_hpp
+#define SidecarFile_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "AudioBuffer.hpp"
+#include "WavCommon.hpp"
+
+struct SidecarHeader;
+
+/* SidecarFile class
+ *
+ * Maps a pre-decoded copy of a wav file that opens without any decoding
+ *
+ * A sidecar is a one page header followed by the samples as planar floats,
+ * laid out exactly like an AudioBuffer so they can be used straight from
+ * the mapping, then optionally the peak and RMS of every block of
+ * overview frames for drawing waveforms. The header remembers the size,
+ * modification time and checksum of the wav file it was made from, so a
+ * stale sidecar can be told apart from a current one.
+ *
+ * The mapping is private: samples can be changed in memory, the changed
+ * pages are copied and the file on disk is never touched.
+ */
+class SidecarFile {
+public:
+
+    // Frames per overview level unless asked otherwise
+    static const int default_overview_frames = 512;
+
+    // Default Constructor
+    SidecarFile();
+
+    // Constructor
+    // Maps the specified sidecar
+    explicit SidecarFile(std::string path);
+
+    // Destructor
+    // Unmaps the file
+    ~SidecarFile();
+
+    // The mapping can't be shared between two owners
+    SidecarFile(const SidecarFile &) = delete;
+    SidecarFile &operator=(const SidecarFile &) = delete;
+
+    // Map a new sidecar, unmapping the old one if necessary
+    // Throws if the file isn't a complete sidecar
+    void open(std::string path);
+
+    // Unmap the current file
+    void close();
+
+    // Writes samples to a sidecar at path, replacing it in one rename
+    // format describes the source's encoding, source_path is the file the samples came from
+    // (empty if none), and overview_frames is the block size of the overview, 0 for none
+    static void write(std::string path, const AudioBufferView &samples, const WavFormatInfo &format,
+                      std::string source_path, int overview_frames = default_overview_frames);
+
+    // Where the sidecar of the wav file at source_path goes
+    static std::string pathFor(const std::string &source_path);
+
+    // 64 bit FNV-1a of every byte of the file at path
+    static uint64_t checksumFile(const std::string &path);
+
+    // True if the wav file at source_path is still the one the sidecar was made from
+    // Size and modification time are compared, and with verify the whole file is checksummed too
+    bool matchesSource(const std::string &source_path, bool verify = false);
+
+    // View of every sample, inside the mapping
+    AudioBufferView getData();
+
+    // Peak and RMS of every block of getOverviewFrames() frames of channel, interleaved
+    // NULL if the sidecar has no overview
+    const float *getOverview(int channel);
+    size_t getNumOverviewPoints();
+    int getOverviewFrames();
+
+    // Getters
+    std::string getFileName();
+    WavFormatInfo getFormatInfo(); // Of the source
+    uint16_t getNumChannels();
+    uint32_t getSampleRate();
+    uint64_t getNumSamples();
+    FileStamp getSourceStamp();
+    uint64_t getSourceChecksum();
+
+protected:
+private:
+    void init(); // Sets/Resets all fields to zero
+
+    std::string filename;
+    unsigned char *map; // Start of the mapping
+    size_t map_size; // Size of the mapping in bytes
+    const SidecarHeader *header; // At the start of the mapping
+};
+
+#endif /* SidecarFile_hpp */
@@ -0,0 +1,178 @@
+//
+//  ThreadPool.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/29.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "ThreadPool.hpp"
+
+// The pool whose task this thread is running, if any
+static thread_local ThreadPool *running_pool = NULL;
+
+// Constructor
+ThreadPool::ThreadPool(int threads){
+    if(threads <= 0){
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    num_threads = threads > 0 ? threads : 1;
+
+    fn = NULL;
+    context = NULL;
+    generation = 0;
+    active = 0;
+    stopping = false;
+    remaining = 0;
+    failed = false;
+
+    queues.reset(new Queue[num_threads]);
+    for(int i = 0; i < num_threads; ++i){
+        queues[i].begin = 0;
+        queues[i].end = 0;
+    }
+
+    for(int i = 0; i < num_threads - 1; ++i){
+        workers.push_back(std::thread(&ThreadPool::worker, this, i));
+    }
+}
+
+// Destructor
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i){
+        workers[i].join();
+    }
+}
+
+// Runs fn(context, i) for every i in [0, num_tasks)
+void ThreadPool::run(TaskFunction task_fn, void *task_context, int num_tasks){
+    if(num_tasks <= 0){
+        return;
+    }
+
+    // Nothing to share, don't bother waking anyone
+    // Nor from inside a task of this pool, whose run_lock is already held
+    if(num_threads == 1 || num_tasks == 1 || running_pool == this){
+        for(int i = 0; i < num_tasks; ++i){
+            task_fn(task_context, i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_guard(run_lock);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        // A worker that woke up late for the last batch may still be looking at the queues
+        done.wait(guard, [this]{ return active == 0; });
+
+        for(int i = 0; i < num_threads; ++i){
+            std::lock_guard<std::mutex> queue_guard(queues[i].lock);
+            queues[i].begin = (int)((long long)num_tasks*i/num_threads);
+            queues[i].end = (int)((long long)num_tasks*(i + 1)/num_threads);
+        }
+        fn = task_fn;
+        context = task_context;
+        error = nullptr;
+        failed.store(false, std::memory_order_relaxed);
+        remaining.store(num_tasks, std::memory_order_relaxed);
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(num_threads - 1);
+
+    // Wait for tasks other threads are still running, and for them to stop looking at the queues
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]{ return remaining.load(std::memory_order_acquire) == 0 && active == 0; });
+    if(error){
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// Number of threads that work on a batch, including the caller
+int ThreadPool::getNumThreads(){
+    return num_threads;
+}
+
+// Body of worker thread index
+void ThreadPool::worker(int index){
+    uint64_t seen = 0;
+    while(true){
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&]{ return stopping || generation != seen; });
+            if(stopping){
+                return;
+            }
+            seen = generation;
+            ++active;
+        }
+
+        work(index);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            --active;
+        }
+        done.notify_all();
+    }
+}
+
+// Runs tasks from queue index, then steals from the others until the batch is empty
+// Once a task has thrown the rest are only counted off
+void ThreadPool::work(int index){
+    ThreadPool *outer = running_pool;
+    running_pool = this;
+    int task;
+    while(pop(index, task) || steal(index, task)){
+        if(!failed.load(std::memory_order_relaxed)){
+            try {
+                fn(context, task);
+            } catch(...){
+                std::lock_guard<std::mutex> guard(lock);
+                if(!error){
+                    error = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            // Take the lock so run can't miss the notification between its check and its wait
+            std::lock_guard<std::mutex> guard(lock);
+            done.notify_all();
+        }
+    }
+    running_pool = outer;
+}
+
+// Takes the next task from the front of this thread's own queue
+bool ThreadPool::pop(int index, int &task){
+    Queue &q = queues[index];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if(q.begin >= q.end){
+        return false;
+    }
+    task = q.begin++;
+    return true;
+}
+
+// Takes a task from the back of another thread's queue
+bool ThreadPool::steal(int index, int &task){
+    for(int i = 1; i < num_threads; ++i){
+        Queue &q = queues[(index + i) % num_threads];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if(q.begin < q.end){
+            task = --q.end;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,106 @@
+//
+//  ThreadPool.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/29.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* ThreadPool class
+ *
+ * Fixed set of worker threads that run batches of indexed tasks
+ *
+ * run splits the task indices evenly between the workers and the calling
+ * thread. Whoever finishes their share first steals single tasks from the
+ * back of someone else's, so uneven tasks still keep every thread busy.
+ *
+ * Threads are only started by the constructor, and run doesn't allocate,
+ * so it's cheap enough to call once per audio block.
+ *
+ * A task that throws doesn't take down the thread it ran on: the first
+ * exception of a batch is kept, the tasks that haven't started yet are
+ * skipped, and run rethrows it once the ones already running are done.
+ */
+class ThreadPool {
+public:
+
+    // Runs task index of a batch, context is whatever was given to run
+    typedef void (*TaskFunction)(void *context, int index);
+
+    // Constructor
+    // Starts num_threads - 1 workers, the thread calling run is the last one
+    // 0 uses one thread per hardware thread
+    explicit ThreadPool(int num_threads = 0);
+
+    // Destructor
+    // Stops and joins the workers
+    ~ThreadPool();
+
+    // Runs fn(context, i) for every i in [0, num_tasks), and returns once they have all finished
+    // Calls from several threads at once are run one after another. A task may call run on its
+    // own pool, that batch then runs inline on the task's thread
+    // Rethrows the first exception a task threw, the tasks after it may not have run
+    void run(TaskFunction fn, void *context, int num_tasks);
+
+    // Number of threads that work on a batch, including the caller
+    int getNumThreads();
+
+protected:
+private:
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // The tasks [begin, end) still waiting in one thread's share of the batch
+    // Padded so neighbouring queues don't share a cache line
+    struct Queue {
+        std::mutex lock;
+        int begin;
+        int end;
+        char padding[64];
+    };
+
+    // Body of worker thread index
+    void worker(int index);
+
+    // Runs tasks from queue index, then steals from the others until the batch is empty
+    void work(int index);
+
+    // Takes the next task from the front of queue index, or the back of another queue
+    // Returns false once there is nothing left there
+    bool pop(int index, int &task);
+    bool steal(int index, int &task);
+
+    int num_threads;
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues; // One per thread, the caller uses the last
+
+    std::mutex run_lock; // Held for the whole of run
+
+    // Current batch, guarded by lock
+    std::mutex lock;
+    std::condition_variable wake; // Signals workers that a batch started or the pool is stopping
+    std::condition_variable done; // Signals run that the batch finished
+    TaskFunction fn;
+    void *context;
+    uint64_t generation; // Incremented once per batch
+    int active; // Workers currently looking at the queues
+    bool stopping;
+    std::exception_ptr error; // First exception a task of the batch threw
+
+    std::atomic<int> remaining; // Tasks of the batch not finished yet
+    std::atomic<bool> failed; // Set with error, so the other threads skip what's left
+};
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,324 @@
+//
+//  WavCommon.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/20.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavCommon.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+// Parses the body of a fmt chunk
+// Structure:
+// 2 byte format tag
+// 2 byte number of channels
+// 4 byte sample rate
+// 4 byte byte rate
+// 2 byte block align
+// 2 byte bits per sample
+// ---- Optional extensions (if format tag is 0xFFFE)
+// 2 byte extra params size
+// 2 byte valid bits per sample
+// 4 byte channel mask
+// 16 byte subformat
+void parseFormatChunk(const unsigned char *data, uint32_t chunksize, WavFormatInfo &info){
+    if(chunksize < 16){
+        throw std::runtime_error("WavFile Error: fmt chunk is too small!");
+    }
+
+    memcpy(&info.format, data, 2);
+    memcpy(&info.num_channels, data + 2, 2);
+    memcpy(&info.sample_rate, data + 4, 4);
+    memcpy(&info.byte_rate, data + 8, 4);
+    memcpy(&info.block_align, data + 12, 2);
+    memcpy(&info.bits_per_sample, data + 14, 2);
+
+    // Resolve the extensible format to the format it actually wraps
+    if((WavFormat)info.format == WavFormat::Extensible && chunksize >= 40){
+        const unsigned char *subformat = data + 24;
+        if(compareSubtype(subformat, KSDATAFORMAT_SUBTYPE_PCM)){
+            info.format = (uint16_t)WavFormat::PulseCodeModulation;
+        } else if(compareSubtype(subformat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)){
+            info.format = (uint16_t)WavFormat::IEEEFloatingPoint;
+        }
+    }
+
+    if(info.num_channels == 0){
+        throw std::runtime_error("WavFile Error: File has no channels!");
+    }
+}
+
+// Returns true if the samples described by info can be decoded to floats
+bool isDecodable(const WavFormatInfo &info){
+    switch((WavFormat)info.format){
+        case WavFormat::PulseCodeModulation:
+            if(info.block_align < info.num_channels*(info.bits_per_sample/8))
+                return false;
+            return info.bits_per_sample == 8 || info.bits_per_sample == 16 ||
+                   info.bits_per_sample == 24 || info.bits_per_sample == 32;
+        case WavFormat::IEEEFloatingPoint:
+            if(info.block_align < info.num_channels*(info.bits_per_sample/8))
+                return false;
+            return info.bits_per_sample == 32 || info.bits_per_sample == 64;
+        default:
+            return false;
+    }
+}
+
+// Decodes frames of interleaved samples into separate channel buffers
+// The format is checked once per call rather than once per sample
+void decodeFrames(const unsigned char *in, const AudioBufferView &out, const WavFormatInfo &info){
+    int channels = info.num_channels;
+    size_t frames = out.getNumFrames();
+    int stride = info.block_align;
+
+    switch(info.bits_per_sample){
+        case 8:
+            for(int channel = 0; channel < channels; ++channel){
+                const unsigned char *src = in + channel;
+                float *dst = out[channel];
+                for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                    // Subtract one because the normalization factor maps to [0,2] and not [-1,1]
+                    dst[frame] = uint8normalize*(float)*src - 1;
+                }
+            }
+            break;
+
+        case 16:
+            for(int channel = 0; channel < channels; ++channel){
+                const unsigned char *src = in + 2*channel;
+                float *dst = out[channel];
+                for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                    int16_t temp16bit;
+                    memcpy(&temp16bit, src, 2);
+                    dst[frame] = int16normalize*(float)temp16bit;
+                }
+            }
+            break;
+
+        case 24:
+            for(int channel = 0; channel < channels; ++channel){
+                const unsigned char *src = in + 3*channel;
+                float *dst = out[channel];
+                for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                    dst[frame] = int24normalize*(float)int24to32(src);
+                }
+            }
+            break;
+
+        case 32:
+            for(int channel = 0; channel < channels; ++channel){
+                const unsigned char *src = in + 4*channel;
+                float *dst = out[channel];
+                if((WavFormat)info.format == WavFormat::IEEEFloatingPoint){
+                    for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                        memcpy(&dst[frame], src, 4);
+                    }
+                } else {
+                    for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                        int32_t temp32bit;
+                        memcpy(&temp32bit, src, 4);
+                        dst[frame] = int32normalize*(float)temp32bit;
+                    }
+                }
+            }
+            break;
+
+        case 64:
+            for(int channel = 0; channel < channels; ++channel){
+                const unsigned char *src = in + 8*channel;
+                float *dst = out[channel];
+                for(size_t frame = 0; frame < frames; ++frame, src += stride){
+                    double temp64bit;
+                    memcpy(&temp64bit, src, 8);
+                    dst[frame] = (float)temp64bit;
+                }
+            }
+            break;
+    }
+}
+
+// Bytes of a fmt chunk body parseFormatChunk looks at
+static const size_t format_chunk_max = 40;
+
+// Reads a whole chunk header at offset, false if the file ends first
+static bool readChunkHeader(WavReadFunction read, void *context, uint64_t offset, void *out, size_t size){
+    return read(context, offset, out, size) == size;
+}
+
+// Walks a RIFF, RF64 or BW64 file
+// Structure:
+// 4 byte 'RIFF', 'RF64' or 'BW64'
+// 4 byte size of the rest of the file, 0xFFFFFFFF if it's in the ds64 chunk
+// 4 byte 'WAVE'
+// ---- Chunks, each padded to an even size
+// 4 byte id
+// 4 byte size
+// ---- ds64 chunk, first after 'WAVE' in RF64 files
+// 8 byte size of the rest of the file
+// 8 byte size of the data chunk
+// 8 byte number of frames
+// 4 byte number of entries in the table of other large chunks, then the table
+static void parseRiffLayout(WavReadFunction read, void *context, uint64_t file_size, WavLayout &layout){
+    unsigned char header[12];
+    if(!readChunkHeader(read, context, 0, header, sizeof(header))){
+        throw std::runtime_error("WavFile Error: Not a Wave File!");
+    }
+    uint32_t chunkid;
+    uint32_t format_specifier;
+    memcpy(&chunkid, header, 4);
+    memcpy(&format_specifier, header + 8, 4);
+
+    // Chunk ID's are stored in big endian format, swap the bytes around
+    chunkid = __builtin_bswap32(chunkid);
+    if((chunkid != (uint32_t)WavChunks::RiffHeader && chunkid != (uint32_t)WavChunks::RF64Header &&
+        chunkid != (uint32_t)WavChunks::BW64Header) || __builtin_bswap32(format_specifier) != WaveIdentifier){
+        throw std::runtime_error("WavFile Error: Not a Wave File!");
+    }
+    layout.container = chunkid == (uint32_t)WavChunks::RiffHeader ? WavContainer::Riff : WavContainer::RF64;
+
+    bool found_format = false;
+    bool found_ds64 = false;
+    uint64_t ds64_data_size = 0;
+    uint64_t offset = 12;
+    while(true){
+        unsigned char chunk[8];
+        uint32_t chunksize;
+        if(!readChunkHeader(read, context, offset, chunk, sizeof(chunk))){
+            throw std::runtime_error("WavFile Error: No data chunk found!");
+        }
+        memcpy(&chunkid, chunk, 4);
+        memcpy(&chunksize, chunk + 4, 4);
+        offset += 8;
+
+        // Never trust the chunk size to stay inside the file
+        uint64_t available = file_size > offset ? file_size - offset : 0;
+
+        switch((WavChunks)__builtin_bswap32(chunkid)){
+            case WavChunks::DataSize64: {
+                uint64_t sizes[2];
+                if(chunksize < sizeof(sizes) || !readChunkHeader(read, context, offset, sizes, sizeof(sizes))){
+                    throw std::runtime_error("WavFile Error: ds64 chunk is too small!");
+                }
+                ds64_data_size = sizes[1];
+                found_ds64 = true;
+                break;
+            }
+
+            case WavChunks::Format: {
+                unsigned char body[format_chunk_max];
+                size_t size = (size_t)std::min<uint64_t>(std::min<uint64_t>(chunksize, available), sizeof(body));
+                size = read(context, offset, body, size);
+                parseFormatChunk(body, (uint32_t)size, layout.info);
+                found_format = true;
+                break;
+            }
+
+            case WavChunks::Data: {
+                if(!found_format){
+                    throw std::runtime_error("WavFile Error: Data chunk before fmt chunk!");
+                }
+                uint64_t size = chunksize;
+                if(layout.container == WavContainer::RF64 && chunksize == RF64SizeInDs64){
+                    if(!found_ds64){
+                        throw std::runtime_error("WavFile Error: RF64 file has no ds64 chunk!");
+                    }
+                    size = ds64_data_size;
+                }
+                layout.data_offset = offset;
+                layout.data_size = std::min(size, available);
+                return;
+            }
+
+            default:
+                // Some other chunk that we don't handle, skip it
+                break;
+        }
+        offset += (uint64_t)chunksize + (chunksize & 1);
+    }
+}
+
+// Walks a Sony Wave64 file
+// Structure:
+// 16 byte riff GUID
+// 8 byte size of the whole file
+// 16 byte wave GUID
+// ---- Chunks, each padded to a multiple of 8 bytes
+// 16 byte GUID
+// 8 byte size, including these 24 bytes
+static void parseWave64Layout(WavReadFunction read, void *context, uint64_t file_size, WavLayout &layout){
+    unsigned char header[40];
+    if(!readChunkHeader(read, context, 0, header, sizeof(header)) || memcmp(header + 24, Wave64Wave, 16) != 0){
+        throw std::runtime_error("WavFile Error: Not a Wave File!");
+    }
+    layout.container = WavContainer::Wave64;
+
+    bool found_format = false;
+    uint64_t offset = sizeof(header);
+    while(true){
+        unsigned char chunk[24];
+        uint64_t chunksize;
+        if(!readChunkHeader(read, context, offset, chunk, sizeof(chunk))){
+            throw std::runtime_error("WavFile Error: No data chunk found!");
+        }
+        memcpy(&chunksize, chunk + 16, 8);
+        if(chunksize < sizeof(chunk)){
+            throw std::runtime_error("WavFile Error: Chunk is too small!");
+        }
+        uint64_t body_size = chunksize - sizeof(chunk);
+        offset += sizeof(chunk);
+        uint64_t available = file_size > offset ? file_size - offset : 0;
+
+        if(memcmp(chunk, Wave64Format, 16) == 0){
+            unsigned char body[format_chunk_max];
+            size_t size = (size_t)std::min(std::min(body_size, available), (uint64_t)sizeof(body));
+            size = read(context, offset, body, size);
+            parseFormatChunk(body, (uint32_t)size, layout.info);
+            found_format = true;
+        } else if(memcmp(chunk, Wave64Data, 16) == 0){
+            if(!found_format){
+                throw std::runtime_error("WavFile Error: Data chunk before fmt chunk!");
+            }
+            layout.data_offset = offset;
+            layout.data_size = std::min(body_size, available);
+            return;
+        }
+
+        // Sizes past the end of the file would wrap the offset around
+        if(body_size > available){
+            throw std::runtime_error("WavFile Error: No data chunk found!");
+        }
+        offset += (body_size + 7) & ~(uint64_t)7;
+    }
+}
+
+// Walks the chunks of a RIFF, RF64 or Wave64 file up to its data chunk
+void parseWavLayout(WavReadFunction read, void *context, uint64_t file_size, WavLayout &layout){
+    memset(&layout, 0, sizeof(layout));
+    unsigned char id[16];
+    if(read(context, 0, id, sizeof(id)) == sizeof(id) && memcmp(id, Wave64Riff, 16) == 0){
+        parseWave64Layout(read, context, file_size, layout);
+    } else {
+        parseRiffLayout(read, context, file_size, layout);
+    }
+}
+
+// Fills stamp for the file at path, returns false if it can't be stat'ed
+bool getFileStamp(const std::string &path, FileStamp &stamp){
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0){
+        return false;
+    }
+    stamp.size = (uint64_t)info.st_size;
+    stamp.modified = (int64_t)info.st_mtime;
+#ifdef __APPLE__
+    stamp.modified_nanoseconds = (uint32_t)info.st_mtimespec.tv_nsec;
+#else
+    stamp.modified_nanoseconds = (uint32_t)info.st_mtim.tv_nsec;
+#endif
+    return true;
+}
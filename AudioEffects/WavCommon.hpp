@@ -0,0 +1,183 @@
+//
+//  WavCommon.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/20.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavCommon_hpp
+#define WavCommon_hpp
+
+#include <cstdint>
+#include <string>
+#include "AudioBuffer.hpp"
+
+/* Definitions shared by everything that reads or writes .wav files
+ *
+ * Chunk ids, format tags, and the sample normalization constants
+ */
+
+// Known chunk id's of RIFF chunks
+enum class WavChunks{
+    RiffHeader = 0x52494646,
+    RF64Header = 0x52463634, // 'RF64', EBU Tech 3306
+    BW64Header = 0x42573634, // 'BW64', ITU-R BS.2088, the same layout as RF64
+    DataSize64 = 0x64733634, // 'ds64', the 64 bit sizes of an RF64 file
+    Junk = 0x4A554E4B, // Filler, reserves room for a ds64 chunk in files that may outgrow RIFF
+    Format = 0x666D7420,
+    Fact = 0x66616374, // Number of frames, required for every format but PCM
+    Data = 0x64617461
+};
+
+// Containers a wav file can come in
+enum class WavContainer {
+    Riff, // Sizes are 32 bits, so at most 4GB. Written with room to become RF64 if it grows past that
+    RF64, // RIFF with the 64 bit sizes in a ds64 chunk
+    Wave64 // Sony Wave64, 16 byte GUID chunk ids and 64 bit sizes throughout
+};
+
+// Size fields of RF64 files that say to look in the ds64 chunk instead
+const uint32_t RF64SizeInDs64 = 0xFFFFFFFF;
+
+// 'WAVE' stored in big endian
+const uint32_t WaveIdentifier = 0x57415645;
+
+// Wave64 chunk GUIDs, as they're stored in the file
+// Each starts with the bytes of the matching RIFF id in lower case
+const unsigned char Wave64Riff[16] = {
+    0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+const unsigned char Wave64Wave[16] = {
+    0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+const unsigned char Wave64Format[16] = {
+    0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+const unsigned char Wave64Data[16] = {
+    0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+const unsigned char Wave64Fact[16] = {
+    0x66, 0x61, 0x63, 0x74, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+// Known formats of the wFormatTag field
+enum class WavFormat {
+    PulseCodeModulation = 0x01,
+    IEEEFloatingPoint = 0x03,
+    ALaw = 0x06,
+    MuLaw = 0x07,
+    IMAADPCM = 0x11,
+    YamahaITUG723ADPCM = 0x16,
+    GSM610 = 0x31,
+    ITUG721ADPCM = 0x40,
+    MPEG = 0x50,
+    Extensible = 0xFFFE
+};
+
+// Subtype GUIDs
+const unsigned char KSDATAFORMAT_SUBTYPE_PCM[] = {
+    0x01,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x10,
+    0x00,
+    0x80,
+    0x00,
+    0x00,
+    0xaa,
+    0x00,
+    0x38,
+    0x9b,
+    0x71};
+
+const unsigned char KSDATAFORMAT_SUBTYPE_IEEE_FLOAT[] = {
+    0x03,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x00,
+    0x10,
+    0x00,
+    0x80,
+    0x00,
+    0x00,
+    0xaa,
+    0x00,
+    0x38,
+    0x9b,
+    0x71};
+
+// Compares subtypes of the WAVE_FORMAT_EXTENSIBLE
+inline bool compareSubtype(const unsigned char a[16], const unsigned char b[16]){
+    for(int i = 0; i < 16; ++i){
+        if(a[i] != b[i])
+            return false;
+    }
+    return true;
+}
+
+// Turns a 3 byte char array into a 32 bit int
+// The ternary operator decides if sign extension is necessary
+inline int32_t int24to32(const unsigned char *in){
+    return ((in[2] & 0x80) ? (0xff <<24) : 0) | (in[2] << 16) | (in[1] << 8) | in[0];
+}
+
+// Normalizing factors for conversions
+const float uint8normalize = 2.0f/0xff; // Maps to [0,2], subtract 1 afterwards!
+const float int16normalize = 1.0f/0x7fff;
+const float int24normalize = 1.0f / 8388607.0; // Magic number, maps smallest to -1 and largest to 1
+const float int32normalize = 1.0f / 2147483647.0;
+
+// The contents of a fmt chunk
+struct WavFormatInfo {
+    uint16_t format; // Format tag, Extensible is resolved to its subformat
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+};
+
+// Parses the body of a fmt chunk (everything after the chunk size)
+// Throws if the chunk is too small to be a valid fmt chunk
+void parseFormatChunk(const unsigned char *data, uint32_t chunksize, WavFormatInfo &info);
+
+// Returns true if the samples described by info can be decoded to floats
+bool isDecodable(const WavFormatInfo &info);
+
+// Decodes out.getNumFrames() frames of interleaved samples described by info into the channels of out
+// Slow, but works for any frame layout. See SampleConversion for the fast kernels
+void decodeFrames(const unsigned char *in, const AudioBufferView &out, const WavFormatInfo &info);
+
+// Where the samples of a wav file are, and what they look like
+struct WavLayout {
+    WavContainer container;
+    WavFormatInfo info;
+    uint64_t data_offset; // Bytes from the start of the file
+    uint64_t data_size; // Bytes of samples, never past the end of the file
+};
+
+// Copies size bytes at offset of a file into out, returns how many there were before the end
+typedef size_t (*WavReadFunction)(void *context, uint64_t offset, void *out, size_t size);
+
+// Walks the chunks of a RIFF, RF64 or Wave64 file of file_size bytes up to its data chunk,
+// reading through read. Throws if it isn't a wav file or the fmt chunk doesn't come first
+void parseWavLayout(WavReadFunction read, void *context, uint64_t file_size, WavLayout &layout);
+
+// Identifies a version of a file on disk, for caching what was worked out from it
+// Whole seconds miss a file rewritten within the same second, so the nanoseconds are kept too
+struct FileStamp {
+    uint64_t size;
+    int64_t modified; // Seconds since the epoch
+    uint32_t modified_nanoseconds; // Into that second, 0 where the filesystem doesn't keep them
+};
+
+// Fills stamp for the file at path, returns false if it can't be stat'ed
+bool getFileStamp(const std::string &path, FileStamp &stamp);
+
+// True if a and b describe the same version of a file
+inline bool compareStamps(const FileStamp &a, const FileStamp &b){
+    return a.size == b.size && a.modified == b.modified && a.modified_nanoseconds == b.modified_nanoseconds;
+}
+
+#endif /* WavCommon_hpp */
@@ -7,14 +7,19 @@
 //
 
 #include "WavFile.hpp"
-#include <fstream>
+#include "Gain.hpp"
+#include "Resampler.hpp"
+#include "SidecarFile.hpp"
+#include "WavCommon.hpp"
+#include "WavReader.hpp"
+#include "WavWriter.hpp"
 #include <sstream>
 #include <cmath>
-#include <iomanip>
+#include <stdexcept>
 
 // Sets/Resets all fields to zero
 void WavFile::init(){
-    samples = NULL;
+    source_path.clear();
     format = 0;
     num_channels = 0;
     sample_rate = 0;
@@ -31,19 +36,15 @@ WavFile::WavFile(){
 
 // Constructor
 // Loads specified wav file into memory
-WavFile::WavFile(std::string path){
-    open(path);
+WavFile::WavFile(std::string path, uint32_t rate){
+    init();
+    open(path, rate);
 }
 
 // Frees samples if needed
 // Outside of destructor so that open function can call it
 void WavFile::freeSamples(){
-    if(samples){
-        for (int i = 0; i < num_channels; ++i) {
-            delete [] samples[i];
-        }
-        delete [] samples;
-    }
+    samples.free();
 }
 
 
@@ -53,312 +54,154 @@ WavFile::~WavFile(){
     freeSamples();
 }
 
-// Known chunk id's of RIFF chunks
-enum class WavChunks{
-    RiffHeader = 0x52494646,
-    Format = 0x666D7420,
-    Data = 0x64617461
-};
-
-// Known formats of the wFormatTag field
-enum class WavFormat {
-    PulseCodeModulation = 0x01,
-    IEEEFloatingPoint = 0x03,
-    ALaw = 0x06,
-    MuLaw = 0x07,
-    IMAADPCM = 0x11,
-    YamahaITUG723ADPCM = 0x16,
-    GSM610 = 0x31,
-    ITUG721ADPCM = 0x40,
-    MPEG = 0x50,
-    Extensible = 0xFFFE
-};
-
-// Subtype GUIDs
-const unsigned char KSDATAFORMAT_SUBTYPE_PCM[] = {
-    0x01,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x00,
-    0x10,
-    0x00,
-    0x80,
-    0x00,
-    0x00,
-    0xaa,
-    0x00,
-    0x38,
-    0x9b,
-    0x71};
-
-// Compares subtypes of the WAVE_FORMAT_EXTENSIBLE
-bool compareSubtype(const unsigned char a[16], const unsigned char b[16]){
-    for(int i = 0; i < 16; ++i){
-        if(a[i] != b[i])
-            return false;
-    }
-    return true;
+// Measures the samples in one pass
+AudioAnalysis WavFile::analyze(ThreadPool *pool){
+    AudioAnalyzer analyzer(pool);
+    return analyzer.analyze(getData(), sample_rate);
 }
 
-
 // Normalizes the samples over the entire file
-// sample/max_sample for all samples
-void WavFile::normalizeSamples(){
-    float max_sample = 0;
-    
-    for(int channel = 0; channel < num_channels; ++channel){
-        for(int sample = 0; sample < num_samples; ++sample){
-            if(max_sample < std::abs(samples[channel][sample])){
-                
-                // absolute value, or else the negative side of the spectrum will not be taken into account
-                
-                max_sample = std::abs(samples[channel][sample]);
-            }
-        }
-    }
-    
-    std::cout << "Max Sample = " << std::setprecision(10) << max_sample << ", normalizing..." << std::endl << std::endl;
-    
-    for(int channel = 0; channel < num_channels; ++channel){
-        for(int sample = 0; sample < num_samples; ++sample){
-            samples[channel][sample] /= max_sample;
-        }
-    }
+// One scan for the peak, then one multiply by its reciprocal. Silence is left alone
+void WavFile::normalizeSamples(ThreadPool *pool){
+    Gain gain(analyze(pool).getPeakGain());
+    gain.process(getData());
 }
 
-// Turns a 3 byte char array into a 32 bit int
-// The ternary operator decides if sign extension is necessary
-inline int32_t int24to32(unsigned char *in){
-    return ((in[2] & 0x80) ? (0xff <<24) : 0) | (in[2] << 16) | (in[1] << 8) | in[0];
+// Scales the samples to an integrated loudness of target_lufs, without the true peak going over max_true_peak
+float WavFile::normalizeLoudness(float target_lufs, float max_true_peak, ThreadPool *pool){
+    Gain gain(analyze(pool).getLoudnessGain(target_lufs, max_true_peak));
+    gain.process(getData());
+    return gain.getGain();
 }
 
-// Normalizing factors for conversions
-const float uint8normalize = 2.0f/0xff; // Maps to [0,2], subtract 1 afterwards!
-const float int16normalize = 1.0f/0x7fff;
-const float int24normalize = 1.0f / 8388607.0; // Magic number, maps smallest to -1 and largest to 1
-
 // Open a new wav file
 // Deallocates old file if necessary
-void WavFile::open(std::string path){
+void WavFile::open(std::string path, uint32_t rate){
     
     // If a file is already loaded, free it
     freeSamples();
     init();
     
-    char sep = '/';
+    // The reader parses the header and picks the fastest decoder for this file
+    WavReader reader(path);
     
-#ifdef _WIN32
-    sep = '\\'
-#endif
+    source_path = path;
+    filename = reader.getFileName();
+    format = reader.getFormat();
+    num_channels = reader.getNumChannels();
+    sample_rate = reader.getSampleRate();
+    byte_rate = reader.getByteRate();
+    block_align = reader.getBlockAlign();
+    bits_per_sample = reader.getBitsPerSample();
+    num_samples = reader.getNumSamples();
     
-    unsigned long i = path.rfind(sep);
+    samples.allocate(num_channels, num_samples);
     
-    if (i != std::string::npos){
-        filename = path.substr(i+1, path.length()-1);
-    } else {
-        filename = path;
-    }
+    // Decode straight into the sample buffer
+    size_t done = reader.read(samples.view());
     
-    // Open the file
-    std::ifstream f;
-    f.open(path, std::ios::binary);
-    if(!f.is_open()){
-        std::cerr << "Error: " << strerror(errno) << std::endl;
-        throw std::runtime_error("WavFile Error: Could not open file\n");
-    }
+    // The data chunk was shorter than its header claimed
+    num_samples = done;
     
-    // While not at end of file
-    while(true){
-        uint32_t chunkid;
-        // The best way I have currently found to extract data fields
-        f.read(reinterpret_cast<char*>(&chunkid), sizeof(chunkid));
-        
-        // Read will return garbage when reading past the end of file
-        // If End Of File flag set, break;
-        if(f.eof())
-            break;
-        
-        // Chunk ID's are stored in big endian format, swap the bytes around
-        chunkid = __builtin_bswap32(chunkid);
-        switch((WavChunks)chunkid){
-                
-            case WavChunks::RiffHeader:
-                // The header of the RIFF structure
-                // Structure:
-                // 4 bytes chunk size (filesize - 8 bytes)
-                // 4 bytes format (must be 'WAVE' in big endian)
-                
-                f.read(reinterpret_cast<char*>(&filesize), sizeof(filesize));
-                
-                uint32_t format_specifier;
-                f.read(reinterpret_cast<char*>(&format_specifier), sizeof(format_specifier));
-                
-                if (__builtin_bswap32(format_specifier) != 0x57415645) { // 0x57415645 is 'WAVE' stored in big endian
-                    throw std::runtime_error("WavFile Error: Not a Wave File!");
-                }
-                break;
-                
-            case WavChunks::Format:
-                // Format Subchunk specifying the format of the wave file
-                // Structure:
-                // 4 byte chunk size
-                // 2 byte format tag
-                // 2 byte number of channels
-                // 4 byte sample rate
-                // 4 byte byte rate
-                // 2 byte block align
-                // 2 byte bits per sample
-                // ---- Optional extensions (if format tag is 0xFFFE)
-                // 2 byte extra params size
-                // 2 byte valid bits per sample
-                // 4 byte channel mask
-                // 16 byte subformat
-                
-                uint32_t chunksize;
-                f.read(reinterpret_cast<char*>(&chunksize), sizeof(chunksize));;
-                
-                f.read(reinterpret_cast<char*>(&format), sizeof(format));
-                
-                f.read(reinterpret_cast<char*>(&num_channels), sizeof(num_channels));
-                f.read(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
-                f.read(reinterpret_cast<char*>(&byte_rate), sizeof(byte_rate));
-                f.read(reinterpret_cast<char*>(&block_align), sizeof(block_align));
-                f.read(reinterpret_cast<char*>(&bits_per_sample), sizeof(bits_per_sample));
-                
-                if ((WavFormat)format == WavFormat::Extensible){
-                    uint16_t extra_params_size;
-                    f.read(reinterpret_cast<char*>(&extra_params_size), sizeof(extra_params_size));
-                    uint16_t valid_bits_per_sample;
-                    f.read(reinterpret_cast<char*>(&valid_bits_per_sample), sizeof(valid_bits_per_sample));
-                    uint32_t channel_mask;
-                    f.read(reinterpret_cast<char*>(&channel_mask), sizeof(channel_mask));
-                    unsigned char subformat[16];
-                    f.read((char*)subformat, 16);
-                    
-                    if(compareSubtype(subformat, KSDATAFORMAT_SUBTYPE_PCM)){
-                        std::cout << "Subformat is KSDATAFORMAT_SUBTYPE_PCM" << std::endl;
-                    }
-                }
-                
-                break;
-                
-            case WavChunks::Data:
-                // Data Subchunk that stores the data
-                // Structure:
-                // 4 byte datasize
-                // x bytes data
-                
-                uint32_t datasize;
-                f.read(reinterpret_cast<char*>(&datasize), sizeof(datasize));
-                samples = new float*[num_channels];
-                num_samples =datasize*8/num_channels/bits_per_sample; // calculate number of samples
-                
-                for (int channel = 0; channel < num_channels; ++channel) {
-                    samples[channel] = new float[num_samples];
-                }
-                
-                // For linear PCM data:
-                // Data is stored as a sequence of packets
-                // each packet contains one sample for all channels
-                
-                for (int sample = 0; sample < num_samples; ++sample) {
-                    for(int channel = 0; channel < num_channels; ++channel){
-                        if (bits_per_sample == 8) {
-                            uint8_t temp8bit;
-                            f.read(reinterpret_cast<char*>(&temp8bit), sizeof(temp8bit));
-                            
-                            // Subtract one because the normalization factor maps to [0,2] and not [-1,1]
-                            samples[channel][sample] = uint8normalize*(float)temp8bit - 1;
-                            
-                        } else if (bits_per_sample == 16) {
-                            int16_t temp16bit;
-                            f.read(reinterpret_cast<char*>(&temp16bit), sizeof(temp16bit));
-                            
-                            samples[channel][sample] = int16normalize*(float)temp16bit;
-                        } else if (bits_per_sample == 24) {
-                            
-                            // There is no 24 bit variable in c++, so must use a 3 byte unsigned char array
-                            unsigned char temp24bit[3] = {0,0,0};
-                            f.read((char*)temp24bit, 3);
-                            
-                            int32_t temp = int24to32(temp24bit); // Convert the unsigned char into a 32-bit int
-                            samples[channel][sample] = int24normalize*(float)temp; // Convert 32-bit int to float
-                        }
-                    }
-                }
-                break;
-                
-            default:
-                // Some other chunk that we don't handle, just log it
-                // Chunk IDs are coded plain text, convert it into a char array for output
-                unsigned char tag[4];
-                tag[0] = (chunkid >> 24) & 0xff;
-                tag[1] = (chunkid >> 16) & 0xff;
-                tag[2] = (chunkid >> 8) & 0xff;
-                tag[3] = chunkid & 0xff;
-                std::cout << "Encountered unknown chunk, ID: " << tag << " or " << std::hex << chunkid;
-                std::cout << std::dec << " at byte " << f.tellg() << std::endl << std::endl;
-                
-                // Now just skip the chunk's data and go on
-                uint32_t skipsize;
-                f.read(reinterpret_cast<char*>(&skipsize), sizeof(skipsize));
-                f.ignore(static_cast<int>(skipsize));
-        }
+    if(rate != 0){
+        resample(rate);
     }
-    f.close();
 }
 
-void WavFile::save(std::string path){
-    std::ofstream out;
-    out.open(path, std::ios::binary);
-    
-    if(!out.is_open()){
-        std::cerr << "Error: " << strerror(errno) << std::endl;
-        throw std::runtime_error("WavFile Error: Could not open file\n");
-    }
-    
-    uint32_t data_block_size = num_samples*num_channels*sizeof(float);
-    uint32_t fmt_block_size = 16;
-    
-    // Save RIFF Header
-    uint32_t riff_header =__builtin_bswap32((unsigned int)WavChunks::RiffHeader);
-    out.write(reinterpret_cast<char*>(&riff_header), sizeof(uint32_t));
-    uint32_t riff_size = 4 + (8 + fmt_block_size) + (8 + data_block_size);
-    out.write(reinterpret_cast<char*>(&riff_size), sizeof(uint32_t));
-    uint32_t wav_identifier = __builtin_bswap32(0x57415645);
-    out.write(reinterpret_cast<char*>(&wav_identifier), sizeof(uint32_t));
-    
-    // Save fmt block
-    uint32_t fmt_header = __builtin_bswap32((unsigned int)WavChunks::Format);
-    out.write(reinterpret_cast<char*>(&fmt_header), sizeof(uint32_t));
-    out.write(reinterpret_cast<char*>(&fmt_block_size), sizeof(uint32_t));
-    
-    uint16_t fmt_id = (uint16_t)WavFormat::IEEEFloatingPoint;
-    out.write(reinterpret_cast<char*>(&fmt_id), sizeof(uint16_t));
-    out.write(reinterpret_cast<char*>(&num_channels), sizeof(uint16_t));
-    out.write(reinterpret_cast<char*>(&sample_rate), sizeof(uint32_t));
-    out.write(reinterpret_cast<char*>(&byte_rate), sizeof(uint32_t));
-    out.write(reinterpret_cast<char*>(&block_align), sizeof(uint16_t));
-    
-    uint16_t samp_size = (uint16_t)32;
-    out.write(reinterpret_cast<char*>(&samp_size), sizeof(uint16_t));
+// Maps a sidecar written by saveSidecar
+// The samples are used straight from the mapping, nothing is decoded or copied
+void WavFile::openSidecar(std::string path){
+    adoptSidecar(std::make_shared<SidecarFile>(path));
+}
+
+// Takes the samples and format from a mapped sidecar, which is kept until the samples are freed
+void WavFile::adoptSidecar(std::shared_ptr<SidecarFile> sidecar){
+    freeSamples();
+    init();
     
-    // Save Data Block
-    uint32_t data_header =__builtin_bswap32((unsigned int)WavChunks::Data);
-    out.write(reinterpret_cast<char*>(&data_header), sizeof(uint32_t));
-    out.write(reinterpret_cast<char*>(&data_block_size), sizeof(uint32_t));
+    WavFormatInfo info = sidecar->getFormatInfo();
+    filename = sidecar->getFileName();
+    format = info.format;
+    num_channels = info.num_channels;
+    sample_rate = info.sample_rate;
+    byte_rate = info.byte_rate;
+    block_align = info.block_align;
+    bits_per_sample = info.bits_per_sample;
+    num_samples = sidecar->getNumSamples();
     
-    for(int sample = 0; sample < num_samples; ++sample){
-        for(int channel = 0; channel < num_channels; ++channel){
-            out.write(reinterpret_cast<char*>(&(samples[channel][sample])),sizeof(float));
+    AudioBufferView data = sidecar->getData();
+    samples.adopt(data.getData(), num_channels, num_samples, data.getStride(), sidecar);
+}
+
+// Opens the wav file at path from its sidecar if that is still current,
+// otherwise decodes it and writes a new sidecar for next time
+bool WavFile::openCached(std::string path){
+    try {
+        std::shared_ptr<SidecarFile> sidecar = std::make_shared<SidecarFile>(SidecarFile::pathFor(path));
+        if(sidecar->matchesSource(path)){
+            adoptSidecar(sidecar);
+            source_path = path;
+            unsigned long i = path.rfind('/');
+            filename = (i != std::string::npos) ? path.substr(i+1) : path;
+            return true;
         }
+    } catch(std::runtime_error &){
+        // Missing or damaged, it's written again below
+    }
+    
+    open(path);
+    try {
+        saveSidecar(SidecarFile::pathFor(path));
+    } catch(std::exception &){
+        // A sidecar that can't be written only costs the next open a decode
+    }
+    return false;
+}
+
+// Writes the samples as they are now to a sidecar at path
+void WavFile::saveSidecar(std::string path){
+    WavFormatInfo info;
+    info.format = format;
+    info.num_channels = num_channels;
+    info.sample_rate = sample_rate;
+    info.byte_rate = byte_rate;
+    info.block_align = block_align;
+    info.bits_per_sample = bits_per_sample;
+    SidecarFile::write(path, getData(), info, source_path);
+}
+
+// Converts the samples to a new sample rate
+// The file keeps its length in time
+void WavFile::resample(uint32_t rate){
+    if(rate == 0){
+        throw std::invalid_argument("WavFile Error: Sample rate must be positive!");
     }
+    if(rate == sample_rate){
+        return;
+    }
+    
+    AudioBuffer converted;
+    Resampler::convert(getData(), sample_rate, rate, converted);
+    samples = std::move(converted);
+    num_samples = samples.getNumFrames();
+    sample_rate = rate;
+    byte_rate = sample_rate*block_align;
+}
+
+// Save the current data to a new .wav file
+// Returns the number of samples that had to be clipped
+uint64_t WavFile::save(std::string path, SampleEncoding encoding, bool dither, WavContainer container){
+    WavWriter out(path, num_channels, sample_rate, encoding, dither, container);
+    out.write(samples.slice(0, num_samples));
     out.close();
+    return out.getClippedSamples();
 }
 
 // Getters
+std::string WavFile::getFileName(){
+    return filename;
+}
+
 uint16_t WavFile::getFormat(){
     return format;
 }
@@ -383,12 +226,12 @@ uint16_t WavFile::getBitsPerSample(){
     return bits_per_sample;
 }
 
-uint32_t WavFile::getNumSamples(){
+uint64_t WavFile::getNumSamples(){
     return num_samples;
 }
 
-float ** WavFile::getData(){
-    return samples;
+AudioBufferView WavFile::getData(){
+    return samples.slice(0, num_samples);
 }
 
 // Convert the format id into a string for display purposes
@@ -13,6 +13,12 @@
 #include <cstdio>
 #include <iostream>
 #include <cstdint>
+#include <memory>
+#include "AudioAnalyzer.hpp"
+#include "AudioBuffer.hpp"
+#include "SampleConversion.hpp"
+
+class SidecarFile;
 
 /* WavFile class
  * 
@@ -26,7 +32,8 @@ public:
     
     // Constructor
     // Loads specified wav file into memory
-    WavFile(std::string path);
+    // If sample_rate isn't 0, the samples are converted to that rate as they're loaded
+    WavFile(std::string path, uint32_t sample_rate = 0);
     
     // Destructor
     // Automatically deallocates any allocated memory
@@ -34,10 +41,31 @@ public:
     
     // Open a new wav file
     // Deallocates old file if necessary
-    void open(std::string path);
+    // If sample_rate isn't 0, the samples are converted to that rate as they're loaded
+    void open(std::string path, uint32_t sample_rate = 0);
+    
+    // Converts the samples to a new sample rate
+    void resample(uint32_t sample_rate);
+    
+    // Maps a sidecar written by saveSidecar instead of decoding a wav file
+    // The samples are used straight from the mapping. Changing them only changes them in
+    // memory, the sidecar itself is never written to
+    void openSidecar(std::string path);
+    
+    // Opens the wav file at path from its sidecar (see SidecarFile::pathFor) if the file
+    // hasn't changed since it was written, otherwise opens the wav file and writes the sidecar
+    // Returns true if the sidecar was used
+    bool openCached(std::string path);
+    
+    // Writes the samples as they are now to a sidecar at path, remembering the wav file they came from
+    void saveSidecar(std::string path);
     
     // Save the current data to a new .wav file
-    void save(std::string path);
+    // Integer encodings are TPDF dithered unless dither is false
+    // RIFF files that turn out bigger than 4GB are written as RF64
+    // Returns the number of samples that had to be clipped
+    uint64_t save(std::string path, SampleEncoding encoding = SampleEncoding::Float32, bool dither = true,
+                  WavContainer container = WavContainer::Riff);
     
     // Getters
     std::string getFileName();
@@ -47,8 +75,10 @@ public:
     uint32_t getByteRate();
     uint16_t getBlockAlign();
     uint16_t getBitsPerSample();
-    uint32_t getNumSamples();
-    float ** getData();
+    uint64_t getNumSamples();
+    
+    // View of all the samples, valid until the file is closed or reopened
+    AudioBufferView getData();
     
     // Operator to access individual channels
     float *operator[](int index){
@@ -63,26 +93,36 @@ public:
     std::string toString();
     std::string printRuntime();
     
+    // Peak, true peak, RMS and loudness of the samples
+    // Channels and segments are analyzed in parallel on pool if there is one
+    AudioAnalysis analyze(ThreadPool *pool = NULL);
+    
     // Normalize samples
-    // Ensures the highest sample peaks at +-1
-    void normalizeSamples();
+    // Ensures the highest sample peaks at +-1, silent files are left as they are
+    void normalizeSamples(ThreadPool *pool = NULL);
+    
+    // Normalize loudness
+    // Scales the samples to an integrated loudness of target_lufs, less if that would
+    // take the true peak over max_true_peak. Returns the gain applied
+    float normalizeLoudness(float target_lufs, float max_true_peak = 1.0f, ThreadPool *pool = NULL);
     
 protected:
 private:
     void init(); // Sets/Resets all fields to zero
     void freeSamples(); // Frees the samples array
+    void adoptSidecar(std::shared_ptr<SidecarFile> sidecar); // Uses the samples inside a mapped sidecar
     
     std::string filename;
-    uint32_t filesize; // File size
-    uint16_t format; // Currently only supports 1 (PCM)
+    std::string source_path; // Wav file the samples were loaded from, if any
+    uint16_t format; // Format tag, Extensible is resolved to its subformat
     uint16_t num_channels; // Number of audio channels;
     uint32_t sample_rate; // Sample rate of the audio;
     uint32_t byte_rate; // bytes per second of the audio;
     uint16_t block_align; // Alignment of blocks in the data stream
     uint16_t bits_per_sample; // Number of bits per sample;
     
-    uint32_t num_samples; // The number of samples per channel in the file
-    float **samples; // The sample arrays, an array of floats for each channel
+    uint64_t num_samples; // The number of samples per channel in the file
+    AudioBuffer samples; // The samples, one aligned channel per channel in the file
 };
 
 #endif /* WavFile_hpp */
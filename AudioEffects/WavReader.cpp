@@ -0,0 +1,261 @@
+//
+//  WavReader.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/20.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavReader.hpp"
+#include "Instrumentation.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+
+// Reads size bytes at offset of the std::ifstream context, for parseWavLayout
+static size_t readStream(void *context, uint64_t offset, void *out, size_t size){
+    std::ifstream &f = *static_cast<std::ifstream *>(context);
+    f.clear();
+    f.seekg((std::streamoff)offset);
+    f.read(static_cast<char *>(out), (std::streamsize)size);
+    size_t got = (size_t)f.gcount();
+    f.clear();
+    return got;
+}
+
+// Sets/Resets all fields to zero
+void WavReader::init(){
+    memset(&info, 0, sizeof(info));
+    container = WavContainer::Riff;
+    data_offset = 0;
+    num_samples = 0;
+    position = 0;
+    packed = false;
+}
+
+// Default Constructor
+WavReader::WavReader(){
+    init();
+}
+
+// Constructor
+// Opens the specified wav file and parses its header
+WavReader::WavReader(std::string path){
+    init();
+    open(path);
+}
+
+// Destructor
+WavReader::~WavReader(){
+    close();
+}
+
+// Close the current file
+void WavReader::close(){
+    if(f.is_open()){
+        f.close();
+    }
+    init();
+}
+
+bool WavReader::isOpen(){
+    return f.is_open();
+}
+
+// Open a new wav file
+// Stops at the start of the data chunk
+// RIFF, RF64 and Wave64 files are all read the same way
+void WavReader::open(std::string path){
+    close();
+
+    char sep = '/';
+
+#ifdef _WIN32
+    sep = '\\';
+#endif
+
+    unsigned long i = path.rfind(sep);
+    filename = (i != std::string::npos) ? path.substr(i+1) : path;
+
+    f.open(path, std::ios::binary);
+    if(!f.is_open()){
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        throw std::runtime_error("WavReader Error: Could not open file\n");
+    }
+
+    // Find the size of the file, then walk its chunks through the stream
+    f.seekg(0, std::ios::end);
+    uint64_t file_size = (uint64_t)f.tellg();
+    WavLayout layout;
+    try {
+        parseWavLayout(readStream, &f, file_size, layout);
+    } catch(...){
+        close();
+        throw;
+    }
+    info = layout.info;
+    if(!isDecodable(info)){
+        close();
+        throw std::runtime_error("WavReader Error: Unsupported sample format!");
+    }
+    container = layout.container;
+    data_offset = (std::streamoff)layout.data_offset;
+    num_samples = layout.data_size/info.block_align;
+    f.clear();
+    f.seekg(data_offset);
+
+    // Only hold on to a whole number of frames
+    raw.resize(std::max(1, raw_buffer_size/info.block_align)*info.block_align);
+
+    // Pick the conversion kernel once for the whole file
+    decoder = selectDecoder(info);
+    packed = (info.block_align == info.num_channels*decoder.bytes_per_sample);
+    if(packed){
+        scratch.resize(raw.size()/info.block_align*info.num_channels);
+    }
+}
+
+// Reads up to frames frames from disk into raw
+// A truncated file ends early, in which case the data is cut short where it stopped
+size_t WavReader::fill(size_t frames){
+    f.read(reinterpret_cast<char*>(raw.data()), (std::streamsize)(frames*info.block_align));
+
+    size_t got = (size_t)f.gcount()/info.block_align;
+    position += got;
+    if(got < frames){
+        num_samples = position;
+        f.clear();
+    }
+    return got;
+}
+
+// Decodes up to out.getNumFrames() frames into out, starting at the current position
+size_t WavReader::read(const AudioBufferView &out){
+    if(!f.is_open()){
+        throw std::runtime_error("WavReader Error: No file open!");
+    }
+    if(out.getNumChannels() != info.num_channels){
+        throw std::invalid_argument("WavReader Error: Buffer has the wrong number of channels!");
+    }
+
+    bool timed = Instrumentation::isEnabled();
+    uint64_t start = timed ? Instrumentation::now() : 0;
+
+    uint64_t remaining = num_samples - position;
+    size_t to_read = (size_t)std::min<uint64_t>(out.getNumFrames(), remaining);
+    size_t frames_per_chunk = raw.size()/info.block_align;
+
+    size_t done = 0;
+    while(done < to_read){
+        size_t frames = std::min(frames_per_chunk, to_read - done);
+        size_t got = fill(frames);
+        AudioBufferView dst = out.slice(done, got);
+        if(packed){
+            decoder.decode(raw.data(), scratch.data(), got*info.num_channels);
+            deinterleave(scratch.data(), dst);
+        } else {
+            decodeFrames(raw.data(), dst, info);
+        }
+        done += got;
+        if(got < frames){
+            break;
+        }
+    }
+    if(timed){
+        Instrumentation::recordDecode(done*info.block_align, Instrumentation::now() - start);
+    }
+    return done;
+}
+
+// Decodes up to frames frames into out as interleaved samples
+// Packed frames decode straight into out, padded ones go through unpacked
+size_t WavReader::readInterleaved(float *out, size_t frames){
+    if(!f.is_open()){
+        throw std::runtime_error("WavReader Error: No file open!");
+    }
+
+    bool timed = Instrumentation::isEnabled();
+    uint64_t start = timed ? Instrumentation::now() : 0;
+
+    uint64_t remaining = num_samples - position;
+    size_t to_read = (size_t)std::min<uint64_t>(frames, remaining);
+    size_t frames_per_chunk = raw.size()/info.block_align;
+
+    size_t done = 0;
+    while(done < to_read){
+        size_t n = std::min(frames_per_chunk, to_read - done);
+        size_t got = fill(n);
+        float *dst = out + done*info.num_channels;
+        if(packed){
+            decoder.decode(raw.data(), dst, got*info.num_channels);
+        } else {
+            if(unpacked.getNumChannels() != info.num_channels || unpacked.getNumFrames() < frames_per_chunk){
+                unpacked.allocate(info.num_channels, frames_per_chunk);
+            }
+            AudioBufferView planar = unpacked.slice(0, got);
+            decodeFrames(raw.data(), planar, info);
+            interleave(planar, dst);
+        }
+        done += got;
+        if(got < n){
+            break;
+        }
+    }
+    if(timed){
+        Instrumentation::recordDecode(done*info.block_align, Instrumentation::now() - start);
+    }
+    return done;
+}
+
+// Move the read position to the given frame
+void WavReader::seek(uint64_t frame){
+    if(frame > num_samples){
+        frame = num_samples;
+    }
+    f.clear();
+    f.seekg(data_offset + (std::streamoff)frame*info.block_align);
+    position = frame;
+}
+
+// Getters
+std::string WavReader::getFileName(){
+    return filename;
+}
+
+uint16_t WavReader::getFormat(){
+    return info.format;
+}
+
+uint16_t WavReader::getNumChannels(){
+    return info.num_channels;
+}
+
+uint32_t WavReader::getSampleRate(){
+    return info.sample_rate;
+}
+
+uint32_t WavReader::getByteRate(){
+    return info.byte_rate;
+}
+
+uint16_t WavReader::getBlockAlign(){
+    return info.block_align;
+}
+
+uint16_t WavReader::getBitsPerSample(){
+    return info.bits_per_sample;
+}
+
+WavContainer WavReader::getContainer(){
+    return container;
+}
+
+uint64_t WavReader::getNumSamples(){
+    return num_samples;
+}
+
+uint64_t WavReader::getPosition(){
+    return position;
+}
@@ -0,0 +1,108 @@
+//
+//  WavReader.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/20.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavReader_hpp
+#define WavReader_hpp
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "AudioBuffer.hpp"
+#include "WavCommon.hpp"
+#include "SampleConversion.hpp"
+
+/* WavReader class
+ *
+ * Streams a wav file from disk in fixed size blocks
+ *
+ * Only the RIFF and fmt chunks are parsed when the file is opened,
+ * samples are decoded on demand so memory use does not depend on the
+ * length of the file
+ *
+ * RF64 and Wave64 files are read too, so positions and lengths are
+ * 64 bit and files past 4GB stream like any other
+ */
+class WavReader {
+public:
+
+    // Default Constructor
+    WavReader();
+
+    // Constructor
+    // Opens the specified wav file and parses its header
+    WavReader(std::string path);
+
+    // Destructor
+    // Closes the file if it is open
+    ~WavReader();
+
+    // Open a new wav file
+    // Stops at the start of the data chunk
+    void open(std::string path);
+
+    // Close the current file
+    void close();
+
+    // Decodes up to out.getNumFrames() frames into out, starting at the current position
+    //
+    // out must have num_channels channels
+    //
+    // returns the number of frames decoded, 0 once the end of the data is reached
+    size_t read(const AudioBufferView &out);
+
+    // Decodes up to frames frames into out as interleaved samples, starting at the current position
+    // Skips the planar round trip when the caller wants interleaved samples anyway
+    //
+    // returns the number of frames decoded, 0 once the end of the data is reached
+    size_t readInterleaved(float *out, size_t frames);
+
+    // Move the read position to the given frame
+    void seek(uint64_t frame);
+
+    bool isOpen();
+
+    // Getters
+    std::string getFileName();
+    uint16_t getFormat();
+    uint16_t getNumChannels();
+    uint32_t getSampleRate();
+    uint32_t getByteRate();
+    uint16_t getBlockAlign();
+    uint16_t getBitsPerSample();
+    WavContainer getContainer();
+    uint64_t getNumSamples();
+    uint64_t getPosition(); // The next frame that will be read
+
+protected:
+private:
+    // Largest number of bytes read from disk at once
+    static const int raw_buffer_size = 1 << 18;
+
+    void init(); // Sets/Resets all fields to zero
+
+    std::ifstream f;
+    std::string filename;
+    WavFormatInfo info;
+
+    WavContainer container;
+    std::streamoff data_offset; // Offset of the first sample in the file
+    uint64_t num_samples; // The number of samples per channel in the file
+    uint64_t position; // The next frame to be decoded
+
+    std::vector<unsigned char> raw; // Undecoded bytes read from disk
+    std::vector<float> scratch; // Decoded but still interleaved samples
+    SampleDecoder decoder; // Picked once per file
+    bool packed; // True if frames have no padding, so the vector kernels can be used
+    AudioBuffer unpacked; // Planar scratch for readInterleaved when frames are padded
+
+    // Reads up to frames frames from disk into raw, returns how many whole frames arrived
+    size_t fill(size_t frames);
+};
+
+#endif /* WavReader_hpp */
@@ -0,0 +1,378 @@
+//
+//  WavWriter.cpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/23.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavWriter.hpp"
+#include "Instrumentation.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// RIFF and RF64 header
+// 'RIFF' or 'RF64', then a JUNK chunk that becomes the ds64 chunk if the file outgrows RIFF,
+// then the fmt chunk, the fact chunk of float files and the data chunk header
+static const std::streamoff riff_size_offset = 4;
+static const std::streamoff ds64_offset = 12;
+static const uint32_t ds64_size = 28;
+
+// Wave64 header
+// Every chunk is a 16 byte GUID and an 8 byte size that counts those 24 bytes too
+static const std::streamoff wave64_riff_size_offset = 16;
+static const uint64_t wave64_chunk_header = 24;
+
+// Sizes of the fmt chunk's body
+static const uint32_t pcm_format_size = 16; // PCMWAVEFORMAT
+static const uint32_t float_format_size = 18; // WAVEFORMATEX with an empty cbSize
+static const uint32_t extensible_format_size = 40; // WAVEFORMATEXTENSIBLE
+
+// The fmt chunk encoding needs with num_channels channels
+// Extensible for more than 2 channels or integers of more than 16 bits, as the spec asks
+static uint32_t formatSize(SampleEncoding encoding, uint16_t num_channels){
+    if(num_channels > 2 || encoding == SampleEncoding::Int24 || encoding == SampleEncoding::Int32){
+        return extensible_format_size;
+    }
+    return encoding == SampleEncoding::Float32 ? float_format_size : pcm_format_size;
+}
+
+// Default speakers of num_channels channels, in the order of the dwChannelMask bits
+// Layouts with no usual meaning are left unassigned
+static uint32_t channelMask(uint16_t num_channels){
+    switch(num_channels){
+        case 1: return 0x4; // Front center
+        case 2: return 0x3; // Front left and right
+        case 3: return 0x7; // Plus front center
+        case 4: return 0x33; // Front and back left and right
+        case 5: return 0x37; // Plus front center
+        case 6: return 0x3F; // 5.1
+        case 7: return 0x70F; // 6.1, with a back center and side left and right
+        case 8: return 0x63F; // 7.1, with side left and right
+        default: return 0;
+    }
+}
+
+// Sets/Resets all fields to zero
+void WavWriter::init(){
+    num_channels = 0;
+    sample_rate = 0;
+    block_align = 0;
+    dither = false;
+    container = WavContainer::Riff;
+    rng_state = 0x9e3779b9;
+    num_samples = 0;
+    clipped_samples = 0;
+    header_size = 0;
+    data_size_offset = 0;
+    fact_offset = 0;
+}
+
+// Default Constructor
+WavWriter::WavWriter(){
+    init();
+}
+
+// Constructor
+// Creates the specified wav file
+WavWriter::WavWriter(std::string path, uint16_t n_channels, uint32_t rate, SampleEncoding encoding, bool dith,
+                     WavContainer cont){
+    init();
+    open(path, n_channels, rate, encoding, dith, cont);
+}
+
+// Destructor
+// Closes the file if it is open
+WavWriter::~WavWriter(){
+    try {
+        close();
+    } catch (...) {
+        // Never throw out of a destructor
+    }
+}
+
+bool WavWriter::isOpen(){
+    return out.is_open();
+}
+
+// Writes a value in little endian
+template <typename T>
+static void put(std::ofstream &out, T value){
+    out.write(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+// Create a new wav file
+// Closes the old file if necessary
+void WavWriter::open(std::string path, uint16_t n_channels, uint32_t rate, SampleEncoding encoding, bool dith,
+                     WavContainer cont){
+    close();
+    init();
+
+    if(n_channels == 0){
+        throw std::runtime_error("WavWriter Error: Can't write a file with no channels!");
+    }
+
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if(!out.is_open()){
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        throw std::runtime_error("WavWriter Error: Could not open file\n");
+    }
+
+    num_channels = n_channels;
+    sample_rate = rate;
+    container = cont;
+    encoder = selectEncoder(encoding);
+    block_align = num_channels*encoder.bytes_per_sample;
+
+    // Floats don't need dither
+    dither = dith && encoding != SampleEncoding::Float32;
+
+    interleaved.resize((size_t)block_frames*num_channels);
+    encoded.resize((size_t)block_frames*block_align);
+    if(dither){
+        noise.resize((size_t)block_frames*num_channels);
+    }
+
+    if(container == WavContainer::Wave64){
+        writeWave64Header(encoding);
+    } else {
+        writeRiffHeader(encoding);
+    }
+}
+
+// Writes the RIFF header, the sizes are filled in by close
+void WavWriter::writeRiffHeader(SampleEncoding encoding){
+    bool rf64 = container == WavContainer::RF64;
+    put<uint32_t>(out, __builtin_bswap32((uint32_t)(rf64 ? WavChunks::RF64Header : WavChunks::RiffHeader)));
+    put<uint32_t>(out, rf64 ? RF64SizeInDs64 : 0);
+    put<uint32_t>(out, __builtin_bswap32(WaveIdentifier));
+
+    // Room for a ds64 chunk, left as JUNK unless the file needs it
+    put<uint32_t>(out, __builtin_bswap32((uint32_t)(rf64 ? WavChunks::DataSize64 : WavChunks::Junk)));
+    put<uint32_t>(out, ds64_size);
+    std::vector<char> zeros(ds64_size, 0);
+    out.write(zeros.data(), ds64_size);
+
+    // fmt chunk, every size used is even so it needs no padding
+    uint32_t format_size = formatSize(encoding, num_channels);
+    put<uint32_t>(out, __builtin_bswap32((uint32_t)WavChunks::Format));
+    put<uint32_t>(out, format_size);
+    writeFormat(encoding, format_size);
+
+    // fact chunk, the frame count is filled in by close
+    if(encoding == SampleEncoding::Float32){
+        put<uint32_t>(out, __builtin_bswap32((uint32_t)WavChunks::Fact));
+        put<uint32_t>(out, 4);
+        fact_offset = out.tellp();
+        put<uint32_t>(out, rf64 ? RF64SizeInDs64 : 0);
+    }
+
+    // data chunk header
+    put<uint32_t>(out, __builtin_bswap32((uint32_t)WavChunks::Data));
+    data_size_offset = out.tellp();
+    put<uint32_t>(out, rf64 ? RF64SizeInDs64 : 0);
+    header_size = (uint64_t)out.tellp();
+}
+
+// Writes the Wave64 header, the sizes are filled in by close
+void WavWriter::writeWave64Header(SampleEncoding encoding){
+    out.write(reinterpret_cast<const char*>(Wave64Riff), 16);
+    put<uint64_t>(out, 0);
+    out.write(reinterpret_cast<const char*>(Wave64Wave), 16);
+
+    // fmt chunk, padded so the next chunk stays 8 byte aligned
+    uint32_t format_size = formatSize(encoding, num_channels);
+    out.write(reinterpret_cast<const char*>(Wave64Format), 16);
+    put<uint64_t>(out, wave64_chunk_header + format_size);
+    writeFormat(encoding, format_size);
+    for(uint32_t i = format_size; i % 8 != 0; ++i){
+        out.put(0);
+    }
+
+    // fact chunk, the frame count is filled in by close
+    if(encoding == SampleEncoding::Float32){
+        out.write(reinterpret_cast<const char*>(Wave64Fact), 16);
+        put<uint64_t>(out, wave64_chunk_header + 4);
+        fact_offset = out.tellp();
+        put<uint32_t>(out, 0);
+        put<uint32_t>(out, 0); // Padding
+    }
+
+    // data chunk header
+    out.write(reinterpret_cast<const char*>(Wave64Data), 16);
+    data_size_offset = out.tellp();
+    put<uint64_t>(out, 0);
+    header_size = (uint64_t)out.tellp();
+}
+
+// Writes the body of a fmt chunk of size bytes, as formatSize picked
+void WavWriter::writeFormat(SampleEncoding encoding, uint32_t size){
+    bool extensible = size == extensible_format_size;
+    put<uint16_t>(out, extensible ? (uint16_t)WavFormat::Extensible : encodingFormatTag(encoding));
+    put<uint16_t>(out, num_channels);
+    put<uint32_t>(out, sample_rate);
+    put<uint32_t>(out, sample_rate*block_align);
+    put<uint16_t>(out, block_align);
+    put<uint16_t>(out, encodingBitsPerSample(encoding));
+    if(size == pcm_format_size){
+        return;
+    }
+
+    // cbSize, the bytes of extension that follow
+    put<uint16_t>(out, (uint16_t)(size - float_format_size));
+    if(extensible){
+        put<uint16_t>(out, encodingBitsPerSample(encoding)); // Valid bits, every bit is used
+        put<uint32_t>(out, channelMask(num_channels));
+        bool is_float = encoding == SampleEncoding::Float32;
+        out.write(reinterpret_cast<const char*>(is_float ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM), 16);
+    }
+}
+
+// Fills in the header sizes and closes the file
+void WavWriter::close(){
+    if(!out.is_open()){
+        return;
+    }
+
+    uint64_t data_size = num_samples*block_align;
+
+    if(container == WavContainer::Wave64){
+        // Chunks are padded to a multiple of 8 bytes, the sizes don't count the padding of the last one
+        uint64_t padding = (8 - data_size%8)%8;
+        for(uint64_t i = 0; i < padding; ++i){
+            out.put(0);
+        }
+        out.seekp(wave64_riff_size_offset);
+        put<uint64_t>(out, header_size + data_size + padding);
+        out.seekp(data_size_offset);
+        put<uint64_t>(out, wave64_chunk_header + data_size);
+        if(fact_offset){
+            out.seekp(fact_offset);
+            put<uint32_t>(out, (uint32_t)std::min(num_samples, (uint64_t)UINT32_MAX));
+        }
+    } else {
+        // Chunks are padded to an even size
+        if(data_size & 1){
+            out.put(0);
+        }
+
+        uint64_t riff_size = header_size - 8 + data_size + (data_size & 1);
+        if(container == WavContainer::RF64 || riff_size > UINT32_MAX){
+            // Too big for RIFF, the JUNK chunk becomes the ds64 chunk that holds the real sizes
+            out.seekp(0);
+            put<uint32_t>(out, __builtin_bswap32((uint32_t)WavChunks::RF64Header));
+            put<uint32_t>(out, RF64SizeInDs64);
+            out.seekp(ds64_offset);
+            put<uint32_t>(out, __builtin_bswap32((uint32_t)WavChunks::DataSize64));
+            put<uint32_t>(out, ds64_size);
+            put<uint64_t>(out, riff_size);
+            put<uint64_t>(out, data_size);
+            put<uint64_t>(out, num_samples);
+            put<uint32_t>(out, 0); // No other chunks need 64 bit sizes
+            out.seekp(data_size_offset);
+            put<uint32_t>(out, RF64SizeInDs64);
+            if(fact_offset){
+                // The frame count is the one in the ds64 chunk
+                out.seekp(fact_offset);
+                put<uint32_t>(out, RF64SizeInDs64);
+            }
+        } else {
+            out.seekp(riff_size_offset);
+            put<uint32_t>(out, (uint32_t)riff_size);
+            out.seekp(data_size_offset);
+            put<uint32_t>(out, (uint32_t)data_size);
+            if(fact_offset){
+                out.seekp(fact_offset);
+                put<uint32_t>(out, (uint32_t)num_samples);
+            }
+        }
+    }
+
+    // The counters stay readable until the next open
+    bool ok = out.good();
+    out.close();
+    if(!ok){
+        throw std::runtime_error("WavWriter Error: Could not write file\n");
+    }
+}
+
+// Converts and writes one block of at most block_frames frames
+void WavWriter::writeBlock(const float *in, int frames){
+    bool timed = Instrumentation::isEnabled();
+    uint64_t start = timed ? Instrumentation::now() : 0;
+    size_t count = (size_t)frames*num_channels;
+
+    if(dither){
+        // TPDF dither, the difference of two uniform values spans +-1 LSB
+        for(size_t i = 0; i < count; ++i){
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 17;
+            rng_state ^= rng_state << 5;
+            float a = (float)(rng_state >> 8)*(1.0f/16777216.0f);
+            rng_state ^= rng_state << 13;
+            rng_state ^= rng_state >> 17;
+            rng_state ^= rng_state << 5;
+            float b = (float)(rng_state >> 8)*(1.0f/16777216.0f);
+            noise[i] = a - b;
+        }
+    }
+
+    clipped_samples += encoder.encode(in, dither ? noise.data() : NULL, encoded.data(), count);
+    out.write(reinterpret_cast<char*>(encoded.data()), (std::streamsize)frames*block_align);
+    num_samples += frames;
+
+    if(timed){
+        Instrumentation::recordEncode((size_t)frames*block_align, Instrumentation::now() - start);
+    }
+}
+
+// Appends the frames of in to the file
+void WavWriter::write(const AudioBufferView &in){
+    if(!out.is_open()){
+        throw std::runtime_error("WavWriter Error: No file open!");
+    }
+    if(in.getNumChannels() != num_channels){
+        throw std::invalid_argument("WavWriter Error: Buffer has the wrong number of channels!");
+    }
+    size_t frames = in.getNumFrames();
+    for(size_t done = 0; done < frames; done += block_frames){
+        size_t n = std::min((size_t)block_frames, frames - done);
+        interleave(in.slice(done, n), interleaved.data());
+        writeBlock(interleaved.data(), (int)n);
+    }
+}
+
+// Appends frames of already interleaved samples to the file
+void WavWriter::writeInterleaved(const float *in, int frames){
+    if(!out.is_open()){
+        throw std::runtime_error("WavWriter Error: No file open!");
+    }
+    for(int done = 0; done < frames; done += block_frames){
+        int n = std::min((int)block_frames, frames - done);
+        writeBlock(in + (size_t)done*num_channels, n);
+    }
+}
+
+// Getters
+uint16_t WavWriter::getNumChannels(){
+    return num_channels;
+}
+
+uint32_t WavWriter::getSampleRate(){
+    return sample_rate;
+}
+
+WavContainer WavWriter::getContainer(){
+    return container;
+}
+
+uint64_t WavWriter::getNumSamples(){
+    return num_samples;
+}
+
+uint64_t WavWriter::getClippedSamples(){
+    return clipped_samples;
+}
@@ -0,0 +1,113 @@
+//
+//  WavWriter.hpp
+//  AudioEffects
+//
+//  Created by John Asper on 2016/8/23.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavWriter_hpp
+#define WavWriter_hpp
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SampleConversion.hpp"
+
+/* WavWriter class
+ *
+ * Streams samples into a new wav file
+ *
+ * Samples are converted and written in large blocks. The header is written
+ * with empty sizes when the file is opened and patched when it is closed,
+ * so the length doesn't need to be known up front.
+ *
+ * RIFF files leave room in their header for a ds64 chunk, and are turned
+ * into RF64 files when they're closed if they grew past 4GB. RF64 and
+ * Wave64 can also be asked for up front.
+ *
+ * The fmt chunk is WAVE_FORMAT_EXTENSIBLE, with the default speaker
+ * layout for the channel count, when there are more than 2 channels or
+ * the samples are integers of more than 16 bits. Float files also get
+ * the cbSize field and a fact chunk that strict readers ask for.
+ *
+ * Integer formats are TPDF dithered by default, and every sample that had
+ * to be clipped to fit the output format is counted.
+ */
+class WavWriter {
+public:
+
+    // Default Constructor
+    WavWriter();
+
+    // Constructor
+    // Creates the specified wav file
+    WavWriter(std::string path, uint16_t num_channels, uint32_t sample_rate,
+              SampleEncoding encoding = SampleEncoding::Float32, bool dither = true,
+              WavContainer container = WavContainer::Riff);
+
+    // Destructor
+    // Closes the file if it is open
+    ~WavWriter();
+
+    // Create a new wav file
+    // Closes the old file if necessary
+    void open(std::string path, uint16_t num_channels, uint32_t sample_rate,
+              SampleEncoding encoding = SampleEncoding::Float32, bool dither = true,
+              WavContainer container = WavContainer::Riff);
+
+    // Fills in the header sizes and closes the file
+    // A RIFF file too big for 32 bit sizes is rewritten as RF64
+    void close();
+
+    // Appends the frames of in to the file
+    // in must have num_channels channels
+    void write(const AudioBufferView &in);
+
+    // Appends frames of already interleaved samples to the file
+    void writeInterleaved(const float *in, int frames);
+
+    bool isOpen();
+
+    // Getters
+    uint16_t getNumChannels();
+    uint32_t getSampleRate();
+    WavContainer getContainer(); // As asked for, a RIFF file can still end up RF64
+    uint64_t getNumSamples(); // Frames written so far
+    uint64_t getClippedSamples(); // Samples clipped so far, across all channels
+
+protected:
+private:
+    // Number of frames converted and written at once
+    static const int block_frames = 1 << 14;
+
+    void init(); // Sets/Resets all fields to zero
+    void writeBlock(const float *interleaved, int frames); // Converts and writes one block
+    void writeRiffHeader(SampleEncoding encoding);
+    void writeWave64Header(SampleEncoding encoding);
+    void writeFormat(SampleEncoding encoding, uint32_t size); // Body of the fmt chunk
+
+    std::ofstream out;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    SampleEncoder encoder;
+    uint16_t block_align;
+    bool dither;
+    WavContainer container;
+    uint32_t rng_state; // State of the dither noise generator
+
+    uint64_t num_samples;
+    uint64_t clipped_samples;
+
+    // Where close fills in the sizes, found while writing the header
+    uint64_t header_size; // Bytes before the samples
+    std::streamoff data_size_offset;
+    std::streamoff fact_offset; // Of the frame count in the fact chunk, 0 if there isn't one
+
+    std::vector<float> interleaved; // Planar input merged into frames
+    std::vector<float> noise; // Dither for the current block
+    std::vector<unsigned char> encoded; // Bytes waiting to be written
+};
+
+#endif /* WavWriter_hpp */
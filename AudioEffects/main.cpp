@@ -7,16 +7,89 @@
 //
 
 #include <iostream>
+#include <cstdlib>
+#include <sys/stat.h>
 #include "WavFile.hpp"
+#include "AnalysisCache.hpp"
 #include "AudioPlayer.hpp"
+#include "BatchRenderer.hpp"
 #include "LowPassFilter.hpp"
+#include "ChannelParallelExecutor.hpp"
+
+// Builds the chain every batch worker renders with
+static AudioEffect *buildChain(void *){
+    return new LowPassFilter();
+}
+
+// AudioEffects --batch <directory or manifest> <output directory> [threads]
+// Renders every file through the chain without playing it
+static int batchRender(int argc, const char * argv[]){
+    if(argc < 4){
+        std::cerr << "Usage: " << argv[0] << " --batch <directory or manifest> <output directory> [threads]" << std::endl;
+        return 1;
+    }
+    std::string source = argv[2];
+    std::string output = argv[3];
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    
+    BatchRenderer renderer(threads);
+    renderer.setChainFactory(buildChain, NULL);
+    
+    struct stat info;
+    if(stat(source.c_str(), &info) == 0 && S_ISDIR(info.st_mode)){
+        renderer.addDirectory(source, output);
+    } else {
+        renderer.loadManifest(source, output);
+    }
+    
+    BatchRenderer::Summary summary = renderer.run();
+    std::cout << summary.toString();
+    return summary.failed == 0 ? 0 : 2;
+}
+
+// AudioEffects --analyze <cache file> <wav file>...
+// Prints the levels and loudness of every file, files that haven't changed since the last run aren't read
+static int analyzeFiles(int argc, const char * argv[]){
+    if(argc < 4){
+        std::cerr << "Usage: " << argv[0] << " --analyze <cache file> <wav file>..." << std::endl;
+        return 1;
+    }
+    AnalysisCache cache(argv[2]);
+    ThreadPool pool;
+    AudioAnalyzer analyzer(&pool);
+    
+    int failed = 0;
+    for(int i = 3; i < argc; ++i){
+        try {
+            std::cout << argv[i] << std::endl << analyzer.analyzeFile(argv[i], &cache).toString() << std::endl;
+        } catch(std::exception &e){
+            std::cerr << argv[i] << ": " << e.what() << std::endl;
+            ++failed;
+        }
+    }
+    cache.save();
+    return failed == 0 ? 0 : 2;
+}
 
 int main(int argc, const char * argv[]) {
+    if(argc > 1 && std::string(argv[1]) == "--batch"){
+        return batchRender(argc, argv);
+    }
+    if(argc > 1 && std::string(argv[1]) == "--analyze"){
+        return analyzeFiles(argc, argv);
+    }
+    
     AudioPlayer player;
     LowPassFilter lp;
     player.setEffects(&lp);
     
     WavFile w("/Users/john/Documents/Xcode Projects/AudioEffects/test.wav");
     player.play(w);
+    
+    // Playing doesn't touch the file's samples, render the effects into it before saving
+    // Wide files get their channels spread across the pool, small ones stay on this thread
+    ThreadPool pool;
+    ChannelParallelExecutor executor(pool);
+    executor.apply(&lp, w.getData(), w.getSampleRate());
     w.save("/Users/john/Documents/Xcode Projects/AudioEffects/save.wav");
 }
@@ -0,0 +1,276 @@
+//
+//  ParameterAutomationTests.cpp
+//  AudioEffectsTests
+//
+//  Created by John Asper on 2016/9/12.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "LowPassFilter.hpp"
+#include "SampleConversion.hpp"
+#include "SegmentParallelExecutor.hpp"
+#include "ThreadPool.hpp"
+
+// Automation has to give the same sweep however the stream is cut up,
+// and has to hold up while other threads post changes mid-block
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if(!(condition)){ \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while(0)
+
+static const int sample_rate = 48000;
+static const int num_channels = 2;
+static const int max_block = 1024;
+static const size_t num_frames = 300000;
+
+// Noise, the same every time
+static void fillInput(AudioBuffer &buffer){
+    buffer.allocate(num_channels, num_frames);
+    uint32_t state = 12345;
+    for(int c = 0; c < num_channels; ++c){
+        for(size_t n = 0; n < num_frames; ++n){
+            state = state*1664525u + 1013904223u;
+            buffer[c][n] = (float)(state >> 8)/8388608.0f - 1.0f;
+        }
+    }
+}
+
+// Ramps that start and end in the middle of blocks, periods and segments
+static void scheduleRamps(LowPassFilter &lp){
+    ParameterAutomation &automation = lp.getAutomation();
+    automation.schedule(LowPassFilter::SweepMax, 0.5f, 1001, 20000);
+    automation.schedule(LowPassFilter::SweepMin, 0.3f, 17777, 333);
+    automation.schedule(LowPassFilter::SweepPeriod, 0.25f, 50001, 70001);
+    automation.schedule(LowPassFilter::SweepMax, 0.99f, 131071, 0);
+    automation.schedule(LowPassFilter::SweepMin, 0.0f, 200003, 90000);
+}
+
+// Block sizes that never line up with the control interval, the same every time
+static size_t nextBlock(uint32_t &state){
+    state = state*1664525u + 1013904223u;
+    return 1 + (state >> 8) % max_block;
+}
+
+static float maxDifference(const AudioBuffer &a, const AudioBuffer &b){
+    float worst = 0.0f;
+    for(int c = 0; c < num_channels; ++c){
+        for(size_t n = 0; n < num_frames; ++n){
+            worst = std::max(worst, fabsf(a[c][n] - b[c][n]));
+        }
+    }
+    return worst;
+}
+
+// The same ramps through process in one go, in uneven blocks, interleaved, and in parallel segments
+static void testPartitioning(){
+    AudioBuffer input;
+    fillInput(input);
+
+    AudioBuffer whole;
+    whole.allocate(num_channels, num_frames);
+    whole.copyFrom(input.view());
+    {
+        LowPassFilter lp;
+        lp.prepare(sample_rate, max_block, num_channels);
+        scheduleRamps(lp);
+        lp.process(whole.view());
+    }
+
+    AudioBuffer blocks;
+    blocks.allocate(num_channels, num_frames);
+    blocks.copyFrom(input.view());
+    {
+        LowPassFilter lp;
+        lp.prepare(sample_rate, max_block, num_channels);
+        scheduleRamps(lp);
+        uint32_t state = 1;
+        for(size_t start = 0; start < num_frames;){
+            size_t n = std::min(nextBlock(state), num_frames - start);
+            lp.process(blocks.slice(start, n));
+            start += n;
+        }
+    }
+    CHECK(maxDifference(whole, blocks) == 0.0f);
+
+    AudioBuffer interleaved;
+    interleaved.allocate(num_channels, num_frames);
+    interleaved.copyFrom(input.view());
+    {
+        LowPassFilter lp;
+        lp.prepare(sample_rate, max_block, num_channels);
+        scheduleRamps(lp);
+        std::vector<float> frames((size_t)max_block*num_channels);
+        uint32_t state = 2;
+        for(size_t start = 0; start < num_frames;){
+            size_t n = std::min(nextBlock(state), num_frames - start);
+            AudioBufferView block = interleaved.slice(start, n);
+            interleave(block, frames.data());
+            lp.processInterleaved(frames.data(), (int)n);
+            deinterleave(frames.data(), block);
+            start += n;
+        }
+    }
+    CHECK(maxDifference(whole, interleaved) == 0.0f);
+
+    // The segments sum the recurrence in a different order, so they only agree to rounding
+    AudioBuffer segments;
+    segments.allocate(num_channels, num_frames);
+    segments.copyFrom(input.view());
+    {
+        ThreadPool pool(4);
+        SegmentParallelExecutor executor(pool);
+        LowPassFilter lp;
+        lp.prepare(sample_rate, SegmentParallelExecutor::block_frames, num_channels);
+        scheduleRamps(lp);
+        executor.process(lp, segments.view());
+    }
+    CHECK(maxDifference(whole, segments) < 1e-4f);
+
+    // The ramps really did move the sweep
+    AudioBuffer still;
+    still.allocate(num_channels, num_frames);
+    still.copyFrom(input.view());
+    {
+        LowPassFilter lp;
+        lp.prepare(sample_rate, max_block, num_channels);
+        lp.process(still.view());
+    }
+    CHECK(maxDifference(whole, still) > 1e-2f);
+}
+
+// Several threads post changes while blocks are processed
+static void testConcurrentPosting(){
+    LowPassFilter lp;
+    lp.prepare(sample_rate, max_block, num_channels);
+
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> stream_frame(0); // Roughly where the audio thread is, for scheduling ahead
+    std::atomic<long> posted(0);
+    std::atomic<long> dropped(0);
+
+    std::vector<std::thread> controls;
+    for(int k = 0; k < 3; ++k){
+        controls.push_back(std::thread([&lp, &running, &stream_frame, &posted, &dropped, k](){
+            uint32_t state = k + 1;
+            while(running){
+                state = state*1664525u + 1013904223u;
+                float value = (float)(state >> 8)/16777216.0f*0.9f;
+                int parameter = (state >> 4) % 2;
+                bool ok;
+                if(k == 2){
+                    ok = lp.getAutomation().schedule(parameter, value, stream_frame + state % 5000, state % 3000);
+                } else {
+                    ok = lp.setParameter(parameter, value, (state % 100)/1000.0f);
+                }
+                (ok ? posted : dropped)++;
+                if(k == 1){
+                    lp.setParameter(LowPassFilter::SweepPeriod, 0.5f + value, 0.1f);
+                }
+            }
+        }));
+    }
+
+    AudioBuffer block;
+    block.allocate(num_channels, max_block);
+    bool finite = true;
+    bool in_range = true;
+    for(int b = 0; b < 2000; ++b){
+        for(int i = 0; i < max_block; ++i){
+            block[0][i] = (i & 1) ? 1.0f : -1.0f;
+            block[1][i] = sinf(i*0.1f);
+        }
+        lp.process(block.view());
+        stream_frame += max_block;
+
+        for(int c = 0; c < num_channels; ++c){
+            for(int i = 0; i < max_block; ++i){
+                finite = finite && std::isfinite(block[c][i]) && fabsf(block[c][i]) <= 1.0f;
+            }
+        }
+        for(int p = LowPassFilter::SweepMin; p <= LowPassFilter::SweepMax; ++p){
+            float value = lp.getAutomation().getValue(p);
+            in_range = in_range && value >= 0.0f && value <= 0.95f;
+        }
+    }
+    running = false;
+    for(size_t i = 0; i < controls.size(); ++i){
+        controls[i].join();
+    }
+
+    CHECK(finite);
+    CHECK(in_range);
+    CHECK(posted > 0);
+
+    // Once the posting stops and the queue has drained, the last change posted still lands
+    lp.process(block.view());
+    CHECK(lp.setParameter(LowPassFilter::SweepMax, 0.25f));
+    for(int b = 0; b < 200; ++b){
+        lp.process(block.view());
+    }
+    CHECK(lp.getAutomation().getValue(LowPassFilter::SweepMax) == 0.25f);
+    printf("%ld changes posted, %ld dropped while processing\n", (long)posted, (long)dropped);
+}
+
+// Values the filter can't run with are clamped, so the output stays within the input's range
+static void testOutOfRange(){
+    const float bad[] = {1.0f, 1.5f, 100.0f, -2.0f, NAN, INFINITY, -INFINITY};
+    const int num_bad = sizeof(bad)/sizeof(bad[0]);
+
+    for(int parameter = LowPassFilter::SweepMin; parameter < LowPassFilter::num_parameters; ++parameter){
+        for(int i = 0; i < num_bad; ++i){
+            LowPassFilter lp;
+            lp.prepare(sample_rate, max_block, num_channels);
+            CHECK(lp.setParameter(parameter, bad[i]));
+            if(parameter == LowPassFilter::SweepPeriod){
+                CHECK(lp.setParameter(LowPassFilter::SweepMax, 0.9f));
+            }
+
+            AudioBuffer block;
+            block.allocate(num_channels, max_block);
+            uint32_t state = 3;
+            bool bounded = true;
+            for(int b = 0; b < 200; ++b){
+                for(int c = 0; c < num_channels; ++c){
+                    for(int n = 0; n < max_block; ++n){
+                        state = state*1664525u + 1013904223u;
+                        block[c][n] = (state & 0x100000) ? 1.0f : -1.0f;
+                    }
+                }
+                lp.process(block.view());
+                for(int c = 0; c < num_channels; ++c){
+                    for(int n = 0; n < max_block; ++n){
+                        bounded = bounded && std::isfinite(block[c][n]) && fabsf(block[c][n]) <= 1.0f;
+                    }
+                }
+            }
+            if(!bounded){
+                fprintf(stderr, "parameter %d set to %g\n", parameter, bad[i]);
+            }
+            CHECK(bounded);
+        }
+    }
+}
+
+int main(){
+    testPartitioning();
+    testConcurrentPosting();
+    testOutOfRange();
+
+    if(failures){
+        fprintf(stderr, "%d check%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("ParameterAutomationTests passed\n");
+    return 0;
+}
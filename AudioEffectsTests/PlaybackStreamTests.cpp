@@ -0,0 +1,268 @@
+//
+//  PlaybackStreamTests.cpp
+//  AudioEffectsTests
+//
+//  Created by John Asper on 2016/9/12.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "PlaybackStream.hpp"
+#include "WavFile.hpp"
+#include "WavWriter.hpp"
+
+// Plays the producer against a consumer driven by a simulated clock
+// The consumer only ever waits on the stream itself, never on real time,
+// so every counter checked here comes out the same on every run
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if(!(condition)){ \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while(0)
+
+static const uint32_t sample_rate = 8000;
+static const int num_channels = 2;
+static const int block_frames = 256; // Producer block
+static const int callback_frames = 256; // Frames asked for by each simulated callback
+
+/* SimulatedClock class
+ *
+ * Stands in for the sound card, time only moves when a callback is made
+ */
+class SimulatedClock {
+public:
+    SimulatedClock(){
+        frames = 0;
+    }
+
+    // One callback worth of time passes
+    void tick(int n){
+        frames += n;
+    }
+
+    double getSeconds(){
+        return (double)frames/sample_rate;
+    }
+
+    uint64_t frames;
+};
+
+/* GateEffect class
+ *
+ * Passes audio through, but holds the producer inside process after
+ * open_blocks blocks until it is released, so the tests decide exactly
+ * when the producer falls behind
+ */
+class GateEffect: public AudioEffect {
+public:
+    GateEffect(int open){
+        open_blocks = open;
+        blocks = 0;
+        released = false;
+    }
+
+    void reset() override {}
+
+    void process(const AudioBufferView &) override {
+        std::unique_lock<std::mutex> guard(lock);
+        ++blocks;
+        if(blocks > open_blocks){
+            released_changed.wait(guard, [this](){ return released; });
+        }
+    }
+
+    void release(){
+        std::lock_guard<std::mutex> guard(lock);
+        released = true;
+        released_changed.notify_all();
+    }
+
+private:
+    int open_blocks;
+    int blocks;
+    bool released;
+    std::mutex lock;
+    std::condition_variable released_changed;
+};
+
+/* ThrowingEffect class
+ *
+ * Fails on the producer thread partway through the stream
+ */
+class ThrowingEffect: public AudioEffect {
+public:
+    ThrowingEffect(int good){
+        good_blocks = good;
+    }
+
+    void reset() override {}
+
+    void process(const AudioBufferView &) override {
+        if(good_blocks-- == 0){
+            throw std::runtime_error("ThrowingEffect Error: Failed on purpose!");
+        }
+    }
+
+private:
+    int good_blocks;
+};
+
+// Writes a file whose samples count up, so anything dropped or repeated shows
+static std::string writeSource(int frames){
+    std::string path = "PlaybackStreamTests.wav";
+    AudioBuffer samples;
+    samples.allocate(num_channels, frames);
+    for(int c = 0; c < num_channels; ++c){
+        for(int n = 0; n < frames; ++n){
+            samples[c][n] = (float)(n + 1)/(1 << 20)*(c ? -1 : 1);
+        }
+    }
+    WavWriter out(path, num_channels, sample_rate);
+    out.write(samples.view());
+    out.close();
+    return path;
+}
+
+// Pulls one callback, appending every frame that came from the stream to played
+static int callback(PlaybackStream &stream, SimulatedClock &clock, std::vector<float> &played){
+    std::vector<float> out((size_t)callback_frames*num_channels, 1.0f);
+    int got = stream.pull(out.data(), callback_frames);
+    played.insert(played.end(), out.begin(), out.begin() + (size_t)got*num_channels);
+    for(size_t i = (size_t)got*num_channels; i < out.size(); ++i){
+        CHECK(out[i] == 0.0f); // The rest is silence
+    }
+    clock.tick(callback_frames);
+    return got;
+}
+
+// True if played is exactly the source, frame for frame
+static bool matchesSource(WavFile &source, const std::vector<float> &played){
+    if(played.size() != (size_t)source.getNumSamples()*num_channels){
+        return false;
+    }
+    for(size_t n = 0; n < source.getNumSamples(); ++n){
+        for(int c = 0; c < num_channels; ++c){
+            if(played[n*num_channels + c] != source[c][n]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The consumer never outruns the producer, so there are no underruns
+static void testSteady(WavFile &source){
+    PlaybackStream stream(1.0f, block_frames);
+    stream.start(source, NULL);
+
+    // One second of 2 channels rounds up to a ring of 16384 samples
+    CHECK(stream.waitForFill(1 << 30) == 8192);
+
+    SimulatedClock clock;
+    std::vector<float> played;
+    while(!stream.isFinished()){
+        stream.waitForFill(callback_frames);
+        callback(stream, clock, played);
+    }
+    stream.stop();
+
+    CHECK(stream.getUnderruns() == 0);
+    CHECK(stream.getFramesPlayed() == source.getNumSamples());
+    CHECK(clock.frames >= source.getNumSamples() && clock.frames < source.getNumSamples() + callback_frames);
+    CHECK(stream.getMinFillLevel() == 0); // The last callback took everything
+    CHECK(stream.getError() == nullptr);
+    CHECK(matchesSource(source, played));
+}
+
+// The producer stalls after four blocks, every callback after those comes up empty
+static void testStall(WavFile &source){
+    GateEffect gate(4);
+    PlaybackStream stream(1.0f, block_frames);
+    stream.start(source, &gate);
+
+    // The producer is held inside its fifth block, so no more than four are ever buffered
+    CHECK(stream.waitForFill(4*block_frames) == 4*block_frames);
+
+    SimulatedClock clock;
+    std::vector<float> played;
+    CHECK(callback(stream, clock, played) == callback_frames);
+    CHECK(stream.getFillLevel() == 3*block_frames);
+    CHECK(stream.getMinFillLevel() == 3*block_frames);
+    for(int i = 0; i < 3; ++i){
+        CHECK(callback(stream, clock, played) == callback_frames);
+    }
+    CHECK(stream.getUnderruns() == 0);
+    CHECK(stream.getMinFillLevel() == 0);
+
+    for(int i = 0; i < 3; ++i){
+        CHECK(callback(stream, clock, played) == 0);
+    }
+    CHECK(stream.getUnderruns() == 3);
+    CHECK(stream.getFramesPlayed() == 4*callback_frames);
+    CHECK(clock.frames == 7*callback_frames);
+
+    // Once the producer catches up nothing else is missed
+    gate.release();
+    while(!stream.isFinished()){
+        stream.waitForFill(callback_frames);
+        callback(stream, clock, played);
+    }
+    stream.stop();
+
+    CHECK(stream.getUnderruns() == 3);
+    CHECK(stream.getFramesPlayed() == source.getNumSamples());
+    CHECK(matchesSource(source, played));
+}
+
+// A failing effect ends the stream, and the failure reaches the consumer
+static void testProducerFailure(WavFile &source){
+    ThrowingEffect effect(2);
+    PlaybackStream stream(1.0f, block_frames);
+    stream.start(source, &effect);
+
+    // Returns once the producer is done, even though the fill level is never reached
+    CHECK(stream.waitForFill(1 << 30) == 2*block_frames);
+    CHECK(stream.isFinished());
+
+    std::exception_ptr error = stream.getError();
+    CHECK(error != nullptr);
+    try {
+        std::rethrow_exception(error);
+    } catch(std::runtime_error &e){
+        CHECK(std::string(e.what()) == "ThrowingEffect Error: Failed on purpose!");
+    }
+
+    // Stopping doesn't throw, and the failure stays until the next start
+    stream.stop();
+    CHECK(stream.getError() == error);
+    stream.start(source, NULL);
+    stream.stop();
+    CHECK(stream.getError() == nullptr);
+}
+
+int main(){
+    std::string path = writeSource(20000);
+    WavFile source(path);
+
+    testSteady(source);
+    testStall(source);
+    testProducerFailure(source);
+
+    remove(path.c_str());
+    if(failures){
+        fprintf(stderr, "%d check%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("PlaybackStreamTests passed\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+//
+//  StaticChainBenchmark.cpp
+//  AudioEffectsTests
+//
+//  Created by John Asper on 2016/9/1.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Clipper.hpp"
+#include "Gain.hpp"
+#include "LowPassFilter.hpp"
+#include "StaticChain.hpp"
+
+// Times the same effects as a linked list of virtual calls and as a StaticChain,
+// and checks both give the same output
+//
+// Usage: StaticChainBenchmark [seconds of audio] [channels]
+
+static const int sample_rate = 44100;
+static const int runs = 5;
+
+// Fastest of runs renders of input through chain, in milliseconds, leaving the last one in output
+static double timeChain(AudioEffect &chain, const AudioBuffer &input, AudioBuffer &output){
+    double best = 1e30;
+    for(int run = 0; run < runs; ++run){
+        output.copyFrom(input.view());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        chain.apply(output.view(), sample_rate);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+static bool sameSamples(const AudioBuffer &a, const AudioBuffer &b){
+    for(int c = 0; c < a.getNumChannels(); ++c){
+        if(memcmp(a[c], b[c], a.getNumFrames()*sizeof(float)) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+static void report(const char *name, double linked, double fused, bool same){
+    printf("%-28s linked %8.2f ms  static %8.2f ms  speedup %5.2fx  %s\n",
+           name, linked, fused, linked/fused, same ? "identical" : "OUTPUT DIFFERS");
+}
+
+int main(int argc, const char *argv[]){
+    double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+    int num_channels = argc > 2 ? atoi(argv[2]) : 2;
+    size_t num_frames = (size_t)(seconds*sample_rate);
+
+    AudioBuffer input, linked_output, static_output;
+    input.allocate(num_channels, num_frames);
+    linked_output.allocate(num_channels, num_frames);
+    static_output.allocate(num_channels, num_frames);
+    srand(1);
+    for(int c = 0; c < num_channels; ++c){
+        for(size_t n = 0; n < num_frames; ++n){
+            input[c][n] = rand()/(float)RAND_MAX*2.0f - 1.0f;
+        }
+    }
+    bool all_same = true;
+
+    // LowPassFilter's process is out of line, so only Gain and Clipper are inlined here
+    {
+        LowPassFilter lowpass;
+        Gain gain(3.0f);
+        Clipper clipper(0.8f);
+        lowpass.setNext(&gain);
+        gain.setNext(&clipper);
+
+        StaticChain<LowPassFilter, Gain, Clipper> chain;
+        chain.get<1>().setGain(3.0f);
+        chain.get<2>().setThreshold(0.8f);
+
+        double linked = timeChain(lowpass, input, linked_output);
+        double fused = timeChain(chain, input, static_output);
+        bool same = sameSamples(linked_output, static_output);
+        report("LowPassFilter Gain Clipper", linked, fused, same);
+        all_same = all_same && same;
+    }
+
+    // Every stage inlines
+    {
+        Gain gain(3.0f);
+        Clipper clipper(0.8f);
+        gain.setNext(&clipper);
+
+        StaticChain<Gain, Clipper> chain;
+        chain.get<0>().setGain(3.0f);
+        chain.get<1>().setThreshold(0.8f);
+
+        double linked = timeChain(gain, input, linked_output);
+        double fused = timeChain(chain, input, static_output);
+        bool same = sameSamples(linked_output, static_output);
+        report("Gain Clipper", linked, fused, same);
+        all_same = all_same && same;
+    }
+
+    return all_same ? 0 : 1;
+}